@@ -23,9 +23,20 @@
 
 #include "hybris-fb.h"
 #include "plugin-logging.h"
+#include "plugin-config.h"
+#include "hybris-thread.h"
+#include "plugin-preload.h"
 
 #include "plugin-api.h"
 
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
 #include <android-config.h>
 #include <system/window.h>
 #include <hardware/gralloc.h>
@@ -41,6 +52,7 @@
  */
 
 typedef enum {
+  HWC2_FUNCTION_GET_DOZE_SUPPORT = 16,
   HWC2_FUNCTION_SET_POWER_MODE = 41,
 } hwc2_function_descriptor_t;
 
@@ -58,6 +70,10 @@ typedef struct hwc2_device
                                            int32_t descriptor);
 } hwc2_device_t;
 
+typedef int32_t (*HWC2_PFN_GET_DOZE_SUPPORT)(hwc2_device_t *device,
+                                             hwc2_display_t display,
+                                             int32_t *outSupport);
+
 typedef int32_t (*HWC2_PFN_SET_POWER_MODE)(hwc2_device_t *device,
                                            hwc2_display_t display,
                                            int32_t mode);
@@ -77,10 +93,52 @@ void        hybris_plugin_fb_unload       (void);
  * FRAMEBUFFER_DEVICE
  * ------------------------------------------------------------------------- */
 
+static void hybris_device_fb_enumerate   (void);
+static void hybris_device_fb_probe_modes (void);
+static bool hybris_device_fb_resolve_request(int disp, int *mode);
 bool        hybris_device_fb_init         (void);
+bool        hybris_device_fb_is_initialized(void);
 void        hybris_device_fb_quit         (void);
+int         hybris_device_fb_get_display_count(void);
+unsigned    hybris_device_fb_get_power_modes(void);
+bool        hybris_device_fb_set_power_mode(int disp, int mode);
 bool        hybris_device_fb_set_power    (bool state);
 
+/* ------------------------------------------------------------------------- *
+ * FRAMEBUFFER_ASYNC_POWER
+ * ------------------------------------------------------------------------- */
+
+static int64_t hybris_fb_async_now_us          (void);
+static void    hybris_fb_trace_open            (void);
+static void    hybris_fb_trace_close           (void);
+static void    hybris_fb_trace_emit            (const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static int     hybris_fb_async_power           (int disp, int mode, int64_t *begin, int64_t *duration);
+static void    hybris_fb_async_account_locked  (int disp, int mode, int64_t begin, int64_t duration, int err);
+static int     hybris_fb_async_transition      (int disp, int mode, bool *skipped, int64_t *duration);
+static int     hybris_fb_async_next_locked     (void);
+static void    hybris_fb_async_task_cb         (void *aptr);
+static bool    hybris_fb_async_start_locked    (void);
+static bool    hybris_fb_async_stop            (void);
+bool           hybris_device_fb_set_power_mode_async(int disp, int mode);
+bool           hybris_device_fb_set_power_async(bool state);
+void           hybris_device_fb_set_power_hook (mce_hybris_fb_power_fn cb);
+mce_hybris_fb_method_t hybris_device_fb_get_power_method(void);
+bool           hybris_device_fb_get_power_stats(mce_hybris_fb_method_t method, mce_hybris_fb_power_stats_t *stats);
+unsigned       hybris_device_fb_get_power_generation(void);
+
+/* ------------------------------------------------------------------------- *
+ * FRAMEBUFFER_POWER_METHODS
+ * ------------------------------------------------------------------------- */
+
+#ifdef HWC_DEVICE_API_VERSION_1_4
+static int  hybris_device_fb_power_hwc20  (int disp, int mode);
+static int  hybris_device_fb_power_hwc14  (int disp, int mode);
+#endif
+#ifdef HWC_DEVICE_API_VERSION_1_0
+static int  hybris_device_fb_power_hwc10  (int disp, int mode);
+#endif
+static int  hybris_device_fb_power_fb     (int disp, int mode);
+
 /* ========================================================================= *
  * FRAMEBUFFER_PLUGIN
  * ========================================================================= */
@@ -100,6 +158,9 @@ hybris_plugin_fb_load(void)
 {
   static bool done = false;
 
+  /* Do not race with background preloading */
+  plugin_preload_wait();
+
   if( done ) {
     goto cleanup;
   }
@@ -159,6 +220,275 @@ static hw_device_t *hybris_device_fb_handle = 0;
 /** Pointer to libhybris frame buffer device object */
 static hw_device_t *hybris_device_hwc_handle = 0;
 
+/** Maximum number of displays: primary + external */
+#define HYBRIS_FB_MAX_DISPLAYS 2
+
+/** How long to wait for in-flight power transition on shutdown [ms] */
+#define HYBRIS_FB_ASYNC_STOP_TIMEOUT 2000
+
+/** Display power control method resolved at hybris_device_fb_init() */
+static int (*hybris_device_fb_power_cb)(int disp, int mode) = 0;
+
+/** Number of displays found at hybris_device_fb_init() */
+static int hybris_device_fb_displays = 0;
+
+/** Mask of MCE_HYBRIS_FB_POWER_MODE_BIT() values usable with the method */
+static unsigned hybris_device_fb_power_modes = 0;
+
+/** Id of hybris_device_fb_power_cb, for statistics and logging */
+static mce_hybris_fb_method_t hybris_device_fb_power_method = MCE_HYBRIS_FB_METHOD_NONE;
+
+/** Human readable names for display power modes */
+static const char * const hybris_device_fb_mode_name[] =
+{
+  [MCE_HYBRIS_FB_POWER_OFF]          = "off",
+  [MCE_HYBRIS_FB_POWER_DOZE]         = "doze",
+  [MCE_HYBRIS_FB_POWER_ON]           = "on",
+  [MCE_HYBRIS_FB_POWER_DOZE_SUSPEND] = "doze-suspend",
+};
+
+/** Human readable names for display power control methods */
+static const char * const hybris_device_fb_method_name[MCE_HYBRIS_FB_METHOD_COUNT] =
+{
+  [MCE_HYBRIS_FB_METHOD_NONE]  = "none",
+  [MCE_HYBRIS_FB_METHOD_HWC20] = "hw composer 2.0 setPowerMode",
+  [MCE_HYBRIS_FB_METHOD_HWC14] = "hw composer 1.4 setPowerMode",
+  [MCE_HYBRIS_FB_METHOD_HWC10] = "hw composer 1.0 blank",
+  [MCE_HYBRIS_FB_METHOD_FB]    = "frame buffer enableScreen",
+};
+
+/** Cached hwc 2.0 setPowerMode() function */
+static HWC2_PFN_SET_POWER_MODE hybris_device_fb_hwc2_set_power_mode = 0;
+
+/** Async display power transition state
+ *
+ * Display power requests can take 50-200 ms to complete on some devices.
+ * To avoid blocking mce mainloop, they can be executed in a worker thread.
+ *
+ * Only the latest request per display is retained - if display state
+ * is toggled while worker is busy, intermediate states are skipped.
+ *
+ * Requests are executed by a thread pool task that exits when there
+ * are no more pending requests.
+ */
+
+typedef struct
+{
+  /** Latest thread pool task, or NULL */
+  hybris_task_t         *task;
+
+  /** Guards all members from here on */
+  pthread_mutex_t        mutex;
+
+  /** Flag for: task is executing pending requests */
+  bool                   running;
+
+  /** Pending request per display: -1 = none, or MCE_HYBRIS_FB_POWER_xxx */
+  int                    pending[HYBRIS_FB_MAX_DISPLAYS];
+
+  /** Current mode per display: -1 = unknown, or MCE_HYBRIS_FB_POWER_xxx */
+  int                    mode[HYBRIS_FB_MAX_DISPLAYS];
+
+  /** Completion callback, called from worker thread */
+  mce_hybris_fb_power_fn hook;
+
+  /** Number of requests superseded before they were executed */
+  unsigned               coalesced;
+
+  /** Per power control method transition statistics */
+  mce_hybris_fb_power_stats_t stats[MCE_HYBRIS_FB_METHOD_COUNT];
+} hybris_fb_async_t;
+
+static hybris_fb_async_t hybris_fb_async =
+{
+  .task     = 0,
+  .mutex    = PTHREAD_MUTEX_INITIALIZER,
+  .running  = false,
+  .pending  = { [0 ... HYBRIS_FB_MAX_DISPLAYS - 1] = -1 },
+  .mode     = { [0 ... HYBRIS_FB_MAX_DISPLAYS - 1] = -1 },
+};
+
+/** Serializes all display power transitions
+ *
+ * Held over current mode check, hal call and mode update, so that a
+ * transition can't be skipped based on state that an in-flight hal
+ * call is about to change. Must be locked before hybris_fb_async.mutex.
+ */
+static pthread_mutex_t hybris_fb_power_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Number of display power hal calls made
+ *
+ * Display power transitions can reset backlight and other state on
+ * kernel / hal side, so write caches elsewhere use changes in this
+ * value as a signal to forget what they think has been written.
+ *
+ * Accessed only via __atomic builtins.
+ */
+static unsigned hybris_fb_power_generation = 0;
+
+/** Latency histogram bucket upper limits [us] */
+static const int64_t hybris_fb_latency_limit[MCE_HYBRIS_FB_LATENCY_BUCKETS - 1] =
+{
+  1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000,
+};
+
+/** File descriptor for ftrace trace_marker, or -1 if not enabled */
+static int hybris_fb_trace_fd = -1;
+
+/* ========================================================================= *
+ * FRAMEBUFFER_POWER_METHODS
+ *
+ * Note: These are called with device handles known to be valid and
+ *       must be kept free of logging etc side effects.
+ * ========================================================================= */
+
+#ifdef HWC_DEVICE_API_VERSION_1_4
+/** Set display power mode via hw composer 2.0 setPowerMode()
+ */
+static int
+hybris_device_fb_power_hwc20(int disp, int mode)
+{
+  hwc2_device_t *hwcdev = (hwc2_device_t *)hybris_device_hwc_handle;
+
+  /* Note: MCE_HYBRIS_FB_POWER_xxx values match hwc2 power modes */
+  return hybris_device_fb_hwc2_set_power_mode(hwcdev, disp, mode);
+}
+
+/** Set display power mode via hw composer 1.4 setPowerMode()
+ */
+static int
+hybris_device_fb_power_hwc14(int disp, int mode)
+{
+  hwc_composer_device_1_t *hwcdev = (hwc_composer_device_1_t *)hybris_device_hwc_handle;
+
+  /* Note: MCE_HYBRIS_FB_POWER_xxx values match HWC_POWER_MODE_xxx */
+  return hwcdev->setPowerMode(hwcdev, disp, mode);
+}
+#endif
+
+#ifdef HWC_DEVICE_API_VERSION_1_0
+/** Set display power via hw composer 1.0 blank()
+ *
+ * Only on and off modes are supported.
+ */
+static int
+hybris_device_fb_power_hwc10(int disp, int mode)
+{
+  hwc_composer_device_1_t *hwcdev = (hwc_composer_device_1_t *)hybris_device_hwc_handle;
+
+  switch( mode ) {
+  case MCE_HYBRIS_FB_POWER_OFF: return hwcdev->blank(hwcdev, disp, true);
+  case MCE_HYBRIS_FB_POWER_ON:  return hwcdev->blank(hwcdev, disp, false);
+  default:                      return -EINVAL;
+  }
+}
+#endif
+
+/** Set display power via frame buffer enableScreen()
+ *
+ * Only primary display and on and off modes are supported.
+ */
+static int
+hybris_device_fb_power_fb(int disp, int mode)
+{
+  framebuffer_device_t *fbdev = (framebuffer_device_t *)hybris_device_fb_handle;
+
+  if( disp != 0 )
+    return -EINVAL;
+
+  switch( mode ) {
+  case MCE_HYBRIS_FB_POWER_OFF: return fbdev->enableScreen(fbdev, false);
+  case MCE_HYBRIS_FB_POWER_ON:  return fbdev->enableScreen(fbdev, true);
+  default:                      return -EINVAL;
+  }
+}
+
+/* ========================================================================= *
+ * FRAMEBUFFER_DEVICE
+ * ========================================================================= */
+
+/** Enumerate displays that can be power controlled
+ *
+ * Primary display is assumed to be always present. Additional
+ * displays are detected via hwc getDisplayConfigs(), which is
+ * available from hwc 1.1 onwards - hwc 2.0 display ids are tied
+ * to hotplug events and only primary display is controlled.
+ *
+ * Note: Only displays connected during init are included.
+ */
+static void
+hybris_device_fb_enumerate(void)
+{
+  hybris_device_fb_displays = 1;
+
+#ifdef HWC_DEVICE_API_VERSION_1_1
+  if( hybris_device_hwc_handle &&
+      (hybris_device_fb_power_method == MCE_HYBRIS_FB_METHOD_HWC14 ||
+       hybris_device_fb_power_method == MCE_HYBRIS_FB_METHOD_HWC10) &&
+      (hybris_device_hwc_handle->version >> 16) >= 0x0101 ) {
+    hwc_composer_device_1_t *hwcdev = (hwc_composer_device_1_t *)hybris_device_hwc_handle;
+
+    for( int disp = 1; hwcdev->getDisplayConfigs && disp < HYBRIS_FB_MAX_DISPLAYS; ++disp ) {
+      uint32_t configs[4];
+      size_t   count = sizeof configs / sizeof *configs;
+
+      if( hwcdev->getDisplayConfigs(hwcdev, disp, configs, &count) != 0 || count < 1 )
+        break;
+
+      hybris_device_fb_displays = disp + 1;
+    }
+  }
+#endif
+
+  mce_log(LL_DEBUG, "power controllable displays: %d", hybris_device_fb_displays);
+}
+
+/** Probe power modes supported by the display power control method
+ *
+ * On and off are always available. Doze modes are available with
+ * hwc 1.4 setPowerMode() and - if hwc reports doze support for the
+ * primary display - with hwc 2.0 setPowerMode().
+ */
+static void
+hybris_device_fb_probe_modes(void)
+{
+  hybris_device_fb_power_modes = (MCE_HYBRIS_FB_POWER_MODE_BIT(MCE_HYBRIS_FB_POWER_OFF) |
+                                  MCE_HYBRIS_FB_POWER_MODE_BIT(MCE_HYBRIS_FB_POWER_ON));
+  bool doze = false;
+
+  switch( hybris_device_fb_power_method ) {
+#ifdef HWC_DEVICE_API_VERSION_1_4
+  case MCE_HYBRIS_FB_METHOD_HWC20:
+    {
+      hwc2_device_t *hwcdev = (hwc2_device_t *)hybris_device_hwc_handle;
+      hwc2_function_pointer_t a_function = hwcdev->getFunction(hwcdev, HWC2_FUNCTION_GET_DOZE_SUPPORT);
+      HWC2_PFN_GET_DOZE_SUPPORT the_function = (HWC2_PFN_GET_DOZE_SUPPORT)(void *)a_function;
+      int32_t support = 0;
+      if( the_function && the_function(hwcdev, 0, &support) == 0 )
+        doze = (support != 0);
+    }
+    break;
+
+  case MCE_HYBRIS_FB_METHOD_HWC14:
+    doze = true;
+    break;
+#endif
+
+  default:
+    break;
+  }
+
+  if( doze ) {
+    hybris_device_fb_power_modes |= (MCE_HYBRIS_FB_POWER_MODE_BIT(MCE_HYBRIS_FB_POWER_DOZE) |
+                                     MCE_HYBRIS_FB_POWER_MODE_BIT(MCE_HYBRIS_FB_POWER_DOZE_SUSPEND));
+  }
+
+  mce_log(LL_DEBUG, "doze power modes: %s", doze ? "supported" : "not supported");
+}
+
+/** Flag for: hybris_device_fb_init() has been called */
+static bool hybris_device_fb_initialized = false;
+
 /** Initialize libhybris frame buffer device object
  *
  * @return true on success, false on failure
@@ -167,13 +497,12 @@ bool
 hybris_device_fb_init(void)
 {
   static bool ack = false;
-  static bool done = false;
 
-  if( done ) {
+  if( hybris_device_fb_initialized ) {
     goto cleanup;
   }
 
-  done = true;
+  hybris_device_fb_initialized = true;
 
   if( !hybris_plugin_fb_load() ) {
     goto cleanup;
@@ -206,8 +535,12 @@ hybris_device_fb_init(void)
 #ifdef HWC_DEVICE_API_VERSION_1_4 // Need 1.4 constants for 2.0 support
         hwc2_device_t *hwcdev = (hwc2_device_t *)hybris_device_hwc_handle;
         if( hwcdev->getFunction ) {
-          if( hwcdev->getFunction(hwcdev, HWC2_FUNCTION_SET_POWER_MODE) ) {
+          hwc2_function_pointer_t a_function = hwcdev->getFunction(hwcdev, HWC2_FUNCTION_SET_POWER_MODE);
+          hybris_device_fb_hwc2_set_power_mode = (HWC2_PFN_SET_POWER_MODE)(void *)a_function;
+          if( hybris_device_fb_hwc2_set_power_mode ) {
             mce_log(LL_DEBUG, "using hw composer 2.0 setPowerMode() method");
+            hybris_device_fb_power_cb     = hybris_device_fb_power_hwc20;
+            hybris_device_fb_power_method = MCE_HYBRIS_FB_METHOD_HWC20;
             ack = true;
             goto cleanup;
           }
@@ -222,6 +555,8 @@ hybris_device_fb_init(void)
         hwc_composer_device_1_t *hwcdev = (hwc_composer_device_1_t *)hybris_device_hwc_handle;
         if( hwcdev->setPowerMode ) {
           mce_log(LL_DEBUG, "using hw composer 1.4 setPowerMode() method");
+          hybris_device_fb_power_cb     = hybris_device_fb_power_hwc14;
+          hybris_device_fb_power_method = MCE_HYBRIS_FB_METHOD_HWC14;
           ack = true;
           goto cleanup;
         }
@@ -235,6 +570,8 @@ hybris_device_fb_init(void)
         hwc_composer_device_1_t *hwcdev = (hwc_composer_device_1_t *)hybris_device_hwc_handle;
         if( hwcdev->blank ) {
           mce_log(LL_DEBUG, "using hw composer 1.0 blank() method");
+          hybris_device_fb_power_cb     = hybris_device_fb_power_hwc10;
+          hybris_device_fb_power_method = MCE_HYBRIS_FB_METHOD_HWC10;
           ack = true;
           goto cleanup;
         }
@@ -269,6 +606,8 @@ hybris_device_fb_init(void)
 
       if( fbdev->enableScreen ) {
         mce_log(LL_DEBUG, "using framebuffer enableScreen() method");
+        hybris_device_fb_power_cb     = hybris_device_fb_power_fb;
+        hybris_device_fb_power_method = MCE_HYBRIS_FB_METHOD_FB;
         ack = true;
         goto cleanup;
       }
@@ -284,14 +623,49 @@ hybris_device_fb_init(void)
 
 cleanup:
 
+  /* Optional tracing, evaluated once */
+  if( ack ) {
+    hybris_device_fb_enumerate();
+    hybris_device_fb_probe_modes();
+    hybris_fb_trace_open();
+  }
+
   return ack;
 }
 
+/** Check whether display power control has been probed already
+ *
+ * Allows reporting capabilities without opening devices.
+ *
+ * @return true if hybris_device_fb_init() has been called, false otherwise
+ */
+bool
+hybris_device_fb_is_initialized(void)
+{
+  return hybris_device_fb_initialized;
+}
+
 /** Release libhybris frame buffer device object
  */
 void
 hybris_device_fb_quit(void)
 {
+  if( !hybris_fb_async_stop() ) {
+    /* Worker is still inside the hal and holds hybris_fb_power_mutex.
+     * Closing devices or resetting the method under it is not safe ->
+     * leave everything as is and leak the handles instead. */
+    mce_log(LL_WARN, "display power hal busy; leaving devices open");
+    return;
+  }
+
+  hybris_fb_trace_close();
+
+  hybris_device_fb_power_cb            = 0;
+  hybris_device_fb_power_method        = MCE_HYBRIS_FB_METHOD_NONE;
+  hybris_device_fb_displays            = 0;
+  hybris_device_fb_power_modes         = 0;
+  hybris_device_fb_hwc2_set_power_mode = 0;
+
   if( hybris_device_hwc_handle ) {
     hybris_device_hwc_handle->close(hybris_device_hwc_handle),
     hybris_device_hwc_handle = 0;
@@ -303,7 +677,133 @@ hybris_device_fb_quit(void)
   }
 }
 
-/** Set frame buffer power state via libhybris
+/** Get number of displays that can be power controlled
+ *
+ * @return number of displays, or 0 if display power can't be controlled
+ */
+int
+hybris_device_fb_get_display_count(void)
+{
+  hybris_device_fb_init();
+
+  return hybris_device_fb_power_cb ? hybris_device_fb_displays : 0;
+}
+
+/** Get mask of supported display power modes
+ *
+ * @return mask of MCE_HYBRIS_FB_POWER_MODE_BIT() values, or 0 if display
+ *         power can't be controlled
+ */
+unsigned
+hybris_device_fb_get_power_modes(void)
+{
+  hybris_device_fb_init();
+
+  return hybris_device_fb_power_modes;
+}
+
+/** Validate display index and map power mode to supported one
+ *
+ * Unsupported low power modes fall back to the next mode that keeps
+ * the display content visible: doze-suspend -> doze -> on.
+ *
+ * @param disp  display index
+ * @param mode  MCE_HYBRIS_FB_POWER_xxx, updated on fallback
+ *
+ * @return true if request can be passed to hal, false otherwise
+ */
+static bool
+hybris_device_fb_resolve_request(int disp, int *mode)
+{
+  int want = *mode;
+
+  if( !hybris_device_fb_init() ) {
+    return false;
+  }
+
+  if( !hybris_device_fb_power_cb ) {
+    /* We already did a warning when probing */
+    mce_log(LL_DEBUG, "no known display power control interfaces");
+    return false;
+  }
+
+  if( disp < 0 || disp >= hybris_device_fb_displays ) {
+    mce_log(LL_WARN, "display %d: not available", disp);
+    return false;
+  }
+
+  if( want < 0 || want >= (int)G_N_ELEMENTS(hybris_device_fb_mode_name) ) {
+    mce_log(LL_WARN, "display %d: invalid power mode %d", disp, want);
+    return false;
+  }
+
+  if( !(hybris_device_fb_power_modes & MCE_HYBRIS_FB_POWER_MODE_BIT(*mode)) &&
+      *mode == MCE_HYBRIS_FB_POWER_DOZE_SUSPEND )
+    *mode = MCE_HYBRIS_FB_POWER_DOZE;
+
+  if( !(hybris_device_fb_power_modes & MCE_HYBRIS_FB_POWER_MODE_BIT(*mode)) &&
+      *mode == MCE_HYBRIS_FB_POWER_DOZE )
+    *mode = MCE_HYBRIS_FB_POWER_ON;
+
+  if( *mode != want ) {
+    mce_log(LL_DEBUG, "display %d: %s not supported, using %s", disp,
+            hybris_device_fb_mode_name[want],
+            hybris_device_fb_mode_name[*mode]);
+  }
+
+  return true;
+}
+
+/** Set display power mode via libhybris
+ *
+ * The power control method is resolved once in hybris_device_fb_init(),
+ * so that this boils down to a single indirect call - or nothing at
+ * all if the display is already in the requested mode.
+ *
+ * Any pending asynchronous request for the display is superseded.
+ *
+ * @param disp  display index
+ * @param mode  MCE_HYBRIS_FB_POWER_xxx
+ *
+ * @return true on success, false on failure
+ */
+bool
+hybris_device_fb_set_power_mode(int disp, int mode)
+{
+  int     err      = -1;
+  int64_t duration = 0;
+  bool    skip     = false;
+
+  if( !hybris_device_fb_resolve_request(disp, &mode) ) {
+    goto cleanup;
+  }
+
+  pthread_mutex_lock(&hybris_fb_async.mutex);
+  if( hybris_fb_async.pending[disp] != -1 ) {
+    hybris_fb_async.pending[disp] = -1;
+    hybris_fb_async.coalesced += 1;
+  }
+  pthread_mutex_unlock(&hybris_fb_async.mutex);
+
+  /* Note: Waits for already executing async transition to finish */
+  err = hybris_fb_async_transition(disp, mode, &skip, &duration);
+
+  if( skip ) {
+    mce_log(LL_DEBUG, "display %d: already %s", disp,
+            hybris_device_fb_mode_name[mode]);
+    goto cleanup;
+  }
+
+  mce_log(err ? LL_WARN : LL_DEBUG, "display %d: %s(%s) -> err=%d (%lld us)",
+          disp, hybris_device_fb_method_name[hybris_device_fb_power_method],
+          hybris_device_fb_mode_name[mode], err, (long long)duration);
+
+cleanup:
+
+  return (err == 0);
+}
+
+/** Set primary display power state via libhybris
  *
  * @param state true to power on, false to power off
  *
@@ -312,83 +812,510 @@ hybris_device_fb_quit(void)
 bool
 hybris_device_fb_set_power(bool state)
 {
-  int err = -1;
+  return hybris_device_fb_set_power_mode(0, state ?
+                                         MCE_HYBRIS_FB_POWER_ON :
+                                         MCE_HYBRIS_FB_POWER_OFF);
+}
 
-  if( !hybris_device_fb_init() ) {
-    goto cleanup;
+/* ========================================================================= *
+ * FRAMEBUFFER_ASYNC_POWER
+ *
+ * Note: Logging functions are not thread safe -> nothing that can
+ *       be called from the worker thread is allowed to log.
+ * ========================================================================= */
+
+/** Get monotonic time stamp
+ *
+ * @return CLOCK_MONOTONIC time in microseconds
+ */
+static int64_t
+hybris_fb_async_now_us(void)
+{
+  struct timespec ts = { 0, 0 };
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * INT64_C(1000000) + ts.tv_nsec / 1000;
+}
+
+/** Open ftrace trace_marker file, if enabled in configuration
+ *
+ * Enabled via:
+ *
+ *   [DisplayConfigHybris]
+ *   TraceMarker=true
+ */
+static void
+hybris_fb_trace_open(void)
+{
+  static const char * const paths[] =
+  {
+    "/sys/kernel/tracing/trace_marker",
+    "/sys/kernel/debug/tracing/trace_marker",
+  };
+
+  static bool done = false;
+
+  gchar *val = 0;
+
+  if( done )
+    goto EXIT;
+
+  done = true;
+
+  val = plugin_config_get_string(MCE_CONF_DISPLAY_CONFIG_HYBRIS_GROUP,
+                                 MCE_CONF_DISPLAY_CONFIG_HYBRIS_TRACE_MARKER,
+                                 0);
+  if( !val || (strcmp(val, "true") && strcmp(val, "1")) )
+    goto EXIT;
+
+  for( size_t i = 0; hybris_fb_trace_fd == -1 && i < G_N_ELEMENTS(paths); ++i )
+    hybris_fb_trace_fd = open(paths[i], O_WRONLY | O_CLOEXEC);
+
+  if( hybris_fb_trace_fd == -1 )
+    mce_log(LL_WARN, "could not open trace_marker: %m");
+  else
+    mce_log(LL_DEBUG, "display power trace markers enabled");
+
+EXIT:
+  g_free(val);
+}
+
+/** Close ftrace trace_marker file
+ */
+static void
+hybris_fb_trace_close(void)
+{
+  if( hybris_fb_trace_fd != -1 ) {
+    close(hybris_fb_trace_fd),
+      hybris_fb_trace_fd = -1;
   }
+}
 
-  /* Try hwc methods */
-  if( hybris_device_hwc_handle ) {
-    int disp  = 0;
+/** Write formatted message to ftrace trace_marker, if enabled
+ *
+ * Note: Called also from worker thread, must not log.
+ *
+ * @param fmt printf style format string
+ * @param ... format arguments
+ */
+static void
+hybris_fb_trace_emit(const char *fmt, ...)
+{
+  char    msg[128];
+  int     len;
+  va_list va;
 
-    uint32_t vers = hybris_device_hwc_handle->version >> 16;
-    mce_log(LL_DEBUG, "hwc_device version: %u.%u", (vers >> 8), (vers & 255));
+  if( hybris_fb_trace_fd == -1 )
+    return;
 
-    if( vers >= 0x0300 ) {
-      /* We do not know what API v3+ might be like -> NOP */
-    }
-    else if( vers >= 0x0200 ) {
-#ifdef HWC_DEVICE_API_VERSION_1_4 // Need 1.4 constants for 2.0 support
-      hwc2_device_t *hwcdev = (hwc2_device_t *)hybris_device_hwc_handle;
-      if( hwcdev->getFunction ) {
-        hwc2_function_pointer_t a_function = hwcdev->getFunction(hwcdev, HWC2_FUNCTION_SET_POWER_MODE);
-        HWC2_PFN_SET_POWER_MODE the_function = (HWC2_PFN_SET_POWER_MODE)(void *)a_function;
-        if( the_function ) {
-          int mode  = state ? HWC_POWER_MODE_NORMAL : HWC_POWER_MODE_OFF;
-          err = the_function(hwcdev, disp, mode);
-          mce_log(err ? LL_WARN : LL_DEBUG,
-                  "hw composer 2.0 setPowerMode(%d) -> err=%d",
-                  mode, err);
-        }
-      }
-#endif
-    }
-    else if( vers >= 0x0104 ) {
-#ifdef HWC_DEVICE_API_VERSION_1_4
-      hwc_composer_device_1_t *hwcdev = (hwc_composer_device_1_t *)hybris_device_hwc_handle;
-      if( hwcdev->setPowerMode ) {
-        int mode  = state ? HWC_POWER_MODE_NORMAL : HWC_POWER_MODE_OFF;
-        err = hwcdev->setPowerMode(hwcdev, disp, mode);
-        mce_log(err ? LL_WARN : LL_DEBUG,
-                "hw composer 1.4 setPowerMode(%d) -> err=%d",
-                mode, err);
-      }
-#endif
-    }
-    else if( vers >= 0x0100 ) {
-#ifdef HWC_DEVICE_API_VERSION_1_0
-      hwc_composer_device_1_t *hwcdev = (hwc_composer_device_1_t *)hybris_device_hwc_handle;
-      if( hwcdev->blank ) {
-        int blank = state ? false : true;
-        err = hwcdev->blank(hwcdev, disp, blank);
-        mce_log(err ? LL_WARN : LL_DEBUG,
-                "hw composer 1.0 blank(%d) -> err=%d",
-                blank, err);
-      }
-#endif
-    }
-    else {
-      /* We have no use for API v0 -> NOP */
+  va_start(va, fmt);
+  len = vsnprintf(msg, sizeof msg, fmt, va);
+  va_end(va);
+
+  /* One write() per marker, errors are ignored */
+  if( len > 0 ) {
+    if( len >= (int)sizeof msg )
+      len = sizeof msg - 1;
+    if( write(hybris_fb_trace_fd, msg, len) == -1 ) {
+      /* nop */
     }
   }
-  /* Try fb methods */
-  else if( hybris_device_fb_handle ) {
-    framebuffer_device_t *fbdev = (framebuffer_device_t *)hybris_device_fb_handle;
-    if( fbdev->enableScreen ) {
-      err = fbdev->enableScreen(fbdev, state);
-      mce_log(err ? LL_WARN : LL_DEBUG,
-              "frame buffer enableScreen(%d) -> err=%d",
-              state, err);
+}
+
+/** Execute display power hal call
+ *
+ * Caller must hold hybris_fb_power_mutex, but not hybris_fb_async.mutex
+ * so that new requests can be queued while the hal is busy.
+ *
+ * @param disp      display index
+ * @param mode      MCE_HYBRIS_FB_POWER_xxx
+ * @param begin     where to store hal call start time [us]
+ * @param duration  where to store time spent in hal [us]
+ *
+ * @return hal error code, zero on success
+ */
+static int
+hybris_fb_async_power(int disp, int mode, int64_t *begin, int64_t *duration)
+{
+  int         err  = -1;
+  const char *name = hybris_device_fb_method_name[hybris_device_fb_power_method];
+
+  hybris_fb_trace_emit("mce-hybris: display_power_begin: method=%s"
+                       " display=%d mode=%s",
+                       name, disp, hybris_device_fb_mode_name[mode]);
+
+  *begin = hybris_fb_async_now_us();
+
+  if( hybris_device_fb_power_cb )
+    err = hybris_device_fb_power_cb(disp, mode);
+
+  *duration = hybris_fb_async_now_us() - *begin;
+
+  hybris_fb_trace_emit("mce-hybris: display_power_end: method=%s"
+                       " display=%d mode=%s err=%d duration_us=%lld",
+                       name, disp, hybris_device_fb_mode_name[mode],
+                       err, (long long)*duration);
+
+  return err;
+}
+
+/** Execute display power transition unless already in requested mode
+ *
+ * Transitions made from mainloop and worker thread are serialized,
+ * so that the current mode check always sees the result of the
+ * previous transition.
+ *
+ * @param disp      display index
+ * @param mode      MCE_HYBRIS_FB_POWER_xxx
+ * @param skipped   where to store flag for: display was already in mode
+ * @param duration  where to store time spent in hal [us]
+ *
+ * @return hal error code, zero on success
+ */
+static int
+hybris_fb_async_transition(int disp, int mode, bool *skipped, int64_t *duration)
+{
+  int     err   = 0;
+  int64_t begin = 0;
+
+  *duration = 0;
+
+  pthread_mutex_lock(&hybris_fb_power_mutex);
+
+  pthread_mutex_lock(&hybris_fb_async.mutex);
+  *skipped = (hybris_fb_async.mode[disp] == mode);
+  pthread_mutex_unlock(&hybris_fb_async.mutex);
+
+  if( !*skipped ) {
+    err = hybris_fb_async_power(disp, mode, &begin, duration);
+
+    pthread_mutex_lock(&hybris_fb_async.mutex);
+    hybris_fb_async_account_locked(disp, mode, begin, *duration, err);
+    pthread_mutex_unlock(&hybris_fb_async.mutex);
+  }
+
+  pthread_mutex_unlock(&hybris_fb_power_mutex);
+
+  return err;
+}
+
+/** Update power transition state and statistics
+ *
+ * Caller must hold hybris_fb_async.mutex.
+ *
+ * @param disp      display index
+ * @param mode      requested MCE_HYBRIS_FB_POWER_xxx
+ * @param begin     hal call start time [us]
+ * @param duration  time spent in hal [us]
+ * @param err       hal error code, zero on success
+ */
+static void
+hybris_fb_async_account_locked(int disp, int mode, int64_t begin,
+                               int64_t duration, int err)
+{
+  mce_hybris_fb_power_stats_t *stats =
+    &hybris_fb_async.stats[hybris_device_fb_power_method];
+
+  int bucket = 0;
+
+  /* On failure the display state is unknown -> retry next time */
+  hybris_fb_async.mode[disp] = err ? -1 : mode;
+
+  /* Whether it succeeded or not, hal call might have reset things */
+  __atomic_add_fetch(&hybris_fb_power_generation, 1, __ATOMIC_RELEASE);
+
+  if( stats->transitions == 0 || stats->min_us > duration )
+    stats->min_us = duration;
+  if( stats->max_us < duration )
+    stats->max_us = duration;
+
+  stats->transitions  += 1;
+  stats->last_begin_us = begin;
+  stats->last_us       = duration;
+  stats->total_us     += duration;
+
+  if( err )
+    stats->failures += 1;
+
+  while( bucket < MCE_HYBRIS_FB_LATENCY_BUCKETS - 1 &&
+         duration >= hybris_fb_latency_limit[bucket] )
+    ++bucket;
+
+  stats->histogram[bucket] += 1;
+}
+
+/** Get display that has async request pending
+ *
+ * Caller must hold hybris_fb_async.mutex.
+ *
+ * @return display index, or -1 if there are no pending requests
+ */
+static int
+hybris_fb_async_next_locked(void)
+{
+  for( int disp = 0; disp < HYBRIS_FB_MAX_DISPLAYS; ++disp ) {
+    if( hybris_fb_async.pending[disp] != -1 )
+      return disp;
+  }
+  return -1;
+}
+
+/** Thread pool task for executing asynchronous power transitions
+ *
+ * Executes pending requests until there are none left.
+ *
+ * @param aptr (unused)
+ */
+static void
+hybris_fb_async_task_cb(void *aptr)
+{
+  (void)aptr;
+
+  hybris_fb_async_t *self = &hybris_fb_async;
+
+  for( ;; ) {
+    mce_hybris_fb_power_fn hook     = 0;
+    int                    err      = 0;
+    int64_t                duration = 0;
+    int                    disp     = -1;
+    int                    mode     = -1;
+    bool                   skip     = false;
+
+    /* Take the latest request, or finish */
+    pthread_mutex_lock(&self->mutex);
+
+    if( (disp = hybris_fb_async_next_locked()) == -1 ) {
+      self->running = false;
+      pthread_mutex_unlock(&self->mutex);
+      break;
     }
+
+    mode = self->pending[disp];
+    self->pending[disp] = -1;
+    hook = self->hook;
+
+    pthread_mutex_unlock(&self->mutex);
+
+    /* Transient toggles that got coalesced back to current
+     * state are skipped without calling the hal */
+    err = hybris_fb_async_transition(disp, mode, &skip, &duration);
+
+    if( hook )
+      hook(disp, mode, err == 0);
   }
-  /* Failed */
-  else {
-    /* We already did a warning when probing */
-    mce_log(LL_DEBUG, "no known display power control interfaces");
+}
+
+/** Make sure pending async requests get executed
+ *
+ * Caller must hold hybris_fb_async.mutex.
+ *
+ * @return true if requests are being executed, false otherwise
+ */
+static bool
+hybris_fb_async_start_locked(void)
+{
+  hybris_fb_async_t *self = &hybris_fb_async;
+
+  if( self->running )
+    goto EXIT;
+
+  /* Previous task has finished or is about to */
+  hybris_task_wait(self->task),
+    self->task = 0;
+
+  if( !(self->task = hybris_task_start("hybris-fb-power",
+                                       hybris_fb_async_task_cb, 0)) ) {
+    mce_log(LL_ERR, "could not start display power task");
+    goto EXIT;
+  }
+
+  self->running = true;
+
+EXIT:
+  return self->running;
+}
+
+/** Wait for async power transitions to finish and log statistics
+ *
+ * If the wait times out, the task is left to finish on its own and the
+ * async state is reset so that it does not refer to the detached task.
+ *
+ * @return true if no transition is in progress, false if the hal call
+ *         made by the task has not returned yet
+ */
+static bool
+hybris_fb_async_stop(void)
+{
+  hybris_fb_async_t *self = &hybris_fb_async;
+
+  pthread_mutex_lock(&self->mutex);
+
+  for( int disp = 0; disp < HYBRIS_FB_MAX_DISPLAYS; ++disp )
+    self->pending[disp] = -1;
+
+  hybris_task_t *task = self->task;
+  self->task = 0;
+
+  pthread_mutex_unlock(&self->mutex);
+
+  /* Pending requests were cleared -> any running task exits soon,
+   * unless it is stuck in the hal - which must not block shutdown */
+  bool done = hybris_task_wait_timeout(task, HYBRIS_FB_ASYNC_STOP_TIMEOUT);
+
+  if( !done )
+    mce_log(LL_WARN, "display power transition did not finish");
+
+  pthread_mutex_lock(&self->mutex);
+
+  /* Detached task no longer counts as running */
+  self->running = false;
+
+  for( int disp = 0; disp < HYBRIS_FB_MAX_DISPLAYS; ++disp ) {
+    self->pending[disp] = -1;
+    self->mode[disp]    = -1;
+  }
+
+  for( int i = 0; i < MCE_HYBRIS_FB_METHOD_COUNT; ++i ) {
+    const mce_hybris_fb_power_stats_t *stats = &self->stats[i];
+
+    if( !stats->transitions )
+      continue;
+
+    mce_log(LL_DEBUG, "%s: transitions=%u failures=%u coalesced=%u"
+            " min=%lld max=%lld avg=%lld last=%lld us",
+            hybris_device_fb_method_name[i],
+            stats->transitions, stats->failures, self->coalesced,
+            (long long)stats->min_us, (long long)stats->max_us,
+            (long long)(stats->total_us / stats->transitions),
+            (long long)stats->last_us);
+  }
+
+  pthread_mutex_unlock(&self->mutex);
+
+  return done;
+}
+
+/** Request display power mode change without blocking
+ *
+ * The request is executed in a worker thread. If the worker is
+ * busy, only the latest of the queued requests per display is
+ * executed. Completion is notified via hook set with
+ * hybris_device_fb_set_power_hook().
+ *
+ * @param disp  display index
+ * @param mode  MCE_HYBRIS_FB_POWER_xxx
+ *
+ * @return true if request was queued, false on failure
+ */
+bool
+hybris_device_fb_set_power_mode_async(int disp, int mode)
+{
+  bool ack = false;
+
+  if( !hybris_device_fb_resolve_request(disp, &mode) ) {
+    goto cleanup;
   }
 
+  pthread_mutex_lock(&hybris_fb_async.mutex);
+  if( hybris_fb_async.pending[disp] != -1 )
+    hybris_fb_async.coalesced += 1;
+  hybris_fb_async.pending[disp] = mode;
+  if( !hybris_fb_async_start_locked() )
+    hybris_fb_async.pending[disp] = -1;
+  else
+    ack = true;
+  pthread_mutex_unlock(&hybris_fb_async.mutex);
+
+  if( !ack ) {
+    goto cleanup;
+  }
+
+  mce_log(LL_DEBUG, "display %d: %s requested", disp,
+          hybris_device_fb_mode_name[mode]);
+
 cleanup:
 
-  return (err == 0);
+  return ack;
+}
+
+/** Request primary display power state change without blocking
+ *
+ * @param state true to power on, false to power off
+ *
+ * @return true if request was queued, false on failure
+ */
+bool
+hybris_device_fb_set_power_async(bool state)
+{
+  return hybris_device_fb_set_power_mode_async(0, state ?
+                                               MCE_HYBRIS_FB_POWER_ON :
+                                               MCE_HYBRIS_FB_POWER_OFF);
+}
+
+/** Set callback for async display power transition completion
+ *
+ * Note: the callback function will be called from worker thread.
+ *
+ * @param cb function to call, or NULL
+ */
+void
+hybris_device_fb_set_power_hook(mce_hybris_fb_power_fn cb)
+{
+  pthread_mutex_lock(&hybris_fb_async.mutex);
+  hybris_fb_async.hook = cb;
+  pthread_mutex_unlock(&hybris_fb_async.mutex);
+}
+
+/** Get display power control method in use
+ *
+ * @return method id, or MCE_HYBRIS_FB_METHOD_NONE
+ */
+mce_hybris_fb_method_t
+hybris_device_fb_get_power_method(void)
+{
+  hybris_device_fb_init();
+
+  return hybris_device_fb_power_method;
+}
+
+/** Get snapshot of display power transition statistics
+ *
+ * @param method  power control method to query
+ * @param stats   where to store the statistics
+ *
+ * @return true on success, false if method is not valid
+ */
+bool
+hybris_device_fb_get_power_stats(mce_hybris_fb_method_t method,
+                                 mce_hybris_fb_power_stats_t *stats)
+{
+  bool ack = false;
+
+  if( !stats || method < 0 || method >= MCE_HYBRIS_FB_METHOD_COUNT ) {
+    goto cleanup;
+  }
+
+  pthread_mutex_lock(&hybris_fb_async.mutex);
+  *stats = hybris_fb_async.stats[method];
+  stats->method    = hybris_device_fb_method_name[method];
+  stats->coalesced = hybris_fb_async.coalesced;
+  pthread_mutex_unlock(&hybris_fb_async.mutex);
+
+  ack = true;
+
+cleanup:
+
+  return ack;
+}
+
+/** Get display power transition generation
+ *
+ * The value changes whenever display power hal call is made, and
+ * can be used for detecting potential loss of backlight state.
+ *
+ * @return display power transition counter
+ */
+unsigned
+hybris_device_fb_get_power_generation(void)
+{
+  return __atomic_load_n(&hybris_fb_power_generation, __ATOMIC_ACQUIRE);
 }
@@ -24,13 +24,26 @@
 #ifndef  HYBRIS_FB_H_
 # define HYBRIS_FB_H_
 
+# include "plugin-api.h"
+
 # include <stdbool.h>
 
-bool hybris_plugin_fb_load      (void);
-void hybris_plugin_fb_unload    (void);
+bool hybris_plugin_fb_load                 (void);
+void hybris_plugin_fb_unload               (void);
+
+bool hybris_device_fb_init                 (void);
+bool hybris_device_fb_is_initialized       (void);
+void hybris_device_fb_quit                 (void);
+int  hybris_device_fb_get_display_count    (void);
+unsigned hybris_device_fb_get_power_modes  (void);
+bool hybris_device_fb_set_power_mode       (int disp, int mode);
+bool hybris_device_fb_set_power_mode_async (int disp, int mode);
+bool hybris_device_fb_set_power            (bool state);
+bool hybris_device_fb_set_power_async      (bool state);
+void hybris_device_fb_set_power_hook       (mce_hybris_fb_power_fn cb);
 
-bool hybris_device_fb_init      (void);
-void hybris_device_fb_quit      (void);
-bool hybris_device_fb_set_power (bool state);
+mce_hybris_fb_method_t hybris_device_fb_get_power_method(void);
+bool hybris_device_fb_get_power_stats      (mce_hybris_fb_method_t method, mce_hybris_fb_power_stats_t *stats);
+unsigned hybris_device_fb_get_power_generation(void);
 
 #endif /* HYBRIS_FB_H_ */
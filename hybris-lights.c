@@ -23,13 +23,54 @@
 
 #include "hybris-lights.h"
 #include "plugin-logging.h"
+#include "plugin-config.h"
+#include "plugin-preload.h"
+#include "hybris-fb.h"
 
 #include "plugin-api.h"
 
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <glib.h>
+
 #include <android-config.h>
 #include <system/window.h>
 #include <hardware/lights.h>
 
+/* ========================================================================= *
+ * TYPES
+ * ========================================================================= */
+
+/** Write deduplication and rate limiting state for one light device */
+typedef struct
+{
+  /** Light name, for diagnostic logging */
+  const char               *name;
+
+  /** Pointer to device handle */
+  struct light_device_t   **handle;
+
+  /** Last level successfully written, or -1 if not known */
+  int                       level;
+
+  /** Display power generation at the time level was written */
+  unsigned                  generation;
+
+  /** Level waiting for minimum write interval to pass, or -1 */
+  int                       pending;
+
+  /** CLOCK_MONOTONIC time of the last write attempt [ms] */
+  int64_t                   written;
+
+  /** Timer id for trailing edge write */
+  guint                     timer_id;
+
+  /** Write statistics */
+  mce_hybris_light_stats_t  stats;
+} hybris_light_cache_t;
+
 /* ========================================================================= *
  * PROTOTYPES
  * ========================================================================= */
@@ -50,6 +91,19 @@ void        hybris_plugin_lights_unload           (void);
 static int  hybris_plugin_lights_open_device      (const char *id, struct light_device_t **pdevice);
 static void hybris_plugin_lights_close_device     (struct light_device_t **pdevice);
 
+/* ------------------------------------------------------------------------- *
+ * LIGHT_CACHE
+ * ------------------------------------------------------------------------- */
+
+static int64_t  hybris_light_now_ms               (void);
+static int      hybris_light_min_interval         (void);
+static bool     hybris_light_write                (hybris_light_cache_t *self, int level);
+static gboolean hybris_light_flush_cb             (gpointer aptr);
+static bool     hybris_light_request              (hybris_light_cache_t *self, int level);
+static void     hybris_light_reset                (hybris_light_cache_t *self);
+static void     hybris_light_invalidate           (hybris_light_cache_t *self);
+static bool     hybris_light_get_stats            (const hybris_light_cache_t *self, mce_hybris_light_stats_t *stats);
+
 /* ------------------------------------------------------------------------- *
  * DISPLAY_BACKLIGHT
  * ------------------------------------------------------------------------- */
@@ -57,14 +111,18 @@ static void hybris_plugin_lights_close_device     (struct light_device_t **pdevi
 bool        hybris_device_backlight_init          (void);
 void        hybris_device_backlight_quit          (void);
 bool        hybris_device_backlight_set_brightness(int level);
+void        hybris_device_backlight_invalidate    (void);
+bool        hybris_device_backlight_get_stats     (mce_hybris_light_stats_t *stats);
 
 /* ------------------------------------------------------------------------- *
  * KEYBOARD_BACKLIGHT
  * ------------------------------------------------------------------------- */
 
 bool        hybris_device_keypad_init             (void);
+bool        hybris_device_keypad_is_initialized   (void);
 void        hybris_device_keypad_quit             (void);
 bool        hybris_device_keypad_set_brightness   (int level);
+bool        hybris_device_keypad_get_stats        (mce_hybris_light_stats_t *stats);
 
 /* ------------------------------------------------------------------------- *
  * INDICATOR_LED
@@ -108,6 +166,9 @@ hybris_plugin_lights_load(void)
 {
   static bool done = false;
 
+  /* Do not race with background preloading */
+  plugin_preload_wait();
+
   if( done ) {
     goto cleanup;
   }
@@ -186,6 +247,245 @@ hybris_plugin_lights_close_device(struct light_device_t **pdevice)
   }
 }
 
+/* ========================================================================= *
+ * LIGHT_CACHE
+ * ========================================================================= */
+
+/** Get monotonic time stamp
+ *
+ * @return CLOCK_MONOTONIC time in milliseconds
+ */
+static int64_t
+hybris_light_now_ms(void)
+{
+  struct timespec ts = { 0, 0 };
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * INT64_C(1000) + ts.tv_nsec / 1000000;
+}
+
+/** Get minimum interval between light HAL writes
+ *
+ * Disabled by default, can be enabled via:
+ *
+ *   [LightsConfigHybris]
+ *   MinWriteInterval=<milliseconds>
+ *
+ * @return minimum interval in milliseconds, or 0 if not limited
+ */
+static int
+hybris_light_min_interval(void)
+{
+  static bool done  = false;
+  static int  value = 0;
+
+  if( !done ) {
+    done = true;
+
+    gchar *val = plugin_config_get_string(MCE_CONF_LIGHTS_CONFIG_HYBRIS_GROUP,
+                                          MCE_CONF_LIGHTS_CONFIG_HYBRIS_MIN_INTERVAL,
+                                          0);
+    if( val )
+      value = clamp_to_range(0, 1000, strtol(val, 0, 0));
+    g_free(val);
+
+    mce_log(LL_DEBUG, "light write interval = %d ms", value);
+  }
+
+  return value;
+}
+
+/** Write brightness level to light HAL device
+ *
+ * @param self  light cache object
+ * @param level 0=off ... 255=maximum brightness
+ *
+ * @return true on success, false on failure
+ */
+static bool
+hybris_light_write(hybris_light_cache_t *self, int level)
+{
+  bool ack = false;
+  struct light_device_t *device = *self->handle;
+
+  /* Assume unknown state until write succeeds */
+  self->level      = -1;
+  self->written    = hybris_light_now_ms();
+  self->generation = hybris_device_fb_get_power_generation();
+
+  if( !device ) {
+    goto cleanup;
+  }
+
+  unsigned lev = clamp_to_range(0, 255, level);
+
+  struct light_state_t lst;
+
+  memset(&lst, 0, sizeof lst);
+
+  lst.color          = (0xff << 24) | (lev << 16) | (lev << 8) | (lev << 0);
+  lst.flashMode      = LIGHT_FLASH_NONE;
+  lst.flashOnMS      = 0;
+  lst.flashOffMS     = 0;
+  lst.brightnessMode = BRIGHTNESS_MODE_USER;
+
+  self->stats.writes += 1;
+
+  if( device->set_light(device, &lst) < 0 ) {
+    self->stats.failures += 1;
+    goto cleanup;
+  }
+
+  self->level = level;
+  ack = true;
+
+cleanup:
+
+  return ack;
+}
+
+/** Timer callback for writing level deferred due to rate limiting
+ *
+ * @param aptr light cache object as void pointer
+ *
+ * @return G_SOURCE_REMOVE
+ */
+static gboolean
+hybris_light_flush_cb(gpointer aptr)
+{
+  hybris_light_cache_t *self = aptr;
+
+  if( !self->timer_id ) {
+    goto cleanup;
+  }
+
+  self->timer_id = 0;
+
+  int level = self->pending;
+  self->pending = -1;
+
+  if( level < 0 || level == self->level ) {
+    goto cleanup;
+  }
+
+  if( !hybris_light_write(self, level) ) {
+    mce_log(LL_WARN, "%s: deferred brightness(%d) failed",
+            self->name, level);
+  }
+
+cleanup:
+
+  return G_SOURCE_REMOVE;
+}
+
+/** Request light brightness level change
+ *
+ * Requests that would not change the level are not passed to HAL,
+ * unless display power has been toggled since the last write.
+ *
+ * If minimum write interval is configured, requests made too soon
+ * after the previous write are held back and only the latest one
+ * is written once the interval has passed.
+ *
+ * @param self  light cache object
+ * @param level 0=off ... 255=maximum brightness
+ *
+ * @return true if level was written or queued, false on failure
+ */
+static bool
+hybris_light_request(hybris_light_cache_t *self, int level)
+{
+  bool ack = true;
+
+  self->stats.requests += 1;
+
+  /* Display power transitions can reset the light on hal side */
+  if( self->generation != hybris_device_fb_get_power_generation() )
+    hybris_light_invalidate(self);
+
+  if( self->timer_id ) {
+    /* Supersede whatever was waiting for the interval to pass */
+    self->stats.coalesced += 1;
+    self->pending = level;
+    goto cleanup;
+  }
+
+  if( level == self->level ) {
+    self->stats.skipped += 1;
+    goto cleanup;
+  }
+
+  int interval = hybris_light_min_interval();
+  int64_t elapsed = hybris_light_now_ms() - self->written;
+
+  if( interval > 0 && elapsed >= 0 && elapsed < interval ) {
+    self->pending  = level;
+    self->timer_id = g_timeout_add(interval - (int)elapsed,
+                                   hybris_light_flush_cb, self);
+    if( self->timer_id ) {
+      goto cleanup;
+    }
+    self->pending = -1;
+  }
+
+  ack = hybris_light_write(self, level);
+
+cleanup:
+
+  return ack;
+}
+
+/** Forget cached light state and cancel pending writes
+ *
+ * @param self  light cache object
+ */
+static void
+hybris_light_reset(hybris_light_cache_t *self)
+{
+  if( self->timer_id ) {
+    g_source_remove(self->timer_id), self->timer_id = 0;
+  }
+
+  if( self->stats.requests ) {
+    mce_log(LL_DEBUG, "%s: requests=%u writes=%u failures=%u"
+            " skipped=%u coalesced=%u", self->name,
+            self->stats.requests, self->stats.writes,
+            self->stats.failures, self->stats.skipped,
+            self->stats.coalesced);
+  }
+
+  self->level   = -1;
+  self->pending = -1;
+}
+
+/** Forget cached light level so that the next request gets written
+ *
+ * @param self  light cache object
+ */
+static void
+hybris_light_invalidate(hybris_light_cache_t *self)
+{
+  self->level = -1;
+}
+
+/** Get light write statistics
+ *
+ * @param self   light cache object
+ * @param stats  where to store statistics
+ *
+ * @return true on success, false on failure
+ */
+static bool
+hybris_light_get_stats(const hybris_light_cache_t *self,
+                       mce_hybris_light_stats_t *stats)
+{
+  if( !stats ) {
+    return false;
+  }
+
+  *stats = self->stats;
+  return true;
+}
+
 /* ========================================================================= *
  * DISPLAY_BACKLIGHT
  * ========================================================================= */
@@ -193,6 +493,17 @@ hybris_plugin_lights_close_device(struct light_device_t **pdevice)
 /** Pointer to libhybris frame display backlight device object */
 static struct light_device_t    *hybris_device_backlight_handle = 0;
 
+/** Write cache for display backlight device */
+static hybris_light_cache_t      hybris_device_backlight_cache  =
+{
+  .name     = "backlight",
+  .handle   = &hybris_device_backlight_handle,
+  .level    = -1,
+  .pending  = -1,
+  .written  = 0,
+  .timer_id = 0,
+};
+
 /** Initialize libhybris display backlight device object
  *
  * @return true on success, false on failure
@@ -228,6 +539,7 @@ cleanup:
 void
 hybris_device_backlight_quit(void)
 {
+  hybris_light_reset(&hybris_device_backlight_cache);
   hybris_plugin_lights_close_device(&hybris_device_backlight_handle);
 }
 
@@ -246,23 +558,8 @@ hybris_device_backlight_set_brightness(int level)
     goto cleanup;
   }
 
-  unsigned lev = clamp_to_range(0, 255, level);
-
-  struct light_state_t lst;
-
-  memset(&lst, 0, sizeof lst);
-
-  lst.color          = (0xff << 24) | (lev << 16) | (lev << 8) | (lev << 0);
-  lst.flashMode      = LIGHT_FLASH_NONE;
-  lst.flashOnMS      = 0;
-  lst.flashOffMS     = 0;
-  lst.brightnessMode = BRIGHTNESS_MODE_USER;
-
-  if( hybris_device_backlight_handle->set_light(hybris_device_backlight_handle, &lst) < 0 ) {
-    goto cleanup;
-  }
-
-  ack = true;
+  ack = hybris_light_request(&hybris_device_backlight_cache,
+                             clamp_to_range(0, 255, level));
 
 cleanup:
 
@@ -272,6 +569,29 @@ cleanup:
   return ack;
 }
 
+/** Make next display backlight brightness request bypass write cache
+ *
+ * For use when the backlight state might have been changed behind
+ * our back, or when the caller explicitly wants to rewrite the level.
+ */
+void
+hybris_device_backlight_invalidate(void)
+{
+  hybris_light_invalidate(&hybris_device_backlight_cache);
+}
+
+/** Get display backlight write statistics
+ *
+ * @param stats  where to store statistics
+ *
+ * @return true on success, false on failure
+ */
+bool
+hybris_device_backlight_get_stats(mce_hybris_light_stats_t *stats)
+{
+  return hybris_light_get_stats(&hybris_device_backlight_cache, stats);
+}
+
 /* ========================================================================= *
  * KEYBOARD_BACKLIGHT
  * ========================================================================= */
@@ -279,6 +599,20 @@ cleanup:
 /** Pointer to libhybris frame keypad backlight device object */
 static struct light_device_t    *hybris_device_keypad_handle    = 0;
 
+/** Flag for: hybris_device_keypad_init() has been called */
+static bool                      hybris_device_keypad_initialized = false;
+
+/** Write cache for keypad backlight device */
+static hybris_light_cache_t      hybris_device_keypad_cache     =
+{
+  .name     = "keypad",
+  .handle   = &hybris_device_keypad_handle,
+  .level    = -1,
+  .pending  = -1,
+  .written  = 0,
+  .timer_id = 0,
+};
+
 /** Initialize libhybris keypad backlight device object
  *
  * @return true on success, false on failure
@@ -286,13 +620,11 @@ static struct light_device_t    *hybris_device_keypad_handle    = 0;
 bool
 hybris_device_keypad_init(void)
 {
-  static bool done = false;
-
-  if( done ) {
+  if( hybris_device_keypad_initialized ) {
     goto cleanup;
   }
 
-  done = true;
+  hybris_device_keypad_initialized = true;
 
   hybris_plugin_lights_open_device(LIGHT_ID_KEYBOARD, &hybris_device_keypad_handle);
 
@@ -309,11 +641,22 @@ cleanup:
   return hybris_device_keypad_handle != 0;
 }
 
+/** Check whether keypad backlight device has been probed already
+ *
+ * @return true if hybris_device_keypad_init() has been called, false otherwise
+ */
+bool
+hybris_device_keypad_is_initialized(void)
+{
+  return hybris_device_keypad_initialized;
+}
+
 /** Release libhybris keypad backlight device object
  */
 void
 hybris_device_keypad_quit(void)
 {
+  hybris_light_reset(&hybris_device_keypad_cache);
   hybris_plugin_lights_close_device(&hybris_device_keypad_handle);
 }
 
@@ -332,23 +675,8 @@ hybris_device_keypad_set_brightness(int level)
     goto cleanup;
   }
 
-  unsigned lev = clamp_to_range(0, 255, level);
-
-  struct light_state_t lst;
-
-  memset(&lst, 0, sizeof lst);
-
-  lst.color          = (0xff << 24) | (lev << 16) | (lev << 8) | (lev << 0);
-  lst.flashMode      = LIGHT_FLASH_NONE;
-  lst.flashOnMS      = 0;
-  lst.flashOffMS     = 0;
-  lst.brightnessMode = BRIGHTNESS_MODE_USER;
-
-  if( hybris_device_keypad_handle->set_light(hybris_device_keypad_handle, &lst) < 0 ) {
-    goto cleanup;
-  }
-
-  ack = true;
+  ack = hybris_light_request(&hybris_device_keypad_cache,
+                             clamp_to_range(0, 255, level));
 
 cleanup:
 
@@ -358,6 +686,18 @@ cleanup:
   return ack;
 }
 
+/** Get keypad backlight write statistics
+ *
+ * @param stats  where to store statistics
+ *
+ * @return true on success, false on failure
+ */
+bool
+hybris_device_keypad_get_stats(mce_hybris_light_stats_t *stats)
+{
+  return hybris_light_get_stats(&hybris_device_keypad_cache, stats);
+}
+
 /* ========================================================================= *
  * INDICATOR_LED
  * ========================================================================= */
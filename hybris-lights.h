@@ -24,6 +24,8 @@
 #ifndef  HYBRIS_LIGHTS_H_
 # define HYBRIS_LIGHTS_H_
 
+# include "plugin-api.h"
+
 # include <stdbool.h>
 
 bool hybris_plugin_lights_load       (void);
@@ -32,10 +34,14 @@ void hybris_plugin_lights_unload     (void);
 bool hybris_device_backlight_init           (void);
 void hybris_device_backlight_quit           (void);
 bool hybris_device_backlight_set_brightness (int level);
+void hybris_device_backlight_invalidate     (void);
+bool hybris_device_backlight_get_stats      (mce_hybris_light_stats_t *stats);
 
 bool hybris_device_keypad_init              (void);
+bool hybris_device_keypad_is_initialized    (void);
 void hybris_device_keypad_quit              (void);
 bool hybris_device_keypad_set_brightness    (int level);
+bool hybris_device_keypad_get_stats         (mce_hybris_light_stats_t *stats);
 
 bool hybris_device_indicator_init           (void);
 void hybris_device_indicator_quit           (void);
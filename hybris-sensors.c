@@ -24,12 +24,49 @@
 #include "hybris-sensors.h"
 #include "plugin-logging.h"
 #include "hybris-thread.h"
+#include "plugin-config.h"
+#include "plugin-preload.h"
 
 #include <android-config.h>
 #include <hardware/sensors.h>
 
+#include <sched.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
 #include <glib.h>
 
+/* ========================================================================= *
+ * TYPES
+ * ========================================================================= */
+
+/** Sensor selection policies */
+typedef enum
+{
+  /** Use the first sensor of given type listed by HAL */
+  SENSOR_POLICY_FIRST,
+
+  /** Use the sensor of given type with the lowest power rating */
+  SENSOR_POLICY_LOWEST_POWER,
+} hybris_sensor_policy_t;
+
+/** How events from a sensor handle are dispatched by the worker thread */
+typedef enum
+{
+  SENSOR_ROLE_NONE,
+  SENSOR_ROLE_PS,
+  SENSOR_ROLE_ALS,
+  SENSOR_ROLE_GENERIC,
+} hybris_sensor_role_t;
+
+/** Number of sensor handles that can be dispatched via look up table */
+#define HYBRIS_SENSORS_MAX_HANDLES 256
+
+/** Delay before closing sensor poll device after last sensor is disabled [ms] */
+#define HYBRIS_SENSORS_IDLE_DELAY  5000
+
 /* ========================================================================= *
  * PROTOTYPES
  * ========================================================================= */
@@ -38,10 +75,17 @@
  * SENSORS_PLUGIN
  * ------------------------------------------------------------------------- */
 
+static hybris_sensor_policy_t hybris_plugin_sensors_get_policy   (void);
+static bool                   hybris_plugin_sensors_is_wakeup    (const struct sensor_t *sensor);
+static const struct sensor_t *hybris_plugin_sensors_select       (int type, const char *name_key, bool wakeup);
 static const struct sensor_t *hybris_plugin_sensors_get_sensor   (int type);
+static void                   hybris_plugin_sensors_update_dispatch(void);
+static hybris_sensor_role_t   hybris_plugin_sensors_get_role     (const sensors_event_t *eve);
 
+bool                          hybris_plugin_sensors_preload      (void);
 bool                          hybris_plugin_sensors_load         (void);
 void                          hybris_plugin_sensors_unload       (void);
+bool                          hybris_plugin_sensors_get_caps     (uint32_t *types, int32_t *min_delay, bool *ps_wakeup);
 
 static bool                   hybris_plugin_sensors_open_device  (struct sensors_poll_device_t **pdevice);
 static void                   hybris_plugin_sensors_close_device (struct sensors_poll_device_t **pdevice);
@@ -50,11 +94,47 @@ static void                   hybris_plugin_sensors_close_device (struct sensors
  * SENSORS_DEVICE
  * ------------------------------------------------------------------------- */
 
+static void                   hybris_device_sensors_synchronize  (void);
 static void                   hybris_device_sensors_thread_cb    (void *aptr);
 
 static bool                   hybris_device_sensors_init         (void);
 static void                   hybris_device_sensors_quit         (void);
 
+static int64_t                hybris_device_sensors_now_us       (void);
+static bool                   hybris_device_sensors_idle_enabled (void);
+static bool                   hybris_device_sensors_in_use       (void);
+static bool                   hybris_device_sensors_probe        (void);
+static bool                   hybris_device_sensors_acquire      (void);
+static gboolean               hybris_device_sensors_idle_cb      (gpointer aptr);
+static void                   hybris_device_sensors_release      (void);
+static bool                   hybris_device_sensors_activate     (const struct sensor_t *sensor, bool state);
+bool                          hybris_device_sensors_get_stats    (mce_hybris_sensor_stats_t *stats);
+
+/* ------------------------------------------------------------------------- *
+ * SENSORS_WATCHDOG
+ * ------------------------------------------------------------------------- */
+
+static int64_t                hybris_sensors_watchdog_get_timeout(void);
+static void                   hybris_sensors_watchdog_feed       (void);
+static void                   hybris_sensors_watchdog_kick       (void);
+static void                   hybris_sensors_watchdog_toggle     (const struct sensor_t *sensor);
+static void                   hybris_sensors_watchdog_reactivate (void);
+static void                   hybris_sensors_watchdog_reopen     (void);
+static gboolean               hybris_sensors_watchdog_timer_cb   (gpointer aptr);
+static void                   hybris_sensors_watchdog_start      (void);
+static void                   hybris_sensors_watchdog_stop       (void);
+
+/* ------------------------------------------------------------------------- *
+ * SENSORS_CLOCK
+ * ------------------------------------------------------------------------- */
+
+static int64_t                hybris_sensors_clock_now_ns        (clockid_t id);
+static void                   hybris_sensors_clock_reset         (void);
+static void                   hybris_sensors_clock_begin         (void);
+static void                   hybris_sensors_clock_calibrate     (int64_t timestamp);
+static int64_t                hybris_sensors_clock_convert       (int64_t timestamp);
+static void                   hybris_sensors_clock_get_stats     (mce_hybris_sensor_stats_t *stats);
+
 /* ------------------------------------------------------------------------- *
  * PROXIMITY_SENSOR
  * ------------------------------------------------------------------------- */
@@ -63,6 +143,33 @@ bool                          hybris_sensor_ps_init              (void);
 void                          hybris_sensor_ps_quit              (void);
 void                          hybris_sensor_ps_set_hook          (mce_hybris_ps_fn cb);
 bool                          hybris_sensor_ps_set_active        (bool state);
+bool                          hybris_sensor_ps_set_wakeup        (bool wakeup);
+
+/* ------------------------------------------------------------------------- *
+ * PROXIMITY_DEBOUNCE
+ * ------------------------------------------------------------------------- */
+
+static int                    hybris_ps_debounce_get_hold        (const char *key);
+static int64_t                hybris_ps_debounce_now_ns          (void);
+static void                   hybris_ps_debounce_unlock_cb       (void *aptr);
+static void                   hybris_ps_debounce_thread_cb       (void *aptr);
+static void                   hybris_ps_debounce_input           (mce_hybris_ps_fn cb, int64_t timestamp, float distance);
+static void                   hybris_ps_debounce_reset           (void);
+static void                   hybris_ps_debounce_synchronize     (void);
+static void                   hybris_ps_debounce_get_stats       (mce_hybris_sensor_stats_t *stats);
+static void                   hybris_ps_debounce_start           (void);
+static void                   hybris_ps_debounce_stop            (void);
+
+/* ------------------------------------------------------------------------- *
+ * ALS_FILTER
+ * ------------------------------------------------------------------------- */
+
+static float                  hybris_als_filter_get_float        (const char *key, float def, float lo, float hi);
+static void                   hybris_als_filter_setup            (void);
+static void                   hybris_als_filter_reset            (void);
+static float                  hybris_als_filter_median           (void);
+static bool                   hybris_als_filter_input            (float lux, float *out);
+static void                   hybris_als_filter_get_stats        (mce_hybris_sensor_stats_t *stats);
 
 /* ------------------------------------------------------------------------- *
  * AMBIENT_LIGHT_SENSOR
@@ -73,6 +180,19 @@ void                          hybris_device_als_quit             (void);
 void                          hybris_device_als_set_hook         (mce_hybris_als_fn cb);
 bool                          hybris_device_als_set_active       (bool state);
 
+/* ------------------------------------------------------------------------- *
+ * GENERIC_SENSORS
+ * ------------------------------------------------------------------------- */
+
+static bool                   hybris_device_sensor_is_generic    (int type);
+static int                    hybris_device_sensor_value_count   (int type);
+static void                   hybris_device_sensor_deactivate_all(void);
+
+bool                          hybris_device_sensor_init          (int type);
+void                          hybris_device_sensor_quit          (void);
+void                          hybris_device_sensor_set_hook      (mce_hybris_sensor_fn cb);
+bool                          hybris_device_sensor_set_active    (int type, bool state);
+
 /* ========================================================================= *
  * SENSORS_PLUGIN
  * ========================================================================= */
@@ -92,6 +212,139 @@ static const struct sensor_t   *hybris_plugin_sensors_ps_sensor = 0;
 /** Pointer to libhybris ambient light sensor object */
 static const struct sensor_t   *hybris_plugin_sensors_als_sensor = 0;
 
+/** Sensors selected for use via generic sensor interface, by type */
+static const struct sensor_t   *hybris_plugin_sensors_generic[32];
+
+/** Sensor handle to event dispatching role look up table
+ *
+ * Written from mainloop, read from worker thread. Accessed only
+ * via __atomic builtins.
+ */
+static uint8_t                  hybris_plugin_sensors_dispatch_lut[HYBRIS_SENSORS_MAX_HANDLES];
+
+/** Get sensor selection policy
+ *
+ * Can be configured via:
+ *
+ *   [SensorConfigHybris]
+ *   SelectionPolicy=<first|lowest-power>
+ *
+ * @return sensor selection policy
+ */
+static hybris_sensor_policy_t
+hybris_plugin_sensors_get_policy(void)
+{
+  static bool                   done   = false;
+  static hybris_sensor_policy_t policy = SENSOR_POLICY_LOWEST_POWER;
+
+  if( !done ) {
+    done = true;
+
+    gchar *val = plugin_config_get_string(MCE_CONF_SENSOR_CONFIG_HYBRIS_GROUP,
+                                          MCE_CONF_SENSOR_CONFIG_HYBRIS_POLICY,
+                                          0);
+    if( !g_strcmp0(val, "first") ) {
+      policy = SENSOR_POLICY_FIRST;
+    }
+    g_free(val);
+  }
+
+  return policy;
+}
+
+/** Predicate for: sensor is a wake-up sensor
+ *
+ * @param sensor sensor object
+ *
+ * @return true if sensor wakes up the device, false otherwise
+ */
+static bool
+hybris_plugin_sensors_is_wakeup(const struct sensor_t *sensor)
+{
+#ifdef SENSOR_FLAG_WAKE_UP_SENSOR
+  return (sensor->flags & SENSOR_FLAG_WAKE_UP_SENSOR) != 0;
+#else
+  (void)sensor;
+  return false;
+#endif
+}
+
+/** Select sensor object to use for given type
+ *
+ * If name of the sensor to use is configured, that is used.
+ * Otherwise sensors with matching wake-up capability are preferred
+ * and selection between those is done according to the configured
+ * selection policy.
+ *
+ * @param type     SENSOR_TYPE_LIGHT etc
+ * @param name_key config key for explicit sensor name, or NULL
+ * @param wakeup   true to prefer wake-up sensors, false to avoid them
+ *
+ * @return sensor pointer, or NULL if not available
+ */
+static const struct sensor_t *
+hybris_plugin_sensors_select(int type, const char *name_key, bool wakeup)
+{
+  const struct sensor_t *res  = 0;
+  gchar                 *name = 0;
+
+  if( name_key ) {
+    name = plugin_config_get_string(MCE_CONF_SENSOR_CONFIG_HYBRIS_GROUP,
+                                    name_key, 0);
+  }
+
+  hybris_sensor_policy_t policy = hybris_plugin_sensors_get_policy();
+
+  for( int i = 0; i < hybris_plugin_sensors_cnt; ++i ) {
+    const struct sensor_t *sensor = &hybris_plugin_sensors_lut[i];
+
+    if( sensor->type != type ) {
+      continue;
+    }
+
+    if( name ) {
+      if( !g_strcmp0(sensor->name, name) ) {
+        res = sensor;
+        break;
+      }
+      continue;
+    }
+
+    if( !res ) {
+      res = sensor;
+      continue;
+    }
+
+    bool res_match = hybris_plugin_sensors_is_wakeup(res) == wakeup;
+    bool cur_match = hybris_plugin_sensors_is_wakeup(sensor) == wakeup;
+
+    if( res_match != cur_match ) {
+      if( cur_match ) {
+        res = sensor;
+      }
+      continue;
+    }
+
+    if( policy == SENSOR_POLICY_LOWEST_POWER && sensor->power < res->power ) {
+      res = sensor;
+    }
+  }
+
+  if( name && !res ) {
+    mce_log(LL_WARN, "configured sensor '%s' not found", name);
+  }
+
+  if( res ) {
+    mce_log(LL_DEBUG, "type %d: using '%s' handle=%d power=%g mA%s",
+            type, res->name, res->handle, res->power,
+            hybris_plugin_sensors_is_wakeup(res) ? " wake-up" : "");
+  }
+
+  g_free(name);
+
+  return res;
+}
+
 /** Helper for locating sensor objects by type
  *
  * @param type SENSOR_TYPE_LIGHT etc
@@ -101,35 +354,111 @@ static const struct sensor_t   *hybris_plugin_sensors_als_sensor = 0;
 static const struct sensor_t *
 hybris_plugin_sensors_get_sensor(int type)
 {
-  const struct sensor_t *res = 0;
+  if( type == SENSOR_TYPE_PROXIMITY ) {
+    return hybris_plugin_sensors_ps_sensor;
+  }
+
+  if( type == SENSOR_TYPE_LIGHT ) {
+    return hybris_plugin_sensors_als_sensor;
+  }
+
+  if( type > 0 && type < (int)G_N_ELEMENTS(hybris_plugin_sensors_generic) ) {
+    return hybris_plugin_sensors_generic[type];
+  }
+
+  return 0;
+}
 
+/** Rebuild sensor handle to dispatch role look up table
+ *
+ * Only events from the selected sensors are forwarded; events from
+ * other variants of the same sensor type are ignored.
+ */
+static void
+hybris_plugin_sensors_update_dispatch(void)
+{
   for( int i = 0; i < hybris_plugin_sensors_cnt; ++i ) {
+    const struct sensor_t *sensor = &hybris_plugin_sensors_lut[i];
+    hybris_sensor_role_t   role   = SENSOR_ROLE_NONE;
+
+    if( sensor->handle < 0 || sensor->handle >= HYBRIS_SENSORS_MAX_HANDLES ) {
+      continue;
+    }
 
-    if( hybris_plugin_sensors_lut[i].type == type ) {
-      res = &hybris_plugin_sensors_lut[i];
-      break;
+    if( sensor == hybris_plugin_sensors_ps_sensor ) {
+      role = SENSOR_ROLE_PS;
+    }
+    else if( sensor == hybris_plugin_sensors_als_sensor ) {
+      role = SENSOR_ROLE_ALS;
     }
+    else if( hybris_device_sensor_is_generic(sensor->type) &&
+             sensor == hybris_plugin_sensors_generic[sensor->type] ) {
+      role = SENSOR_ROLE_GENERIC;
+    }
+
+    __atomic_store_n(&hybris_plugin_sensors_dispatch_lut[sensor->handle],
+                     role, __ATOMIC_RELAXED);
   }
+}
 
-  return res;
+/** Get dispatching role for a sensor event
+ *
+ * For use from worker thread.
+ *
+ * @param eve sensor event
+ *
+ * @return how the event should be dispatched
+ */
+static hybris_sensor_role_t
+hybris_plugin_sensors_get_role(const sensors_event_t *eve)
+{
+  if( eve->sensor >= 0 && eve->sensor < HYBRIS_SENSORS_MAX_HANDLES ) {
+    hybris_sensor_role_t role =
+      __atomic_load_n(&hybris_plugin_sensors_dispatch_lut[eve->sensor],
+                      __ATOMIC_RELAXED);
+
+    /* Ignore e.g. meta data events referring to sensor handles */
+    if( role == SENSOR_ROLE_PS && eve->type != SENSOR_TYPE_PROXIMITY ) {
+      role = SENSOR_ROLE_NONE;
+    }
+    else if( role == SENSOR_ROLE_ALS && eve->type != SENSOR_TYPE_LIGHT ) {
+      role = SENSOR_ROLE_NONE;
+    }
+
+    return role;
+  }
+
+  /* Fall back to dispatching by sensor type */
+  switch( eve->type ) {
+  case SENSOR_TYPE_PROXIMITY:
+    return SENSOR_ROLE_PS;
+  case SENSOR_TYPE_LIGHT:
+    return SENSOR_ROLE_ALS;
+  default:
+    break;
+  }
+
+  return SENSOR_ROLE_GENERIC;
 }
 
-/** Load libhybris sensors plugin
+/** Flag for: hybris_plugin_sensors_preload() has been called */
+static bool hybris_plugin_sensors_preloaded = false;
+
+/** Load libhybris sensors module and fetch list of sensors
  *
- * Also initializes look up table for supported sensors.
+ * Does not access configuration, and can thus be executed from
+ * background preload worker thread.
  *
  * @return true on success, false on failure
  */
 bool
-hybris_plugin_sensors_load(void)
+hybris_plugin_sensors_preload(void)
 {
-  static bool done = false;
-
-  if( done ) {
+  if( hybris_plugin_sensors_preloaded ) {
     goto cleanup;
   }
 
-  done = true;
+  hybris_plugin_sensors_preloaded = true;
 
   {
     const struct hw_module_t *mod = 0;
@@ -152,8 +481,66 @@ hybris_plugin_sensors_load(void)
   hybris_plugin_sensors_cnt = hybris_plugin_sensors_handle->get_sensors_list(hybris_plugin_sensors_handle,
                                                                              &hybris_plugin_sensors_lut);
 
-  hybris_plugin_sensors_als_sensor = hybris_plugin_sensors_get_sensor(SENSOR_TYPE_LIGHT);
-  hybris_plugin_sensors_ps_sensor  = hybris_plugin_sensors_get_sensor(SENSOR_TYPE_PROXIMITY);
+cleanup:
+
+  return hybris_plugin_sensors_handle != 0;
+}
+
+/** Load libhybris sensors plugin
+ *
+ * Also initializes look up table for supported sensors.
+ *
+ * Note: Sensor selection uses configuration, which can be accessed
+ *       only from the main thread.
+ *
+ * @return true on success, false on failure
+ */
+bool
+hybris_plugin_sensors_load(void)
+{
+  static bool done = false;
+
+  /* Do not race with background preloading */
+  plugin_preload_wait();
+
+  if( done ) {
+    goto cleanup;
+  }
+
+  done = true;
+
+  if( !hybris_plugin_sensors_preload() ) {
+    goto cleanup;
+  }
+
+  {
+    /* Prefer wake-up proximity sensor unless configured otherwise.
+     * On android the wake-up variant is usually listed first, and
+     * mce relies on getting proximity changes e.g. during calls. */
+    gchar *val = plugin_config_get_string(MCE_CONF_SENSOR_CONFIG_HYBRIS_GROUP,
+                                          MCE_CONF_SENSOR_CONFIG_HYBRIS_PS_WAKEUP,
+                                          0);
+    bool wakeup = !val || !strcmp(val, "true") || !strcmp(val, "1");
+    g_free(val);
+
+    hybris_plugin_sensors_als_sensor =
+      hybris_plugin_sensors_select(SENSOR_TYPE_LIGHT,
+                                   MCE_CONF_SENSOR_CONFIG_HYBRIS_ALS_NAME,
+                                   false);
+    hybris_plugin_sensors_ps_sensor =
+      hybris_plugin_sensors_select(SENSOR_TYPE_PROXIMITY,
+                                   MCE_CONF_SENSOR_CONFIG_HYBRIS_PS_NAME,
+                                   wakeup);
+  }
+
+  for( int type = 1; type < (int)G_N_ELEMENTS(hybris_plugin_sensors_generic); ++type ) {
+    if( hybris_device_sensor_is_generic(type) ) {
+      hybris_plugin_sensors_generic[type] =
+        hybris_plugin_sensors_select(type, 0, false);
+    }
+  }
+
+  hybris_plugin_sensors_update_dispatch();
 
 cleanup:
 
@@ -172,6 +559,55 @@ hybris_plugin_sensors_unload(void)
   // FIXME: how to unload libhybris modules?
 }
 
+/** Get summary of available sensors
+ *
+ * Uses the sensor list of already loaded sensors module - does not
+ * load the module, select sensors or open poll device.
+ *
+ * @param types      where to store mask of available SENSOR_TYPE_xxx bits
+ * @param min_delay  array of 32 entries, where to store shortest
+ *                   sampling interval per sensor type [us]
+ * @param ps_wakeup  where to store availability of wake-up proximity sensor
+ *
+ * @return true if sensor availability is known, or false if sensors
+ *         module has not been loaded yet
+ */
+bool
+hybris_plugin_sensors_get_caps(uint32_t *types, int32_t *min_delay,
+                               bool *ps_wakeup)
+{
+  *types     = 0;
+  *ps_wakeup = false;
+  memset(min_delay, 0, 32 * sizeof *min_delay);
+
+  if( !hybris_plugin_sensors_preloaded ) {
+    return false;
+  }
+
+  for( int i = 0; i < hybris_plugin_sensors_cnt; ++i ) {
+    const struct sensor_t *sensor = &hybris_plugin_sensors_lut[i];
+
+    if( sensor->type <= 0 || sensor->type >= 32 ) {
+      continue;
+    }
+
+    if( !(*types & (1u << sensor->type)) ||
+        (sensor->minDelay > 0 && (min_delay[sensor->type] <= 0 ||
+                                  min_delay[sensor->type] > sensor->minDelay)) ) {
+      min_delay[sensor->type] = sensor->minDelay;
+    }
+
+    *types |= 1u << sensor->type;
+
+    if( sensor->type == SENSOR_TYPE_PROXIMITY &&
+        hybris_plugin_sensors_is_wakeup(sensor) ) {
+      *ps_wakeup = true;
+    }
+  }
+
+  return true;
+}
+
 /** Convenience function for opening sensors device
  *
  * Similar to what we might or might not have available from hardware/sensors.h
@@ -223,15 +659,88 @@ hybris_plugin_sensors_close_device(struct sensors_poll_device_t **pdevice)
 /** Pointer to libhybris sensor poll device object */
 static struct sensors_poll_device_t  *hybris_device_sensors_handle = 0;
 
-/** Callback for forwarding proximity sensor events */
+/** Callback for forwarding proximity sensor events
+ *
+ * Accessed only via __atomic builtins, see hybris_device_sensors_synchronize()
+ */
 static mce_hybris_ps_fn               hybris_device_sensors_ps_cb  = 0;
 
-/** Callback for forwarding ambient light sensor events */
+/** Callback for forwarding ambient light sensor events
+ *
+ * Accessed only via __atomic builtins, see hybris_device_sensors_synchronize()
+ */
 static mce_hybris_als_fn              hybris_device_sensors_als_cb = 0;
 
 /** Worker thread id */
 static pthread_t                      hybris_device_sensors_thread_id = 0;
 
+/** Callback for forwarding events from other sensor types
+ *
+ * Accessed only via __atomic builtins, see hybris_device_sensors_synchronize()
+ */
+static mce_hybris_sensor_fn           hybris_device_sensors_generic_cb = 0;
+
+/** Bitmask of sensor types activated via generic sensor interface
+ *
+ * Accessed only via __atomic builtins.
+ */
+static uint32_t                       hybris_device_sensors_generic_mask = 0;
+
+/** Callback dispatch sequence number; odd while worker is dispatching */
+static unsigned                       hybris_device_sensors_dispatch_seq = 0;
+
+/** Proximity sensor input enabled state */
+static bool                           hybris_sensor_ps_active = false;
+
+/** Ambient light sensor input enabled state */
+static bool                           hybris_device_als_active = false;
+
+/** Timer id for delayed closing of idle sensor poll device */
+static guint                          hybris_device_sensors_idle_id = 0;
+
+/** Sensor poll device open / close statistics */
+static mce_hybris_sensor_stats_t      hybris_device_sensors_stats;
+
+/** Wait until worker thread is not using previously set callbacks
+ *
+ * Callback pointers are published atomically and read without locking
+ * by the worker thread. After changing a callback, this function is
+ * used for waiting until the worker has finished any dispatching round
+ * that might have been started using the old value - so that after
+ * e.g. hybris_sensor_ps_quit() returns, the old callback is guaranteed
+ * not to get called anymore.
+ *
+ * Does not wait if called from the worker thread itself, i.e. when a
+ * callback is changed from within a callback.
+ */
+static void
+hybris_device_sensors_synchronize(void)
+{
+  if( !hybris_device_sensors_thread_id ) {
+    goto cleanup;
+  }
+
+  if( pthread_equal(pthread_self(), hybris_device_sensors_thread_id) ) {
+    goto cleanup;
+  }
+
+  unsigned seq = __atomic_load_n(&hybris_device_sensors_dispatch_seq,
+                                 __ATOMIC_SEQ_CST);
+
+  if( !(seq & 1) ) {
+    goto cleanup;
+  }
+
+  while( __atomic_load_n(&hybris_device_sensors_dispatch_seq,
+                         __ATOMIC_SEQ_CST) == seq ) {
+    sched_yield();
+  }
+
+cleanup:
+
+  return;
+}
+
 /** Worker thread for reading sensor events via blocking libhybris interface
  *
  * Note: no mce_log() calls from this function - they are not thread safe
@@ -253,42 +762,75 @@ hybris_device_sensors_thread_cb(void *aptr)
      * the hybris_device_sensors_handle->poll() are lost. */
     int n = hybris_device_sensors_handle->poll(hybris_device_sensors_handle, eve, G_N_ELEMENTS(eve));
 
+    if( n <= 0 ) {
+      continue;
+    }
+
+    hybris_sensors_watchdog_feed();
+    hybris_sensors_clock_begin();
+
+    /* Do not get cancelled while executing callbacks, and mark
+     * dispatching round active for hybris_device_sensors_synchronize() */
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, 0);
+    __atomic_add_fetch(&hybris_device_sensors_dispatch_seq, 1,
+                       __ATOMIC_SEQ_CST);
+
+    mce_hybris_als_fn als_cb = __atomic_load_n(&hybris_device_sensors_als_cb,
+                                               __ATOMIC_SEQ_CST);
+    mce_hybris_ps_fn  ps_cb  = __atomic_load_n(&hybris_device_sensors_ps_cb,
+                                               __ATOMIC_SEQ_CST);
+    mce_hybris_sensor_fn generic_cb =
+      __atomic_load_n(&hybris_device_sensors_generic_cb, __ATOMIC_SEQ_CST);
+    uint32_t generic_mask =
+      __atomic_load_n(&hybris_device_sensors_generic_mask, __ATOMIC_SEQ_CST);
+
     for( int i = 0; i < n; ++i ) {
       sensors_event_t *e = &eve[i];
 
+      e->timestamp = hybris_sensors_clock_convert(e->timestamp);
+
       /* Forward data via per sensor callback routines. The callbacks must
        * handle the fact that they get called from the context of the worker
        * thread. */
-      switch( e->type ) {
-      case SENSOR_TYPE_LIGHT:
-        if( hybris_device_sensors_als_cb ) {
-          hybris_device_sensors_als_cb(e->timestamp, e->distance);
+      switch( hybris_plugin_sensors_get_role(e) ) {
+      case SENSOR_ROLE_ALS:
+        if( als_cb ) {
+          float lux = 0;
+          if( hybris_als_filter_input(e->distance, &lux) ) {
+            als_cb(e->timestamp, lux);
+          }
+        }
+        break;
+      case SENSOR_ROLE_PS:
+        if( ps_cb ) {
+          hybris_ps_debounce_input(ps_cb, e->timestamp, e->light);
         }
         break;
-      case SENSOR_TYPE_PROXIMITY:
-        if( hybris_device_sensors_ps_cb ) {
-          hybris_device_sensors_ps_cb(e->timestamp, e->light);
+
+      case SENSOR_ROLE_GENERIC:
+        if( generic_cb && hybris_device_sensor_is_generic(e->type) &&
+            (generic_mask & (1u << e->type)) ) {
+          generic_cb(e->type, e->timestamp, e->data,
+                     hybris_device_sensor_value_count(e->type));
         }
         break;
 
-      case SENSOR_TYPE_ACCELEROMETER:
-      case SENSOR_TYPE_MAGNETIC_FIELD:
-      case SENSOR_TYPE_ORIENTATION:
-      case SENSOR_TYPE_GYROSCOPE:
-      case SENSOR_TYPE_PRESSURE:
-      case SENSOR_TYPE_TEMPERATURE:
-      case SENSOR_TYPE_GRAVITY:
-      case SENSOR_TYPE_LINEAR_ACCELERATION:
-      case SENSOR_TYPE_ROTATION_VECTOR:
-      case SENSOR_TYPE_RELATIVE_HUMIDITY:
-      case SENSOR_TYPE_AMBIENT_TEMPERATURE:
+      default:
         break;
       }
     }
+
+    __atomic_add_fetch(&hybris_device_sensors_dispatch_seq, 1,
+                       __ATOMIC_SEQ_CST);
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, 0);
   }
 }
 
 /** Initialize libhybris sensor poll device object
+ *
+ * Unless disabled in configuration, this is done only when the first
+ * sensor is activated, and undone after all sensors have been
+ * deactivated - see hybris_device_sensors_release().
  *
  * Also:
  * - disables ALS and PS sensor inputs if possible
@@ -299,6 +841,8 @@ hybris_device_sensors_thread_cb(void *aptr)
 static bool
 hybris_device_sensors_init(void)
 {
+  int64_t t0 = hybris_device_sensors_now_us();
+
   if( hybris_device_sensors_handle ) {
     goto cleanup;
   }
@@ -319,8 +863,25 @@ hybris_device_sensors_init(void)
     hybris_device_sensors_handle->activate(hybris_device_sensors_handle, hybris_plugin_sensors_als_sensor->handle, false);
   }
 
+  hybris_ps_debounce_start();
+  hybris_als_filter_setup();
+  hybris_sensors_clock_reset();
+
   hybris_device_sensors_thread_id = hybris_thread_start(hybris_device_sensors_thread_cb, 0);
 
+  hybris_sensors_watchdog_start();
+
+  int64_t t = hybris_device_sensors_now_us() - t0;
+
+  hybris_device_sensors_stats.opens      += 1;
+  hybris_device_sensors_stats.last_open_us = t;
+  if( hybris_device_sensors_stats.max_open_us < t ) {
+    hybris_device_sensors_stats.max_open_us = t;
+  }
+
+  mce_log(LL_DEBUG, "sensor poll device opened in %lld us",
+          (long long)t);
+
 cleanup:
 
   return hybris_device_sensors_handle != 0;
@@ -335,94 +896,1597 @@ cleanup:
 static void
 hybris_device_sensors_quit(void)
 {
+  if( hybris_device_sensors_idle_id ) {
+    g_source_remove(hybris_device_sensors_idle_id),
+      hybris_device_sensors_idle_id = 0;
+  }
+
+  hybris_sensors_watchdog_stop();
+
   if( hybris_device_sensors_handle ) {
     if( hybris_device_sensors_thread_id ) {
       hybris_thread_stop(hybris_device_sensors_thread_id),
       hybris_device_sensors_thread_id = 0;
     }
 
+    hybris_ps_debounce_stop();
+
     if( hybris_plugin_sensors_ps_sensor ) {
       hybris_device_sensors_handle->activate(hybris_device_sensors_handle, hybris_plugin_sensors_ps_sensor->handle, false);
+      hybris_sensor_ps_active = false;
     }
 
     if( hybris_plugin_sensors_als_sensor ) {
       hybris_device_sensors_handle->activate(hybris_device_sensors_handle, hybris_plugin_sensors_als_sensor->handle, false);
+      hybris_device_als_active = false;
     }
 
+    hybris_device_sensor_deactivate_all();
+
     hybris_plugin_sensors_close_device(&hybris_device_sensors_handle);
   }
 }
 
-/* ========================================================================= *
- * PROXIMITY_SENSOR
- * ========================================================================= */
-
-/** Start using proximity sensor via libhybris
+/** Get monotonic time stamp
  *
- * @return true on success, false on failure
+ * @return CLOCK_MONOTONIC time in microseconds
  */
-bool
-hybris_sensor_ps_init(void)
+static int64_t
+hybris_device_sensors_now_us(void)
 {
-  bool res = false;
-
-  if( !hybris_device_sensors_init() ) {
-    goto cleanup;
-  }
+  struct timespec ts = { 0, 0 };
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * INT64_C(1000000) + ts.tv_nsec / 1000;
+}
+
+/** Predicate for: sensor poll device should be closed when not in use
+ *
+ * Closing the poll device involves asynchronous cancellation of the
+ * worker thread while it is blocked in vendor poll() code - which can
+ * leak resources or leave hal / bionic locks held. Thus by default
+ * the worker is just left parked in poll() with all sensors disabled.
+ *
+ * Can be enabled on devices where it is known to work via:
+ *
+ *   [SensorConfigHybris]
+ *   IdleShutdown=true
+ *
+ * @return true if idle shutdown is enabled, false otherwise
+ */
+static bool
+hybris_device_sensors_idle_enabled(void)
+{
+  static bool done    = false;
+  static bool enabled = false;
+
+  if( !done ) {
+    done = true;
+
+    gchar *val = plugin_config_get_string(MCE_CONF_SENSOR_CONFIG_HYBRIS_GROUP,
+                                          MCE_CONF_SENSOR_CONFIG_HYBRIS_IDLE_SHUTDOWN,
+                                          0);
+    if( val && (!strcmp(val, "true") || !strcmp(val, "1")) ) {
+      enabled = true;
+    }
+    g_free(val);
+
+    mce_log(LL_DEBUG, "sensor idle shutdown: %s",
+            enabled ? "enabled" : "disabled");
+  }
+
+  return enabled;
+}
+
+/** Predicate for: some sensor input is enabled
+ *
+ * @return true if at least one sensor is active, false otherwise
+ */
+static bool
+hybris_device_sensors_in_use(void)
+{
+  return (hybris_sensor_ps_active ||
+          hybris_device_als_active ||
+          __atomic_load_n(&hybris_device_sensors_generic_mask,
+                          __ATOMIC_SEQ_CST) != 0);
+}
+
+/** Check sensor availability without necessarily opening poll device
+ *
+ * If idle shutdown is disabled, the poll device is opened right away.
+ *
+ * @return true on success, false on failure
+ */
+static bool
+hybris_device_sensors_probe(void)
+{
+  if( !hybris_plugin_sensors_load() ) {
+    return false;
+  }
+
+  if( hybris_device_sensors_idle_enabled() ) {
+    return true;
+  }
+
+  return hybris_device_sensors_init();
+}
+
+/** Make sure sensor poll device is open and worker thread running
+ *
+ * @return true on success, false on failure
+ */
+static bool
+hybris_device_sensors_acquire(void)
+{
+  if( hybris_device_sensors_idle_id ) {
+    g_source_remove(hybris_device_sensors_idle_id),
+      hybris_device_sensors_idle_id = 0;
+  }
+
+  return hybris_device_sensors_init();
+}
+
+/** Timer callback for closing idle sensor poll device
+ *
+ * @param aptr (unused) user data pointer
+ *
+ * @return G_SOURCE_REMOVE
+ */
+static gboolean
+hybris_device_sensors_idle_cb(gpointer aptr)
+{
+  (void)aptr;
+
+  if( !hybris_device_sensors_idle_id ) {
+    goto cleanup;
+  }
+
+  hybris_device_sensors_idle_id = 0;
+
+  if( hybris_device_sensors_in_use() || !hybris_device_sensors_handle ) {
+    goto cleanup;
+  }
+
+  mce_log(LL_DEBUG, "no active sensors; closing sensor poll device");
+
+  hybris_device_sensors_stats.closes += 1;
+  hybris_device_sensors_quit();
+
+cleanup:
+
+  return G_SOURCE_REMOVE;
+}
+
+/** Schedule closing of sensor poll device if no sensors are active
+ */
+static void
+hybris_device_sensors_release(void)
+{
+  if( !hybris_device_sensors_idle_enabled() ) {
+    goto cleanup;
+  }
+
+  if( hybris_device_sensors_idle_id || !hybris_device_sensors_handle ) {
+    goto cleanup;
+  }
+
+  if( hybris_device_sensors_in_use() ) {
+    goto cleanup;
+  }
+
+  hybris_device_sensors_idle_id = g_timeout_add(HYBRIS_SENSORS_IDLE_DELAY,
+                                                hybris_device_sensors_idle_cb,
+                                                0);
+
+cleanup:
+
+  return;
+}
+
+/** Change sensor input enabled state, opening poll device if needed
+ *
+ * @param sensor sensor object
+ * @param state  true to enable input, or false to disable input
+ *
+ * @return true on success, false on failure
+ */
+static bool
+hybris_device_sensors_activate(const struct sensor_t *sensor, bool state)
+{
+  bool res = false;
+
+  if( state ) {
+    if( !hybris_device_sensors_acquire() ) {
+      goto cleanup;
+    }
+  }
+  else if( !hybris_device_sensors_handle ) {
+    /* Closed poll device implies all sensors are inactive */
+    res = true;
+    goto cleanup;
+  }
+
+  if( hybris_device_sensors_handle->activate(hybris_device_sensors_handle, sensor->handle, state) < 0 ) {
+    goto cleanup;
+  }
+
+  if( state ) {
+    hybris_sensors_watchdog_kick();
+  }
+
+  res = true;
+
+cleanup:
+
+  return res;
+}
+
+/** Get sensor poll device statistics
+ *
+ * @param stats  where to store statistics
+ *
+ * @return true on success, false on failure
+ */
+bool
+hybris_device_sensors_get_stats(mce_hybris_sensor_stats_t *stats)
+{
+  if( !stats ) {
+    return false;
+  }
+
+  *stats = hybris_device_sensors_stats;
+  hybris_ps_debounce_get_stats(stats);
+  hybris_als_filter_get_stats(stats);
+  hybris_sensors_clock_get_stats(stats);
+  return true;
+}
+
+/* ========================================================================= *
+ * SENSORS_WATCHDOG
+ *
+ * Some vendor sensor HALs occasionally wedge so that poll() never returns
+ * and sensor input stays dead until mce is restarted. This can be worked
+ * around by enabling a watchdog:
+ *
+ *   [SensorConfigHybris]
+ *   WatchdogTimeout=<ms>
+ *
+ * If no events at all are received while some sensor is active for the
+ * given time, the active sensors are first re-activated. If that does not
+ * help either, the poll device is closed and reopened - after which the
+ * watchdog stays passive until sensor enabled states change again.
+ *
+ * Note that on-change sensors (such as proximity) do not emit events while
+ * nothing changes, so the timeout must be long enough to make spurious
+ * recovery attempts rare. Disabled by default.
+ * ========================================================================= */
+
+/** Watchdog recovery stages */
+typedef enum
+{
+  /** Events are flowing */
+  WATCHDOG_STAGE_IDLE,
+
+  /** Active sensors have been re-activated */
+  WATCHDOG_STAGE_REACTIVATED,
+
+  /** Poll device has been reopened, waiting for activity changes */
+  WATCHDOG_STAGE_REOPENED,
+} hybris_sensors_watchdog_stage_t;
+
+/** Timer id for periodic watchdog checks */
+static guint                           hybris_sensors_watchdog_id = 0;
+
+/** Time of the latest sensor event [us]; accessed via __atomic builtins */
+static int64_t                         hybris_sensors_watchdog_event_us = 0;
+
+/** Time of the latest activation / recovery action [us] */
+static int64_t                         hybris_sensors_watchdog_action_us = 0;
+
+/** Time when stalled sensor input was detected [us], or 0 */
+static int64_t                         hybris_sensors_watchdog_stall_us = 0;
+
+/** Current recovery stage */
+static hybris_sensors_watchdog_stage_t hybris_sensors_watchdog_stage = WATCHDOG_STAGE_IDLE;
+
+/** Get watchdog timeout from configuration
+ *
+ * @return timeout [us], or 0 if watchdog is disabled
+ */
+static int64_t
+hybris_sensors_watchdog_get_timeout(void)
+{
+  static bool    done    = false;
+  static int64_t timeout = 0;
+
+  if( !done ) {
+    done = true;
+
+    gchar *val = plugin_config_get_string(MCE_CONF_SENSOR_CONFIG_HYBRIS_GROUP,
+                                          MCE_CONF_SENSOR_CONFIG_HYBRIS_WATCHDOG,
+                                          0);
+    if( val ) {
+      int ms = strtol(val, 0, 0);
+      if( ms > 0 ) {
+        /* Anything shorter than a second is just asking for trouble */
+        timeout = (ms < 1000 ? 1000 : ms) * INT64_C(1000);
+      }
+    }
+    g_free(val);
+
+    mce_log(LL_DEBUG, "sensor watchdog timeout: %lld ms",
+            (long long)(timeout / 1000));
+  }
+
+  return timeout;
+}
+
+/** Record arrival of sensor events
+ *
+ * For use from sensor worker thread.
+ */
+static void
+hybris_sensors_watchdog_feed(void)
+{
+  __atomic_store_n(&hybris_sensors_watchdog_event_us,
+                   hybris_device_sensors_now_us(), __ATOMIC_RELAXED);
+}
+
+/** Restart watchdog timeout after changes in sensor activity
+ */
+static void
+hybris_sensors_watchdog_kick(void)
+{
+  hybris_sensors_watchdog_action_us = hybris_device_sensors_now_us();
+  hybris_sensors_watchdog_stage     = WATCHDOG_STAGE_IDLE;
+}
+
+/** Re-activate sensor
+ *
+ * @param sensor sensor object, or NULL
+ */
+static void
+hybris_sensors_watchdog_toggle(const struct sensor_t *sensor)
+{
+  if( sensor && hybris_device_sensors_handle ) {
+    hybris_device_sensors_handle->activate(hybris_device_sensors_handle, sensor->handle, false);
+    hybris_device_sensors_handle->activate(hybris_device_sensors_handle, sensor->handle, true);
+  }
+}
+
+/** Re-activate all active sensors without closing poll device
+ */
+static void
+hybris_sensors_watchdog_reactivate(void)
+{
+  if( hybris_sensor_ps_active ) {
+    hybris_sensors_watchdog_toggle(hybris_plugin_sensors_ps_sensor);
+  }
+
+  if( hybris_device_als_active ) {
+    hybris_sensors_watchdog_toggle(hybris_plugin_sensors_als_sensor);
+  }
+
+  uint32_t mask = __atomic_load_n(&hybris_device_sensors_generic_mask,
+                                  __ATOMIC_SEQ_CST);
+
+  for( int type = 1; type < 32; ++type ) {
+    if( mask & (1u << type) ) {
+      hybris_sensors_watchdog_toggle(hybris_plugin_sensors_get_sensor(type));
+    }
+  }
+
+  hybris_device_sensors_stats.watchdog_reactivations += 1;
+}
+
+/** Close and reopen poll device, then re-activate all active sensors
+ */
+static void
+hybris_sensors_watchdog_reopen(void)
+{
+  bool     ps   = hybris_sensor_ps_active;
+  bool     als  = hybris_device_als_active;
+  uint32_t mask = __atomic_load_n(&hybris_device_sensors_generic_mask,
+                                  __ATOMIC_SEQ_CST);
+
+  /* Worker thread is most likely stuck in poll(), but gets
+   * cancelled asynchronously anyway */
+  hybris_device_sensors_quit();
+
+  if( ps ) {
+    hybris_sensor_ps_set_active(true);
+  }
+
+  if( als ) {
+    hybris_device_als_set_active(true);
+  }
+
+  for( int type = 1; type < 32; ++type ) {
+    if( mask & (1u << type) ) {
+      hybris_device_sensor_set_active(type, true);
+    }
+  }
+
+  hybris_device_sensors_stats.watchdog_reopens += 1;
+}
+
+/** Timer callback for checking that active sensors produce events
+ *
+ * @param aptr (unused) user data pointer
+ *
+ * @return G_SOURCE_CONTINUE, or G_SOURCE_REMOVE if the timer was
+ *         replaced while reopening poll device
+ */
+static gboolean
+hybris_sensors_watchdog_timer_cb(gpointer aptr)
+{
+  (void)aptr;
+
+  gboolean keep = G_SOURCE_CONTINUE;
+
+  if( !hybris_sensors_watchdog_id ) {
+    keep = G_SOURCE_REMOVE;
+    goto cleanup;
+  }
+
+  int64_t now   = hybris_device_sensors_now_us();
+  int64_t event = __atomic_load_n(&hybris_sensors_watchdog_event_us,
+                                  __ATOMIC_RELAXED);
+
+  /* Account recovery once events start flowing again */
+  if( hybris_sensors_watchdog_stall_us &&
+      event > hybris_sensors_watchdog_stall_us ) {
+    int64_t t = event - hybris_sensors_watchdog_stall_us;
+
+    hybris_device_sensors_stats.watchdog_recoveries += 1;
+    hybris_device_sensors_stats.last_recovery_us = t;
+    if( hybris_device_sensors_stats.max_recovery_us < t ) {
+      hybris_device_sensors_stats.max_recovery_us = t;
+    }
+
+    mce_log(LL_NOTICE, "sensor input recovered in %lld us", (long long)t);
+
+    hybris_sensors_watchdog_stall_us = 0;
+    hybris_sensors_watchdog_stage    = WATCHDOG_STAGE_IDLE;
+  }
+
+  if( !hybris_device_sensors_in_use() ) {
+    hybris_sensors_watchdog_stall_us = 0;
+    goto cleanup;
+  }
+
+  int64_t latest = event;
+  if( latest < hybris_sensors_watchdog_action_us ) {
+    latest = hybris_sensors_watchdog_action_us;
+  }
+
+  if( now - latest < hybris_sensors_watchdog_get_timeout() ) {
+    goto cleanup;
+  }
+
+  if( !hybris_sensors_watchdog_stall_us ) {
+    hybris_sensors_watchdog_stall_us = now;
+  }
+
+  switch( hybris_sensors_watchdog_stage ) {
+  case WATCHDOG_STAGE_IDLE:
+    mce_log(LL_WARN, "no sensor events; re-activating sensors");
+    hybris_sensors_watchdog_reactivate();
+    hybris_sensors_watchdog_kick();
+    hybris_sensors_watchdog_stage = WATCHDOG_STAGE_REACTIVATED;
+    break;
+
+  case WATCHDOG_STAGE_REACTIVATED:
+    mce_log(LL_WARN, "no sensor events; reopening sensor poll device");
+    /* Reopening starts a new watchdog timer */
+    hybris_sensors_watchdog_id = 0, keep = G_SOURCE_REMOVE;
+    hybris_sensors_watchdog_reopen();
+    hybris_sensors_watchdog_stage = WATCHDOG_STAGE_REOPENED;
+    break;
+
+  default:
+    break;
+  }
+
+cleanup:
+
+  return keep;
+}
+
+/** Start watchdog timer, if enabled in configuration
+ */
+static void
+hybris_sensors_watchdog_start(void)
+{
+  int64_t timeout = hybris_sensors_watchdog_get_timeout();
+
+  if( !timeout || hybris_sensors_watchdog_id ) {
+    goto cleanup;
+  }
+
+  hybris_sensors_watchdog_kick();
+
+  /* Check twice per timeout period */
+  hybris_sensors_watchdog_id = g_timeout_add(timeout / 2000,
+                                             hybris_sensors_watchdog_timer_cb,
+                                             0);
+
+cleanup:
+
+  return;
+}
+
+/** Stop watchdog timer
+ */
+static void
+hybris_sensors_watchdog_stop(void)
+{
+  if( hybris_sensors_watchdog_id ) {
+    g_source_remove(hybris_sensors_watchdog_id),
+      hybris_sensors_watchdog_id = 0;
+  }
+}
+
+/* ========================================================================= *
+ * SENSORS_CLOCK
+ *
+ * Sensor HALs differ in what clock domain they use for event time stamps:
+ * some use CLOCK_BOOTTIME (as android expects), some CLOCK_MONOTONIC and
+ * some something else entirely. To make time stamps comparable, the HAL
+ * clock domain is deduced from the first event after the poll device is
+ * opened or the device has been suspended, and all time stamps delivered
+ * to mce are converted to CLOCK_BOOTTIME nanoseconds.
+ *
+ * After resume the first event can be an old one that was queued or
+ * batched before suspend. Such events do not match any clock, and are
+ * not allowed to override the clock domain detected earlier.
+ *
+ * Everything except hybris_sensors_clock_reset() and statistics access
+ * is done from the sensor worker thread.
+ * ========================================================================= */
+
+/** Maximum accepted age of an event used for clock domain detection [ns] */
+#define HYBRIS_SENSORS_CLOCK_MAX_AGE    INT64_C(2000000000)
+
+/** Tolerance for events that seem to come from the future [ns] */
+#define HYBRIS_SENSORS_CLOCK_TOLERANCE  INT64_C(10000000)
+
+/** Change in boottime vs monotonic offset that is taken as resume [ns] */
+#define HYBRIS_SENSORS_CLOCK_RESUME     INT64_C(1000000)
+
+/** Sensor time stamp conversion state */
+typedef struct
+{
+  /** Flag for: clock domain needs to be (re)detected; accessed via
+   *  __atomic builtins */
+  bool    reset;
+
+  /** Detected HAL clock domain; accessed via __atomic builtins */
+  int     domain;
+
+  /** Offset to add to HAL time stamps to get boottime [ns] */
+  int64_t offset;
+
+  /** CLOCK_BOOTTIME at the start of current dispatching round [ns] */
+  int64_t now;
+
+  /** CLOCK_BOOTTIME - CLOCK_MONOTONIC at the start of current round [ns] */
+  int64_t sleep;
+
+  /** Counters, accessed via __atomic builtins */
+  unsigned calibrations;
+  unsigned events;
+  int64_t  last_delay;
+  int64_t  max_delay;
+  int64_t  total_delay;
+} hybris_sensors_clock_t;
+
+/** Sensor time stamp conversion state */
+static hybris_sensors_clock_t hybris_sensors_clock =
+{
+  .reset  = true,
+  .domain = MCE_HYBRIS_SENSOR_CLOCK_UNKNOWN,
+};
+
+/** Get time stamp from given clock
+ *
+ * @param id  CLOCK_BOOTTIME etc
+ *
+ * @return time in nanoseconds
+ */
+static int64_t
+hybris_sensors_clock_now_ns(clockid_t id)
+{
+  struct timespec ts = { 0, 0 };
+  clock_gettime(id, &ts);
+  return ts.tv_sec * INT64_C(1000000000) + ts.tv_nsec;
+}
+
+/** Request clock domain detection from scratch
+ *
+ * Should be called when the poll device is opened, before the
+ * worker thread is started.
+ */
+static void
+hybris_sensors_clock_reset(void)
+{
+  __atomic_store_n(&hybris_sensors_clock.domain,
+                   MCE_HYBRIS_SENSOR_CLOCK_UNKNOWN, __ATOMIC_RELAXED);
+  __atomic_store_n(&hybris_sensors_clock.reset, true, __ATOMIC_RELEASE);
+}
+
+/** Sample clocks at the start of event dispatching round
+ *
+ * Also detects resume from suspend, after which the HAL clock
+ * domain is detected again.
+ */
+static void
+hybris_sensors_clock_begin(void)
+{
+  hybris_sensors_clock_t *self = &hybris_sensors_clock;
+
+  int64_t mono  = hybris_sensors_clock_now_ns(CLOCK_MONOTONIC);
+  int64_t boot  = hybris_sensors_clock_now_ns(CLOCK_BOOTTIME);
+  int64_t sleep = boot - mono;
+  int64_t drift = sleep - self->sleep;
+
+  /* Re-check the clock domain, but keep the current one as fallback */
+  if( drift > HYBRIS_SENSORS_CLOCK_RESUME ||
+      drift < -HYBRIS_SENSORS_CLOCK_RESUME ) {
+    __atomic_store_n(&self->reset, true, __ATOMIC_RELEASE);
+  }
+
+  self->now   = boot;
+  self->sleep = sleep;
+
+  switch( self->domain ) {
+  case MCE_HYBRIS_SENSOR_CLOCK_MONOTONIC:
+    self->offset = sleep;
+    break;
+
+  case MCE_HYBRIS_SENSOR_CLOCK_REALTIME:
+    self->offset = boot - hybris_sensors_clock_now_ns(CLOCK_REALTIME);
+    break;
+
+  default:
+    break;
+  }
+}
+
+/** Deduce HAL clock domain from event time stamp
+ *
+ * Picks the clock whose current time is closest to - but not too
+ * much before - the time stamp.
+ *
+ * If none matches and the clock domain is not known yet, the HAL clock
+ * is assumed to be arbitrary and the event to have no latency. If the
+ * domain is already known, e.g. when recalibrating after resume, the
+ * event is assumed to be a stale one and the domain is left as is.
+ *
+ * @param timestamp  time stamp from HAL
+ */
+static void
+hybris_sensors_clock_calibrate(int64_t timestamp)
+{
+  hybris_sensors_clock_t *self = &hybris_sensors_clock;
+
+  static const struct
+  {
+    int       domain;
+    clockid_t id;
+  } lut[] =
+  {
+    { MCE_HYBRIS_SENSOR_CLOCK_BOOTTIME,  CLOCK_BOOTTIME  },
+    { MCE_HYBRIS_SENSOR_CLOCK_MONOTONIC, CLOCK_MONOTONIC },
+    { MCE_HYBRIS_SENSOR_CLOCK_REALTIME,  CLOCK_REALTIME  },
+  };
+
+  int     domain = MCE_HYBRIS_SENSOR_CLOCK_ARBITRARY;
+  int64_t best   = HYBRIS_SENSORS_CLOCK_MAX_AGE;
+
+  for( size_t i = 0; i < G_N_ELEMENTS(lut); ++i ) {
+    int64_t age = hybris_sensors_clock_now_ns(lut[i].id) - timestamp;
+
+    if( age < -HYBRIS_SENSORS_CLOCK_TOLERANCE ) {
+      continue;
+    }
+
+    if( age < 0 ) {
+      age = -age;
+    }
+
+    if( age < best ) {
+      best   = age;
+      domain = lut[i].domain;
+    }
+  }
+
+  /* Do not let stale event override previously detected domain */
+  if( domain == MCE_HYBRIS_SENSOR_CLOCK_ARBITRARY &&
+      self->domain != MCE_HYBRIS_SENSOR_CLOCK_UNKNOWN ) {
+    goto cleanup;
+  }
+
+  switch( domain ) {
+  case MCE_HYBRIS_SENSOR_CLOCK_BOOTTIME:
+    self->offset = 0;
+    break;
+
+  case MCE_HYBRIS_SENSOR_CLOCK_MONOTONIC:
+    self->offset = self->sleep;
+    break;
+
+  case MCE_HYBRIS_SENSOR_CLOCK_REALTIME:
+    self->offset = self->now - hybris_sensors_clock_now_ns(CLOCK_REALTIME);
+    break;
+
+  default:
+    self->offset = self->now - timestamp;
+    break;
+  }
+
+  __atomic_store_n(&self->domain, domain, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&self->calibrations, 1, __ATOMIC_RELAXED);
+
+cleanup:
+  return;
+}
+
+/** Convert HAL event time stamp to CLOCK_BOOTTIME
+ *
+ * Also updates delivery delay statistics.
+ *
+ * @param timestamp  time stamp from HAL
+ *
+ * @return CLOCK_BOOTTIME time stamp [ns]
+ */
+static int64_t
+hybris_sensors_clock_convert(int64_t timestamp)
+{
+  hybris_sensors_clock_t *self = &hybris_sensors_clock;
+
+  if( __atomic_exchange_n(&self->reset, false, __ATOMIC_ACQUIRE) ) {
+    hybris_sensors_clock_calibrate(timestamp);
+  }
+
+  int64_t boot  = timestamp + self->offset;
+  int64_t delay = self->now - boot;
+
+  if( delay < 0 ) {
+    delay = 0;
+  }
+
+  __atomic_add_fetch(&self->events, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&self->total_delay, delay, __ATOMIC_RELAXED);
+  __atomic_store_n(&self->last_delay, delay, __ATOMIC_RELAXED);
+  if( __atomic_load_n(&self->max_delay, __ATOMIC_RELAXED) < delay ) {
+    __atomic_store_n(&self->max_delay, delay, __ATOMIC_RELAXED);
+  }
+
+  return boot;
+}
+
+/** Get sensor time stamp conversion statistics
+ *
+ * @param stats  where to store statistics
+ */
+static void
+hybris_sensors_clock_get_stats(mce_hybris_sensor_stats_t *stats)
+{
+  hybris_sensors_clock_t *self = &hybris_sensors_clock;
+
+  stats->clock_domain       = __atomic_load_n(&self->domain, __ATOMIC_RELAXED);
+  stats->clock_calibrations = __atomic_load_n(&self->calibrations, __ATOMIC_RELAXED);
+  stats->delay_events       = __atomic_load_n(&self->events, __ATOMIC_RELAXED);
+  stats->last_delay_us      = __atomic_load_n(&self->last_delay, __ATOMIC_RELAXED) / 1000;
+  stats->max_delay_us       = __atomic_load_n(&self->max_delay, __ATOMIC_RELAXED) / 1000;
+  stats->total_delay_us     = __atomic_load_n(&self->total_delay, __ATOMIC_RELAXED) / 1000;
+}
+
+/* ========================================================================= *
+ * PROXIMITY_SENSOR
+ * ========================================================================= */
+
+/** Start using proximity sensor via libhybris
+ *
+ * @return true on success, false on failure
+ */
+bool
+hybris_sensor_ps_init(void)
+{
+  bool res = false;
+
+  if( !hybris_device_sensors_probe() ) {
+    goto cleanup;
+  }
 
   if( !hybris_plugin_sensors_ps_sensor ) {
     goto cleanup;
   }
 
-  res = true;
+  res = true;
+
+cleanup:
+
+  return res;
+}
+
+/** Stop using proximity sensor via libhybris
+ *
+ * @return true on success, false on failure
+ */
+void
+hybris_sensor_ps_quit(void)
+{
+  hybris_sensor_ps_set_hook(0);
+}
+
+/** Set callback function for handling proximity sensor events
+ *
+ * Note: the callback function will be called from worker thread.
+ *
+ * When called from other than the worker thread, this function returns
+ * only after the previously set callback is no longer in use.
+ */
+void
+hybris_sensor_ps_set_hook(mce_hybris_ps_fn cb)
+{
+  __atomic_store_n(&hybris_device_sensors_ps_cb, cb, __ATOMIC_SEQ_CST);
+  hybris_device_sensors_synchronize();
+  hybris_ps_debounce_synchronize();
+}
+
+/** Set proximity sensort input enabled state
+ *
+ * @param state true to enable input, or false to disable input
+ */
+bool
+hybris_sensor_ps_set_active(bool state)
+{
+  bool res = false;
+
+  if( !hybris_sensor_ps_init() ) {
+    goto cleanup;
+  }
+
+  if( !hybris_device_sensors_activate(hybris_plugin_sensors_ps_sensor, state) ) {
+    goto cleanup;
+  }
+
+  /* Report the first event after (re)activation without delay */
+  hybris_ps_debounce_reset();
+
+  hybris_sensor_ps_active = state;
+
+  res = true;
+
+cleanup:
+
+  hybris_device_sensors_release();
+
+  return res;
+}
+
+/** Choose between wake-up and non-wake-up proximity sensor
+ *
+ * Wake-up sensor is needed e.g. during calls, when proximity changes
+ * must be reported also while the device is suspended. Otherwise the
+ * non-wake-up variant - if the HAL provides one - is cheaper to use.
+ *
+ * If proximity sensor input is enabled, the newly selected sensor is
+ * activated before the previous one is deactivated.
+ *
+ * @param wakeup true to prefer wake-up sensor, false to avoid it
+ *
+ * @return true if sensor with requested wake-up capability is in use,
+ *         false otherwise
+ */
+bool
+hybris_sensor_ps_set_wakeup(bool wakeup)
+{
+  bool res = false;
+
+  if( !hybris_sensor_ps_init() ) {
+    goto cleanup;
+  }
+
+  const struct sensor_t *prev = hybris_plugin_sensors_ps_sensor;
+  const struct sensor_t *next =
+    hybris_plugin_sensors_select(SENSOR_TYPE_PROXIMITY,
+                                 MCE_CONF_SENSOR_CONFIG_HYBRIS_PS_NAME,
+                                 wakeup);
+
+  if( !next ) {
+    goto cleanup;
+  }
+
+  if( next != prev ) {
+    if( hybris_sensor_ps_active ) {
+      if( hybris_device_sensors_handle->activate(hybris_device_sensors_handle, next->handle, true) < 0 ) {
+        goto cleanup;
+      }
+    }
+
+    hybris_plugin_sensors_ps_sensor = next;
+    hybris_plugin_sensors_update_dispatch();
+
+    if( hybris_sensor_ps_active ) {
+      hybris_device_sensors_handle->activate(hybris_device_sensors_handle, prev->handle, false);
+    }
+  }
+
+  res = hybris_plugin_sensors_is_wakeup(next) == wakeup;
+
+cleanup:
+
+  return res;
+}
+
+/* ========================================================================= *
+ * PROXIMITY_DEBOUNCE
+ *
+ * Cheap proximity sensors can flap between near and far states when
+ * an object is at the detection threshold. To avoid needless display
+ * blank / unblank cycles, state changes can be reported only after
+ * the new state has been stable for a configurable hold time:
+ *
+ *   [SensorConfigHybris]
+ *   ProximityNearHold=<ms>
+ *   ProximityFarHold=<ms>
+ *
+ * Typically near should be reported fast and far with some delay.
+ *
+ * Both hold times default to zero i.e. no debouncing. If debouncing
+ * is enabled, delayed state changes are reported from a helper thread
+ * that sleeps until the hold time has passed.
+ *
+ * Note: Logging functions are not thread safe -> nothing that can
+ *       be called from the worker threads is allowed to log.
+ * ========================================================================= */
+
+/** Proximity sensor debouncing state */
+typedef struct
+{
+  /** Debounce thread id, or 0 if debouncing is disabled */
+  pthread_t       thread;
+
+  /** Mutex for protecting state and serializing callbacks */
+  pthread_mutex_t mutex;
+
+  /** Condition for waking up debounce thread */
+  pthread_cond_t  cond;
+
+  /** Time the near state must be stable before reporting [ms] */
+  int             near_hold;
+
+  /** Time the far state must be stable before reporting [ms] */
+  int             far_hold;
+
+  /** Reported state: -1 = unknown, 0 = far, 1 = near */
+  int             state;
+
+  /** Flag for: state change is waiting for hold time to pass */
+  bool            pending;
+
+  /** CLOCK_MONOTONIC deadline for reporting pending state [ns] */
+  int64_t         deadline;
+
+  /** Timestamp of the latest event matching pending state */
+  int64_t         timestamp;
+
+  /** Distance from the latest event matching pending state */
+  float           distance;
+
+  /** Number of events received */
+  unsigned        events;
+
+  /** Number of state changes reported */
+  unsigned        reported;
+
+  /** Number of state changes suppressed as flapping */
+  unsigned        suppressed;
+} hybris_ps_debounce_t;
+
+/** Proximity sensor debouncing state */
+static hybris_ps_debounce_t hybris_ps_debounce =
+{
+  .thread     = 0,
+  .mutex      = PTHREAD_MUTEX_INITIALIZER,
+  .near_hold  = 0,
+  .far_hold   = 0,
+  .state      = -1,
+  .pending    = false,
+};
+
+/** Get debounce hold time from configuration
+ *
+ * @param key  configuration key
+ *
+ * @return hold time [ms]
+ */
+static int
+hybris_ps_debounce_get_hold(const char *key)
+{
+  int    res = 0;
+  gchar *val = plugin_config_get_string(MCE_CONF_SENSOR_CONFIG_HYBRIS_GROUP,
+                                        key, 0);
+  if( val ) {
+    res = strtol(val, 0, 0);
+    if( res < 0 ) {
+      res = 0;
+    }
+    else if( res > 10000 ) {
+      res = 10000;
+    }
+  }
+
+  g_free(val);
+
+  return res;
+}
+
+/** Get monotonic time stamp
+ *
+ * @return CLOCK_MONOTONIC time in nanoseconds
+ */
+static int64_t
+hybris_ps_debounce_now_ns(void)
+{
+  struct timespec ts = { 0, 0 };
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * INT64_C(1000000000) + ts.tv_nsec;
+}
+
+/** Cancellation cleanup handler for releasing a mutex
+ *
+ * @param aptr mutex as void pointer
+ */
+static void
+hybris_ps_debounce_unlock_cb(void *aptr)
+{
+  pthread_mutex_unlock(aptr);
+}
+
+/** Thread for reporting state changes after hold time has passed
+ *
+ * @param aptr (unused)
+ */
+static void
+hybris_ps_debounce_thread_cb(void *aptr)
+{
+  (void)aptr;
+
+  hybris_ps_debounce_t *self = &hybris_ps_debounce;
+
+  /* Holding mutexes while asynchronously cancelled is not ok */
+  pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, 0);
+
+  for( ;; ) {
+    pthread_mutex_lock(&self->mutex);
+    pthread_cleanup_push(hybris_ps_debounce_unlock_cb, &self->mutex);
+
+    for( ;; ) {
+      if( !self->pending ) {
+        pthread_cond_wait(&self->cond, &self->mutex);
+        continue;
+      }
+
+      if( hybris_ps_debounce_now_ns() >= self->deadline ) {
+        break;
+      }
+
+      struct timespec ts = {
+        .tv_sec  = self->deadline / 1000000000,
+        .tv_nsec = self->deadline % 1000000000,
+      };
+      pthread_cond_timedwait(&self->cond, &self->mutex, &ts);
+    }
+
+    /* The new state has been stable long enough */
+    self->pending   = false;
+    self->state     = !self->state;
+    self->reported += 1;
+
+    mce_hybris_ps_fn cb = __atomic_load_n(&hybris_device_sensors_ps_cb,
+                                          __ATOMIC_SEQ_CST);
+    if( cb ) {
+      pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, 0);
+      cb(self->timestamp, self->distance);
+      pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, 0);
+    }
+
+    pthread_cleanup_pop(1);
+  }
+}
+
+/** Handle proximity sensor event
+ *
+ * For use from sensor worker thread.
+ *
+ * Events are classified as near if the distance is less than the
+ * maximum range of the sensor. Changes to near/far state are either
+ * reported immediately or scheduled to be reported after the hold
+ * time. Flapping back to the reported state during the hold time
+ * cancels the pending state change.
+ *
+ * @param cb        callback for reporting events
+ * @param timestamp event timestamp
+ * @param distance  reported distance
+ */
+static void
+hybris_ps_debounce_input(mce_hybris_ps_fn cb, int64_t timestamp,
+                         float distance)
+{
+  hybris_ps_debounce_t  *self   = &hybris_ps_debounce;
+  const struct sensor_t *sensor = hybris_plugin_sensors_ps_sensor;
+
+  if( !self->thread || !sensor ) {
+    cb(timestamp, distance);
+    return;
+  }
+
+  int state = distance < sensor->maxRange;
+
+  pthread_mutex_lock(&self->mutex);
+
+  self->events += 1;
+
+  if( state == self->state ) {
+    /* Flapped back to reported state */
+    if( self->pending ) {
+      self->pending     = false;
+      self->suppressed += 1;
+    }
+    goto cleanup;
+  }
+
+  int hold = state ? self->near_hold : self->far_hold;
+
+  if( hold <= 0 || self->state < 0 ) {
+    /* Report immediately */
+    self->pending   = false;
+    self->state     = state;
+    self->reported += 1;
+    cb(timestamp, distance);
+    goto cleanup;
+  }
+
+  if( !self->pending ) {
+    /* Start hold time from the first event in new state */
+    self->pending  = true;
+    self->deadline = hybris_ps_debounce_now_ns() + hold * INT64_C(1000000);
+    pthread_cond_signal(&self->cond);
+  }
+
+  self->timestamp = timestamp;
+  self->distance  = distance;
+
+cleanup:
+
+  pthread_mutex_unlock(&self->mutex);
+}
+
+/** Forget reported state, so that the next event is reported immediately
+ */
+static void
+hybris_ps_debounce_reset(void)
+{
+  hybris_ps_debounce_t *self = &hybris_ps_debounce;
+
+  if( !self->thread ) {
+    return;
+  }
+
+  pthread_mutex_lock(&self->mutex);
+  if( self->pending ) {
+    self->pending     = false;
+    self->suppressed += 1;
+  }
+  self->state = -1;
+  pthread_mutex_unlock(&self->mutex);
+}
+
+/** Wait until debounce thread is not executing proximity callback
+ *
+ * Does not wait if called from sensor threads, i.e. when a callback
+ * is changed from within a callback.
+ */
+static void
+hybris_ps_debounce_synchronize(void)
+{
+  hybris_ps_debounce_t *self = &hybris_ps_debounce;
+
+  if( !self->thread ) {
+    return;
+  }
+
+  if( pthread_equal(pthread_self(), self->thread) ) {
+    return;
+  }
+
+  if( hybris_device_sensors_thread_id &&
+      pthread_equal(pthread_self(), hybris_device_sensors_thread_id) ) {
+    return;
+  }
+
+  pthread_mutex_lock(&self->mutex);
+  pthread_mutex_unlock(&self->mutex);
+}
+
+/** Get proximity debouncing statistics
+ *
+ * @param stats  where to store statistics
+ */
+static void
+hybris_ps_debounce_get_stats(mce_hybris_sensor_stats_t *stats)
+{
+  hybris_ps_debounce_t *self = &hybris_ps_debounce;
+
+  pthread_mutex_lock(&self->mutex);
+  stats->ps_events     = self->events;
+  stats->ps_reported   = self->reported;
+  stats->ps_suppressed = self->suppressed;
+  pthread_mutex_unlock(&self->mutex);
+}
+
+/** Start proximity debounce thread, if enabled in configuration
+ */
+static void
+hybris_ps_debounce_start(void)
+{
+  static bool cond_done = false;
+
+  hybris_ps_debounce_t *self = &hybris_ps_debounce;
+
+  if( self->thread ) {
+    goto cleanup;
+  }
+
+  self->near_hold = hybris_ps_debounce_get_hold(MCE_CONF_SENSOR_CONFIG_HYBRIS_PS_NEAR_HOLD);
+  self->far_hold  = hybris_ps_debounce_get_hold(MCE_CONF_SENSOR_CONFIG_HYBRIS_PS_FAR_HOLD);
+
+  if( self->near_hold <= 0 && self->far_hold <= 0 ) {
+    goto cleanup;
+  }
+
+  if( !cond_done ) {
+    /* Hold time deadlines are in CLOCK_MONOTONIC time base */
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&self->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    cond_done = true;
+  }
+
+  self->state   = -1;
+  self->pending = false;
+
+  /* Long lived and cancelled on stop -> would pin a pool worker */
+  self->thread  = hybris_thread_start(hybris_ps_debounce_thread_cb, 0);
+
+  mce_log(LL_DEBUG, "proximity debounce: near=%d ms far=%d ms -> %s",
+          self->near_hold, self->far_hold,
+          self->thread ? "enabled" : "failed");
 
 cleanup:
 
+  return;
+}
+
+/** Stop proximity debounce thread
+ */
+static void
+hybris_ps_debounce_stop(void)
+{
+  hybris_ps_debounce_t *self = &hybris_ps_debounce;
+
+  if( !self->thread ) {
+    return;
+  }
+
+  hybris_thread_stop(self->thread),
+    self->thread = 0;
+
+  mce_log(LL_DEBUG, "proximity debounce: events=%u reported=%u"
+          " suppressed=%u", self->events, self->reported,
+          self->suppressed);
+
+  self->state   = -1;
+  self->pending = false;
+}
+
+/* ========================================================================= *
+ * ALS_FILTER
+ *
+ * Ambient light sensor samples can be filtered before delivery, so
+ * that mce does not need to react to every bit of sensor noise:
+ *
+ *   [SensorConfigHybris]
+ *   # Reject isolated samples that differ from filtered level by
+ *   # more than given factor; disabled by default
+ *   LightFilterSpike=<ratio>
+ *   # Sliding median window size, up to 9; disabled by default
+ *   LightFilterMedian=<samples>
+ *   # Exponential moving average weight for new samples, 0 ... 1;
+ *   # default is 1 i.e. no averaging
+ *   LightFilterAlpha=<weight>
+ *   # Minimum relative change to filtered level required for delivery,
+ *   # in percent; default is 0 i.e. any change is delivered
+ *   LightFilterDeadband=<percent>
+ *
+ * The filter state is of fixed size and accessed only from the sensor
+ * worker thread - with the exception of configuration that is set up
+ * before the worker is started, and atomic reset flag / counters.
+ * ========================================================================= */
+
+/** Maximum sliding median window size */
+#define HYBRIS_ALS_FILTER_MAX_MEDIAN 9
+
+/** Ambient light sensor filter state */
+typedef struct
+{
+  /** Flag for: some filtering stage is enabled */
+  bool     enabled;
+
+  /** Spike rejection ratio, or 0 if disabled */
+  float    spike;
+
+  /** Median window size, 1 = disabled */
+  int      median;
+
+  /** Moving average weight for new samples, 1 = disabled */
+  float    alpha;
+
+  /** Relative change required for delivery */
+  float    deadband;
+
+  /** Sliding median window */
+  float    window[HYBRIS_ALS_FILTER_MAX_MEDIAN];
+
+  /** Number of samples in median window */
+  int      fill;
+
+  /** Position for the next sample in median window */
+  int      pos;
+
+  /** Flag for: output has been calculated */
+  bool     have_output;
+
+  /** Filtered level */
+  float    output;
+
+  /** Flag for: level has been delivered */
+  bool     have_delivered;
+
+  /** Most recently delivered level */
+  float    delivered;
+
+  /** Direction of ongoing deviation from filtered level, or 0 */
+  int      spike_dir;
+
+  /** Flag for: history should be cleared; accessed via __atomic builtins */
+  bool     reset;
+
+  /** Counters, accessed via __atomic builtins */
+  unsigned events;
+  unsigned rejected;
+  unsigned passed;
+} hybris_als_filter_t;
+
+/** Ambient light sensor filter state */
+static hybris_als_filter_t hybris_als_filter =
+{
+  .enabled = false,
+  .spike   = 0.0f,
+  .median  = 1,
+  .alpha   = 1.0f,
+};
+
+/** Get floating point filter parameter from configuration
+ *
+ * @param key  configuration key
+ * @param def  default value
+ * @param lo   minimum value
+ * @param hi   maximum value
+ *
+ * @return configured value clamped to [lo, hi], or def if not configured
+ */
+static float
+hybris_als_filter_get_float(const char *key, float def, float lo, float hi)
+{
+  float  res = def;
+  gchar *val = plugin_config_get_string(MCE_CONF_SENSOR_CONFIG_HYBRIS_GROUP,
+                                        key, 0);
+  if( val ) {
+    res = strtof(val, 0);
+    res = res < lo ? lo : res > hi ? hi : res;
+  }
+
+  g_free(val);
+
   return res;
 }
 
-/** Stop using proximity sensor via libhybris
+/** Set up ambient light filter from configuration
  *
- * @return true on success, false on failure
+ * Must be called while the sensor worker thread is not running.
  */
-void
-hybris_sensor_ps_quit(void)
+static void
+hybris_als_filter_setup(void)
 {
-  hybris_device_sensors_ps_cb = 0;
+  static bool done = false;
+
+  hybris_als_filter_t *self = &hybris_als_filter;
+
+  if( done ) {
+    goto cleanup;
+  }
+
+  done = true;
+
+  self->spike    = hybris_als_filter_get_float(MCE_CONF_SENSOR_CONFIG_HYBRIS_ALS_SPIKE,
+                                               0.0f, 0.0f, 1000.0f);
+  self->median   = (int)hybris_als_filter_get_float(MCE_CONF_SENSOR_CONFIG_HYBRIS_ALS_MEDIAN,
+                                                    1, 1, HYBRIS_ALS_FILTER_MAX_MEDIAN);
+  self->alpha    = hybris_als_filter_get_float(MCE_CONF_SENSOR_CONFIG_HYBRIS_ALS_ALPHA,
+                                               1.0f, 0.01f, 1.0f);
+  self->deadband = hybris_als_filter_get_float(MCE_CONF_SENSOR_CONFIG_HYBRIS_ALS_DEADBAND,
+                                               0.0f, 0.0f, 100.0f) / 100.0f;
+
+  /* Ratios below one would reject everything */
+  if( self->spike > 0.0f && self->spike <= 1.0f ) {
+    self->spike = 0.0f;
+  }
+
+  self->enabled = (self->spike > 0.0f || self->median > 1 ||
+                   self->alpha < 1.0f || self->deadband > 0.0f);
+
+  mce_log(LL_DEBUG, "light filter: spike=%g median=%d alpha=%g"
+          " deadband=%g -> %s", self->spike, self->median, self->alpha,
+          self->deadband, self->enabled ? "enabled" : "disabled");
+
+cleanup:
+
+  hybris_als_filter_reset();
 }
 
-/** Set callback function for handling proximity sensor events
+/** Request filter history to be cleared before the next sample
+ */
+static void
+hybris_als_filter_reset(void)
+{
+  __atomic_store_n(&hybris_als_filter.reset, true, __ATOMIC_RELEASE);
+}
+
+/** Get median of samples in sliding window
  *
- * Note: the callback function will be called from worker thread.
+ * @return median value
  */
-void
-hybris_sensor_ps_set_hook(mce_hybris_ps_fn cb)
+static float
+hybris_als_filter_median(void)
 {
-  hybris_device_sensors_ps_cb = cb;
+  hybris_als_filter_t *self = &hybris_als_filter;
+
+  float tmp[HYBRIS_ALS_FILTER_MAX_MEDIAN];
+
+  /* Insertion sort; the window is tiny */
+  for( int i = 0; i < self->fill; ++i ) {
+    float v = self->window[i];
+    int   k = i;
+    for( ; k > 0 && tmp[k - 1] > v; --k ) {
+      tmp[k] = tmp[k - 1];
+    }
+    tmp[k] = v;
+  }
+
+  return tmp[self->fill / 2];
 }
 
-/** Set proximity sensort input enabled state
+/** Pass ambient light sample through filter pipeline
  *
- * @param state true to enable input, or false to disable input
+ * For use from sensor worker thread.
+ *
+ * @param lux  raw sample
+ * @param out  where to store filtered level
+ *
+ * @return true if filtered level should be delivered, false otherwise
  */
-bool
-hybris_sensor_ps_set_active(bool state)
+static bool
+hybris_als_filter_input(float lux, float *out)
 {
-  bool res = false;
+  hybris_als_filter_t *self = &hybris_als_filter;
 
-  if( !hybris_sensor_ps_init() ) {
+  bool deliver = false;
+
+  __atomic_add_fetch(&self->events, 1, __ATOMIC_RELAXED);
+
+  if( !self->enabled ) {
+    *out = lux;
+    deliver = true;
     goto cleanup;
   }
 
-  if( hybris_device_sensors_handle->activate(hybris_device_sensors_handle, hybris_plugin_sensors_ps_sensor->handle, state) < 0 ) {
-    goto cleanup;
+  if( __atomic_exchange_n(&self->reset, false, __ATOMIC_ACQUIRE) ) {
+    self->fill           = 0;
+    self->pos            = 0;
+    self->have_output    = false;
+    self->have_delivered = false;
+    self->spike_dir      = 0;
   }
 
-  res = true;
+  /* Spike rejection: drop the first sample that deviates too much
+   * from filtered level; accept it and the following ones as long as
+   * they keep deviating in the same direction, so that real step
+   * changes are followed without dropping every other sample */
+  if( self->spike > 0.0f && self->have_output ) {
+    float ratio = (lux + 1.0f) / (self->output + 1.0f);
+    int   dir   = (ratio > self->spike) ? 1 : (ratio * self->spike < 1.0f) ? -1 : 0;
+
+    if( dir != self->spike_dir ) {
+      self->spike_dir = dir;
+      if( dir != 0 ) {
+        __atomic_add_fetch(&self->rejected, 1, __ATOMIC_RELAXED);
+        goto cleanup;
+      }
+    }
+  }
+
+  /* Sliding median */
+  float level = lux;
+
+  if( self->median > 1 ) {
+    self->window[self->pos] = lux;
+    self->pos = (self->pos + 1) % self->median;
+    if( self->fill < self->median ) {
+      self->fill += 1;
+    }
+    level = hybris_als_filter_median();
+  }
+
+  /* Exponential moving average */
+  if( self->have_output ) {
+    self->output += self->alpha * (level - self->output);
+  }
+  else {
+    self->output      = level;
+    self->have_output = true;
+  }
+
+  /* Deliver only changes exceeding the dead band */
+  if( self->have_delivered ) {
+    float delta = fabsf(self->output - self->delivered);
+    if( delta <= self->deadband * fmaxf(self->delivered, 1.0f) ) {
+      goto cleanup;
+    }
+  }
+
+  self->delivered      = self->output;
+  self->have_delivered = true;
+
+  *out = self->output;
+  deliver = true;
 
 cleanup:
 
-  return res;
+  if( deliver ) {
+    __atomic_add_fetch(&self->passed, 1, __ATOMIC_RELAXED);
+  }
+
+  return deliver;
+}
+
+/** Get ambient light filter statistics
+ *
+ * @param stats  where to store statistics
+ */
+static void
+hybris_als_filter_get_stats(mce_hybris_sensor_stats_t *stats)
+{
+  hybris_als_filter_t *self = &hybris_als_filter;
+
+  stats->als_events    = __atomic_load_n(&self->events, __ATOMIC_RELAXED);
+  stats->als_rejected  = __atomic_load_n(&self->rejected, __ATOMIC_RELAXED);
+  stats->als_delivered = __atomic_load_n(&self->passed, __ATOMIC_RELAXED);
 }
 
 /* ========================================================================= *
@@ -438,7 +2502,7 @@ hybris_device_als_init(void)
 {
   bool res = false;
 
-  if( !hybris_device_sensors_init() ) {
+  if( !hybris_device_sensors_probe() ) {
     goto cleanup;
   }
 
@@ -460,17 +2524,21 @@ cleanup:
 void
 hybris_device_als_quit(void)
 {
-  hybris_device_sensors_als_cb = 0;
+  hybris_device_als_set_hook(0);
 }
 
 /** Set callback function for handling ambient light sensor events
  *
  * Note: the callback function will be called from worker thread.
+ *
+ * When called from other than the worker thread, this function returns
+ * only after the previously set callback is no longer in use.
  */
 void
 hybris_device_als_set_hook(mce_hybris_als_fn cb)
 {
-  hybris_device_sensors_als_cb = cb;
+  __atomic_store_n(&hybris_device_sensors_als_cb, cb, __ATOMIC_SEQ_CST);
+  hybris_device_sensors_synchronize();
 }
 
 /** Set ambient light sensor input enabled state
@@ -486,13 +2554,227 @@ hybris_device_als_set_active(bool state)
     goto cleanup;
   }
 
-  if( hybris_device_sensors_handle->activate(hybris_device_sensors_handle, hybris_plugin_sensors_als_sensor->handle, state) < 0 ) {
+  if( !hybris_device_sensors_activate(hybris_plugin_sensors_als_sensor, state) ) {
+    goto cleanup;
+  }
+
+  /* Do not mix samples from before and after (re)activation */
+  hybris_als_filter_reset();
+
+  hybris_device_als_active = state;
+
+  res = true;
+
+cleanup:
+
+  hybris_device_sensors_release();
+
+  return res;
+}
+
+/* ========================================================================= *
+ * GENERIC_SENSORS
+ * ========================================================================= */
+
+/** Predicate for: sensor type can be used via generic sensor interface
+ *
+ * Only types listed in mce_hybris_sensor_type_t are accepted - others,
+ * such as one-shot and uncalibrated sensors, have event payloads that
+ * can't be passed on as simple value vectors. Proximity and ambient
+ * light sensors have dedicated interfaces.
+ *
+ * @param type SENSOR_TYPE_ACCELEROMETER etc
+ *
+ * @return true if type is supported, false otherwise
+ */
+static bool
+hybris_device_sensor_is_generic(int type)
+{
+  switch( type ) {
+  case MCE_HYBRIS_SENSOR_ACCELEROMETER:
+  case MCE_HYBRIS_SENSOR_MAGNETIC_FIELD:
+  case MCE_HYBRIS_SENSOR_ORIENTATION:
+  case MCE_HYBRIS_SENSOR_GYROSCOPE:
+  case MCE_HYBRIS_SENSOR_PRESSURE:
+  case MCE_HYBRIS_SENSOR_TEMPERATURE:
+  case MCE_HYBRIS_SENSOR_GRAVITY:
+  case MCE_HYBRIS_SENSOR_LINEAR_ACCELERATION:
+  case MCE_HYBRIS_SENSOR_ROTATION_VECTOR:
+  case MCE_HYBRIS_SENSOR_RELATIVE_HUMIDITY:
+  case MCE_HYBRIS_SENSOR_AMBIENT_TEMPERATURE:
+    return true;
+
+  default:
+    break;
+  }
+
+  return false;
+}
+
+/** Get number of meaningful values in sensor event
+ *
+ * @param type SENSOR_TYPE_ACCELEROMETER etc
+ *
+ * @return number of values in sensors_event_t data array
+ */
+static int
+hybris_device_sensor_value_count(int type)
+{
+  switch( type ) {
+  case SENSOR_TYPE_ACCELEROMETER:
+  case SENSOR_TYPE_MAGNETIC_FIELD:
+  case SENSOR_TYPE_ORIENTATION:
+  case SENSOR_TYPE_GYROSCOPE:
+  case SENSOR_TYPE_GRAVITY:
+  case SENSOR_TYPE_LINEAR_ACCELERATION:
+    return 3;
+
+  case SENSOR_TYPE_ROTATION_VECTOR:
+    return 5;
+
+  case SENSOR_TYPE_PRESSURE:
+  case SENSOR_TYPE_TEMPERATURE:
+  case SENSOR_TYPE_RELATIVE_HUMIDITY:
+  case SENSOR_TYPE_AMBIENT_TEMPERATURE:
+    return 1;
+
+  default:
+    break;
+  }
+
+  return MCE_HYBRIS_SENSOR_MAX_VALUES;
+}
+
+/** Start using sensor of given type via libhybris
+ *
+ * @param type SENSOR_TYPE_ACCELEROMETER etc
+ *
+ * @return true on success, false on failure
+ */
+bool
+hybris_device_sensor_init(int type)
+{
+  bool res = false;
+
+  if( !hybris_device_sensor_is_generic(type) ) {
+    goto cleanup;
+  }
+
+  if( !hybris_device_sensors_probe() ) {
+    goto cleanup;
+  }
+
+  if( !hybris_plugin_sensors_get_sensor(type) ) {
+    goto cleanup;
+  }
+
+  res = true;
+
+cleanup:
+
+  return res;
+}
+
+/** Deactivate all sensors activated via hybris_device_sensor_set_active()
+ */
+static void
+hybris_device_sensor_deactivate_all(void)
+{
+  uint32_t mask = __atomic_exchange_n(&hybris_device_sensors_generic_mask,
+                                      0, __ATOMIC_SEQ_CST);
+
+  if( !hybris_device_sensors_handle ) {
+    goto cleanup;
+  }
+
+  for( int type = 1; type < 32; ++type ) {
+    if( !(mask & (1u << type)) ) {
+      continue;
+    }
+
+    const struct sensor_t *sensor = hybris_plugin_sensors_get_sensor(type);
+
+    if( sensor ) {
+      hybris_device_sensors_handle->activate(hybris_device_sensors_handle, sensor->handle, false);
+    }
+  }
+
+cleanup:
+
+  return;
+}
+
+/** Stop using sensors via generic sensor interface
+ *
+ * Deactivates all sensors activated via hybris_device_sensor_set_active()
+ * and removes the event callback.
+ */
+void
+hybris_device_sensor_quit(void)
+{
+  hybris_device_sensor_deactivate_all();
+  hybris_device_sensor_set_hook(0);
+  hybris_device_sensors_release();
+}
+
+/** Set callback function for handling events from generic sensors
+ *
+ * Note: the callback function will be called from worker thread.
+ *
+ * When called from other than the worker thread, this function returns
+ * only after the previously set callback is no longer in use.
+ */
+void
+hybris_device_sensor_set_hook(mce_hybris_sensor_fn cb)
+{
+  __atomic_store_n(&hybris_device_sensors_generic_cb, cb, __ATOMIC_SEQ_CST);
+  hybris_device_sensors_synchronize();
+}
+
+/** Set sensor input enabled state
+ *
+ * @param type  SENSOR_TYPE_ACCELEROMETER etc
+ * @param state true to enable input, or false to disable input
+ *
+ * @return true on success, false on failure
+ */
+bool
+hybris_device_sensor_set_active(int type, bool state)
+{
+  bool res = false;
+
+  if( !hybris_device_sensor_init(type) ) {
+    goto cleanup;
+  }
+
+  const struct sensor_t *sensor = hybris_plugin_sensors_get_sensor(type);
+  uint32_t               bit    = 1u << type;
+
+  /* Enable forwarding before activating and disable after deactivating,
+   * so that no events get lost in between */
+  if( state ) {
+    __atomic_or_fetch(&hybris_device_sensors_generic_mask, bit,
+                      __ATOMIC_SEQ_CST);
+  }
+
+  if( !hybris_device_sensors_activate(sensor, state) ) {
+    if( state ) {
+      __atomic_and_fetch(&hybris_device_sensors_generic_mask, ~bit,
+                         __ATOMIC_SEQ_CST);
+    }
     goto cleanup;
   }
 
+  if( !state ) {
+    __atomic_and_fetch(&hybris_device_sensors_generic_mask, ~bit,
+                       __ATOMIC_SEQ_CST);
+  }
+
   res = true;
 
 cleanup:
 
+  hybris_device_sensors_release();
+
   return res;
 }
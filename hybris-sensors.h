@@ -26,17 +26,27 @@
 
 # include "plugin-api.h"
 
+bool hybris_plugin_sensors_preload (void);
 bool hybris_plugin_sensors_load    (void);
 void hybris_plugin_sensors_unload  (void);
+bool hybris_plugin_sensors_get_caps(uint32_t *types, int32_t *min_delay, bool *ps_wakeup);
+
+bool hybris_device_sensors_get_stats(mce_hybris_sensor_stats_t *stats);
 
 bool hybris_sensor_ps_init        (void);
 void hybris_sensor_ps_quit        (void);
 bool hybris_sensor_ps_set_active  (bool state);
 void hybris_sensor_ps_set_hook    (mce_hybris_ps_fn cb);
+bool hybris_sensor_ps_set_wakeup  (bool wakeup);
 
 bool hybris_device_als_init       (void);
 void hybris_device_als_quit       (void);
 bool hybris_device_als_set_active (bool state);
 void hybris_device_als_set_hook   (mce_hybris_als_fn cb);
 
+bool hybris_device_sensor_init       (int type);
+void hybris_device_sensor_quit       (void);
+bool hybris_device_sensor_set_active (int type, bool state);
+void hybris_device_sensor_set_hook   (mce_hybris_sensor_fn cb);
+
 #endif /* HYBRIS_SENSORS_H_ */
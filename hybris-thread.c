@@ -24,7 +24,10 @@
 #include "hybris-thread.h"
 #include "plugin-logging.h"
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
+#include <errno.h>
 
 /* ========================================================================= *
  * PROTOTYPES
@@ -35,37 +38,128 @@
  * ------------------------------------------------------------------------- */
 
 /** Thread start details; used for inserting custom thread setup code
+ *
+ * Lives in the stack of hybris_thread_start() caller, which waits
+ * until the new thread has copied what it needs and set started flag.
  */
 typedef struct
 {
   /** Function to call from initialized thread */
-  void (*func)(void *);
+  void          (*func)(void *);
 
   /** Parameter to pass to the thread function */
-  void  *data;
+  void           *data;
+
+  /** Guards the started flag */
+  pthread_mutex_t mutex;
+
+  /** For signaling thread startup */
+  pthread_cond_t  cond;
+
+  /** Predicate for: thread is up and running */
+  bool            started;
 } thread_gate_t;
 
 static void          *thread_gate_start_cb (void *aptr);
 
-static thread_gate_t *thread_gate_create   (void (*func)(void *), void *data);
-static void           thread_gate_delete   (thread_gate_t *self);
+/* ------------------------------------------------------------------------- *
+ * THREAD_POOL
+ * ------------------------------------------------------------------------- */
+
+/** Task executed by pool worker thread */
+struct hybris_task_t
+{
+  /** Next task in queue */
+  hybris_task_t  *next;
+
+  /** Task name, for thread naming and diagnostics */
+  char            name[16];
+
+  /** Function to call from worker thread */
+  void          (*func)(void *);
+
+  /** Parameter to pass to the task function */
+  void           *data;
+
+  /** For signaling task completion */
+  pthread_cond_t  cond;
+
+  /** Predicate for: task function has returned */
+  bool            done;
+
+  /** Flag for: task is released on completion instead of waited for */
+  bool            detached;
+};
+
+/** Pool worker thread bookkeeping */
+typedef struct
+{
+  /** Worker thread id */
+  pthread_t tid;
+
+  /** Flag for: worker has exited its loop and can be joined */
+  bool      exited;
+
+  /** Flag for: pool has given up waiting; worker frees this on exit */
+  bool      abandoned;
+} thread_pool_worker_t;
+
+static void           thread_pool_set_name      (const char *name);
+static hybris_task_t *thread_pool_take_locked   (void);
+static void           thread_pool_worker_cb     (void *aptr);
+static bool           thread_pool_reserve_locked(void);
+static void           thread_pool_grow          (void);
+static void           thread_pool_deadline      (struct timespec *ts, int ms);
 
 /* ------------------------------------------------------------------------- *
  * GENERIC
  * ------------------------------------------------------------------------- */
 
-pthread_t hybris_thread_start (void (*start)(void *), void *arg);
-void      hybris_thread_stop  (pthread_t tid);
+pthread_t      hybris_thread_start     (void (*start)(void *), void *arg);
+void           hybris_thread_stop      (pthread_t tid);
+hybris_task_t *hybris_task_start       (const char *name, void (*func)(void *), void *data);
+bool           hybris_task_is_done     (hybris_task_t *task);
+void           hybris_task_wait        (hybris_task_t *task);
+bool           hybris_task_wait_timeout(hybris_task_t *task, int ms);
+void           hybris_task_detach      (hybris_task_t *task);
+void           hybris_thread_pool_quit (void);
 
 /* ========================================================================= *
  * DATA
  * ========================================================================= */
 
-/** Mutex used for synchronous worker thread startup */
-static pthread_mutex_t hybris_thread_gate_mutex = PTHREAD_MUTEX_INITIALIZER;
+/** Maximum number of pool worker threads */
+#define HYBRIS_THREAD_POOL_MAX 4
+
+/** How long to wait for pool workers to finish on shutdown [ms] */
+#define HYBRIS_THREAD_POOL_QUIT_TIMEOUT 3000
+
+/** Guards all thread pool data */
+static pthread_mutex_t hybris_thread_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** For signaling pool workers about queued tasks / shutdown */
+static pthread_cond_t  hybris_thread_pool_cond  = PTHREAD_COND_INITIALIZER;
+
+/** Pool worker threads */
+static thread_pool_worker_t *hybris_thread_pool_worker[HYBRIS_THREAD_POOL_MAX];
+
+/** Number of pool worker threads started */
+static int             hybris_thread_pool_count = 0;
 
-/** Condition used for signaling worker thread startup */
-static pthread_cond_t  hybris_thread_gate_cond  = PTHREAD_COND_INITIALIZER;
+/** Number of pool worker threads waiting for tasks */
+static int             hybris_thread_pool_idle  = 0;
+
+/** Number of pool worker threads being started */
+static int             hybris_thread_pool_starting = 0;
+
+/** Flag for: pool workers should exit */
+static bool            hybris_thread_pool_quitting = false;
+
+/** Queued tasks, oldest first */
+static hybris_task_t  *hybris_thread_pool_head  = 0;
+
+/** Where to link the next queued task */
+static hybris_task_t **hybris_thread_pool_tail  = &hybris_thread_pool_head;
 
 /* ========================================================================= *
  * THREAD_GATE
@@ -88,23 +182,21 @@ thread_gate_start_cb(void *aptr)
 {
   thread_gate_t *gate = aptr;
 
-  void  (*func)(void*);
-  void   *data;
+  /* Collect data we need, the gate goes away once starter is woken up */
+  void  (*func)(void*) = gate->func;
+  void   *data         = gate->data;
 
   /* Allow quick and dirty cancellation */
   pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, 0);
   pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, 0);
 
   /* Tell thread gate we're up and running */
-  pthread_mutex_lock(&hybris_thread_gate_mutex);
-  pthread_cond_broadcast(&hybris_thread_gate_cond);
-  pthread_mutex_unlock(&hybris_thread_gate_mutex);
+  pthread_mutex_lock(&gate->mutex);
+  gate->started = true;
+  pthread_cond_signal(&gate->cond);
+  pthread_mutex_unlock(&gate->mutex);
 
-  /* Collect data we need, release rest */
-  func = gate->func;
-  data = gate->data;
-
-  thread_gate_delete(gate),gate = 0;
+  gate = 0;
 
   /* Call the real thread start */
   func(data);
@@ -112,36 +204,187 @@ thread_gate_start_cb(void *aptr)
   return 0;
 }
 
-/** Construct a thread gate object
+/* ========================================================================= *
+ * THREAD_POOL
+ *
+ * Blocking work - such as HAL calls that can take hundreds of milliseconds
+ * - can be executed off the mainloop as tasks in a small pool of worker
+ * threads instead of creating ad-hoc threads for each purpose.
  *
- * @param func Thread function
- * @param data Data to pass to the thread function
+ * Each task has a completion object of its own, which the submitter can
+ * poll or wait for. Tasks that nobody is going to wait for can be
+ * detached, in which case they are released when they finish.
  *
- * @return gate object, or NULL
+ * Unlike threads started via hybris_thread_start(), pool workers are never
+ * cancelled - they exit only after finishing all queued tasks when the
+ * pool is shut down. Workers that do not finish in time, e.g. because a
+ * task is stuck in vendor code, are detached and left behind rather than
+ * allowed to block shutdown.
+ * ========================================================================= */
+
+/** Set name of the calling thread, for diagnostic purposes
+ *
+ * @param name thread name, truncated to 15 characters
  */
-static thread_gate_t *
-thread_gate_create(void (*func)(void *), void *data)
+static void
+thread_pool_set_name(const char *name)
 {
-  thread_gate_t *self = calloc(1, sizeof *self);
+  char tmp[16];
+  snprintf(tmp, sizeof tmp, "%s", name);
+  pthread_setname_np(pthread_self(), tmp);
+}
 
-  if( self ) {
-    self->func = func;
-    self->data = data;
+/** Take the oldest task from queue
+ *
+ * Caller must hold hybris_thread_pool_mutex.
+ *
+ * @return task, or NULL if queue is empty
+ */
+static hybris_task_t *
+thread_pool_take_locked(void)
+{
+  hybris_task_t *task = hybris_thread_pool_head;
+
+  if( task ) {
+    if( !(hybris_thread_pool_head = task->next) )
+      hybris_thread_pool_tail = &hybris_thread_pool_head;
+    task->next = 0;
   }
 
-  return self;
+  return task;
 }
 
-/** Destroy a thread gate object
+/** Pool worker thread
+ *
+ * Note: no mce_log() calls from this function - they are not thread safe
  *
- * @param self Gate object, or NULL
+ * @param aptr worker bookkeeping data as void pointer
  */
 static void
-thread_gate_delete(thread_gate_t *self)
+thread_pool_worker_cb(void *aptr)
 {
-  if( self ) {
+  thread_pool_worker_t *self = aptr;
+
+  /* Pool workers are not cancelled, they are joined */
+  pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, 0);
+  pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, 0);
+
+  thread_pool_set_name("hybris-pool");
+
+  pthread_mutex_lock(&hybris_thread_pool_mutex);
+
+  for( ;; ) {
+    /* Abandoned worker must not pick up more tasks */
+    if( self->abandoned )
+      break;
+
+    hybris_task_t *task = thread_pool_take_locked();
+
+    if( !task ) {
+      if( hybris_thread_pool_quitting )
+        break;
+
+      hybris_thread_pool_idle += 1;
+      pthread_cond_wait(&hybris_thread_pool_cond, &hybris_thread_pool_mutex);
+      hybris_thread_pool_idle -= 1;
+      continue;
+    }
+
+    pthread_mutex_unlock(&hybris_thread_pool_mutex);
+
+    thread_pool_set_name(task->name);
+    task->func(task->data);
+    thread_pool_set_name("hybris-pool");
+
+    pthread_mutex_lock(&hybris_thread_pool_mutex);
+
+    if( task->detached ) {
+      pthread_cond_destroy(&task->cond);
+      free(task);
+    }
+    else {
+      task->done = true;
+      pthread_cond_broadcast(&task->cond);
+    }
+  }
+
+  if( self->abandoned ) {
+    /* Nobody is going to join us */
     free(self);
   }
+  else {
+    self->exited = true;
+    pthread_cond_broadcast(&hybris_thread_pool_cond);
+  }
+
+  pthread_mutex_unlock(&hybris_thread_pool_mutex);
+}
+
+/** Check whether additional pool worker is needed for a new task
+ *
+ * Caller must hold hybris_thread_pool_mutex. If true is returned,
+ * a worker slot has been reserved and caller must follow up with
+ * thread_pool_grow() after releasing the mutex.
+ *
+ * @return true if a worker should be started, false otherwise
+ */
+static bool
+thread_pool_reserve_locked(void)
+{
+  /* Count queued tasks that are not going to be picked by idle workers */
+  int backlog = 1 - hybris_thread_pool_idle - hybris_thread_pool_starting;
+
+  for( hybris_task_t *task = hybris_thread_pool_head; task; task = task->next )
+    ++backlog;
+
+  if( backlog <= 0 ||
+      hybris_thread_pool_count + hybris_thread_pool_starting >= HYBRIS_THREAD_POOL_MAX )
+    return false;
+
+  hybris_thread_pool_starting += 1;
+  return true;
+}
+
+/** Start pool worker reserved via thread_pool_reserve_locked()
+ *
+ * Caller must not hold hybris_thread_pool_mutex - starting a thread
+ * involves logging and waiting for the new thread to get going.
+ */
+static void
+thread_pool_grow(void)
+{
+  thread_pool_worker_t *worker = calloc(1, sizeof *worker);
+
+  if( worker && !(worker->tid = hybris_thread_start(thread_pool_worker_cb, worker)) )
+    free(worker), worker = 0;
+
+  pthread_mutex_lock(&hybris_thread_pool_mutex);
+
+  hybris_thread_pool_starting -= 1;
+
+  if( worker ) {
+    hybris_thread_pool_worker[hybris_thread_pool_count++] = worker;
+
+    /* Worker might have exited already, see hybris_thread_pool_quit() */
+    pthread_cond_broadcast(&hybris_thread_pool_cond);
+  }
+
+  pthread_mutex_unlock(&hybris_thread_pool_mutex);
+}
+
+/** Get absolute CLOCK_REALTIME deadline for pthread_cond_timedwait()
+ *
+ * @param ts  where to store the deadline
+ * @param ms  milliseconds from now
+ */
+static void
+thread_pool_deadline(struct timespec *ts, int ms)
+{
+  clock_gettime(CLOCK_REALTIME, ts);
+  ts->tv_sec  += ms / 1000;
+  ts->tv_nsec += (ms % 1000) * 1000000L;
+  if( ts->tv_nsec >= 1000000000L )
+    ts->tv_sec += 1, ts->tv_nsec -= 1000000000L;
 }
 
 /* ========================================================================= *
@@ -149,6 +392,10 @@ thread_gate_delete(thread_gate_t *self)
  * ========================================================================= */
 
 /** Helper for starting new worker thread
+ *
+ * Each start uses a gate of its own and waits for the started
+ * predicate, so spurious wakeups or concurrent starts can't make
+ * this return before the thread is ready.
  *
  * @param start function to call from new thread
  * @param arg   data to pass to start function
@@ -158,16 +405,19 @@ thread_gate_delete(thread_gate_t *self)
 pthread_t
 hybris_thread_start(void (*start)(void *), void* arg)
 {
-  pthread_t      tid  = 0;
-  thread_gate_t *gate = 0;
-
-  if( !(gate = thread_gate_create(start, arg)) ) {
-    goto EXIT;
-  }
-
-  pthread_mutex_lock(&hybris_thread_gate_mutex);
-
-  if( pthread_create(&tid, 0, thread_gate_start_cb, gate) != 0 ) {
+  pthread_t     tid  = 0;
+  thread_gate_t gate =
+  {
+    .func    = start,
+    .data    = arg,
+    .mutex   = PTHREAD_MUTEX_INITIALIZER,
+    .cond    = PTHREAD_COND_INITIALIZER,
+    .started = false,
+  };
+
+  pthread_mutex_lock(&gate.mutex);
+
+  if( pthread_create(&tid, 0, thread_gate_start_cb, &gate) != 0 ) {
     mce_log(LL_ERR, "could not start worker thread");
 
     /* content of tid is undefined on failure, force to zero */
@@ -177,18 +427,15 @@ hybris_thread_start(void (*start)(void *), void* arg)
     /* wait until thread has had time to start and set
      * up the cancellation parameters */
     mce_log(LL_DEBUG, "waiting worker to start ...");
-    pthread_cond_wait(&hybris_thread_gate_cond, &hybris_thread_gate_mutex);
+    while( !gate.started )
+      pthread_cond_wait(&gate.cond, &gate.mutex);
     mce_log(LL_DEBUG, "worker started");
-
-    /* the thread owns the gate now */
-    gate = 0;
   }
 
-  pthread_mutex_unlock(&hybris_thread_gate_mutex);
-
-EXIT:
+  pthread_mutex_unlock(&gate.mutex);
 
-  thread_gate_delete(gate);
+  pthread_cond_destroy(&gate.cond);
+  pthread_mutex_destroy(&gate.mutex);
 
   return tid;
 }
@@ -215,3 +462,242 @@ hybris_thread_stop(pthread_t tid)
     }
   }
 }
+
+/** Execute function in a pool worker thread
+ *
+ * The returned task must be either waited for with hybris_task_wait()
+ * or released with hybris_task_detach().
+ *
+ * @param name  task name, for diagnostic purposes
+ * @param func  function to call from worker thread
+ * @param data  data to pass to the function
+ *
+ * @return task object, or NULL on failure
+ */
+hybris_task_t *
+hybris_task_start(const char *name, void (*func)(void *), void *data)
+{
+  hybris_task_t *task = calloc(1, sizeof *task);
+
+  if( !task )
+    goto EXIT;
+
+  snprintf(task->name, sizeof task->name, "%s", name ?: "hybris-task");
+  task->func = func;
+  task->data = data;
+  pthread_cond_init(&task->cond, 0);
+
+  pthread_mutex_lock(&hybris_thread_pool_mutex);
+  bool grow = !hybris_thread_pool_quitting && thread_pool_reserve_locked();
+  pthread_mutex_unlock(&hybris_thread_pool_mutex);
+
+  if( grow )
+    thread_pool_grow();
+
+  pthread_mutex_lock(&hybris_thread_pool_mutex);
+
+  /* Without workers the task would never get executed */
+  if( hybris_thread_pool_quitting ||
+      (hybris_thread_pool_count + hybris_thread_pool_starting) == 0 ) {
+    pthread_mutex_unlock(&hybris_thread_pool_mutex);
+    mce_log(LL_ERR, "%s: no worker thread available", task->name);
+    pthread_cond_destroy(&task->cond);
+    free(task), task = 0;
+    goto EXIT;
+  }
+
+  *hybris_thread_pool_tail = task;
+  hybris_thread_pool_tail  = &task->next;
+  pthread_cond_signal(&hybris_thread_pool_cond);
+
+  pthread_mutex_unlock(&hybris_thread_pool_mutex);
+
+EXIT:
+  return task;
+}
+
+/** Check whether task has been finished
+ *
+ * @param task  task object from hybris_task_start()
+ *
+ * @return true if task function has returned, false otherwise
+ */
+bool
+hybris_task_is_done(hybris_task_t *task)
+{
+  bool done = true;
+
+  if( task ) {
+    pthread_mutex_lock(&hybris_thread_pool_mutex);
+    done = task->done;
+    pthread_mutex_unlock(&hybris_thread_pool_mutex);
+  }
+
+  return done;
+}
+
+/** Wait for task to finish and release it
+ *
+ * @param task  task object from hybris_task_start(), or NULL
+ */
+void
+hybris_task_wait(hybris_task_t *task)
+{
+  if( !task )
+    goto EXIT;
+
+  pthread_mutex_lock(&hybris_thread_pool_mutex);
+  while( !task->done )
+    pthread_cond_wait(&task->cond, &hybris_thread_pool_mutex);
+  pthread_mutex_unlock(&hybris_thread_pool_mutex);
+
+  pthread_cond_destroy(&task->cond);
+  free(task);
+
+EXIT:
+  return;
+}
+
+/** Wait for task to finish, but only for a limited time
+ *
+ * The task is released in either case: If it finishes in time, it is
+ * released like in hybris_task_wait(), otherwise it is detached.
+ *
+ * @param task  task object from hybris_task_start(), or NULL
+ * @param ms    maximum time to wait [ms]
+ *
+ * @return true if task finished, false on timeout
+ */
+bool
+hybris_task_wait_timeout(hybris_task_t *task, int ms)
+{
+  bool            done = true;
+  struct timespec deadline;
+  char            name[sizeof task->name];
+
+  if( !task )
+    goto EXIT;
+
+  thread_pool_deadline(&deadline, ms);
+
+  pthread_mutex_lock(&hybris_thread_pool_mutex);
+  while( !task->done ) {
+    if( pthread_cond_timedwait(&task->cond, &hybris_thread_pool_mutex,
+                               &deadline) == ETIMEDOUT )
+      break;
+  }
+  if( !(done = task->done) ) {
+    /* Worker frees the task after returning - take note of the name */
+    snprintf(name, sizeof name, "%s", task->name);
+    task->detached = true;
+  }
+  pthread_mutex_unlock(&hybris_thread_pool_mutex);
+
+  if( done ) {
+    pthread_cond_destroy(&task->cond);
+    free(task);
+  }
+  else {
+    mce_log(LL_WARN, "%s: task did not finish in %d ms; detached",
+            name, ms);
+  }
+
+EXIT:
+  return done;
+}
+
+/** Release task without waiting for it to finish
+ *
+ * @param task  task object from hybris_task_start(), or NULL
+ */
+void
+hybris_task_detach(hybris_task_t *task)
+{
+  bool done = false;
+
+  if( !task )
+    goto EXIT;
+
+  pthread_mutex_lock(&hybris_thread_pool_mutex);
+  if( !(done = task->done) )
+    task->detached = true;
+  pthread_mutex_unlock(&hybris_thread_pool_mutex);
+
+  if( done ) {
+    pthread_cond_destroy(&task->cond);
+    free(task);
+  }
+
+EXIT:
+  return;
+}
+
+/** Finish queued tasks and stop pool worker threads
+ *
+ * Waits at most HYBRIS_THREAD_POOL_QUIT_TIMEOUT ms for the workers to
+ * exit. Workers that are still busy after that are detached and left
+ * to exit on their own once their current task returns.
+ */
+void
+hybris_thread_pool_quit(void)
+{
+  thread_pool_worker_t *exited[HYBRIS_THREAD_POOL_MAX];
+  int                   joined    = 0;
+  int                   abandoned = 0;
+  struct timespec       deadline;
+
+  thread_pool_deadline(&deadline, HYBRIS_THREAD_POOL_QUIT_TIMEOUT);
+
+  pthread_mutex_lock(&hybris_thread_pool_mutex);
+
+  hybris_thread_pool_quitting = true;
+  pthread_cond_broadcast(&hybris_thread_pool_cond);
+
+  for( ;; ) {
+    bool pending = false;
+
+    for( int i = 0; i < hybris_thread_pool_count; ++i ) {
+      if( !hybris_thread_pool_worker[i]->exited )
+        pending = true;
+    }
+
+    if( !pending )
+      break;
+
+    if( pthread_cond_timedwait(&hybris_thread_pool_cond,
+                               &hybris_thread_pool_mutex,
+                               &deadline) == ETIMEDOUT )
+      break;
+  }
+
+  for( int i = 0; i < hybris_thread_pool_count; ++i ) {
+    thread_pool_worker_t *worker = hybris_thread_pool_worker[i];
+
+    hybris_thread_pool_worker[i] = 0;
+
+    if( worker->exited ) {
+      exited[joined++] = worker;
+    }
+    else {
+      worker->abandoned = true;
+      pthread_detach(worker->tid);
+      ++abandoned;
+    }
+  }
+
+  hybris_thread_pool_count    = 0;
+  hybris_thread_pool_quitting = false;
+
+  pthread_mutex_unlock(&hybris_thread_pool_mutex);
+
+  for( int i = 0; i < joined; ++i ) {
+    pthread_join(exited[i]->tid, 0);
+    free(exited[i]);
+  }
+
+  if( abandoned > 0 )
+    mce_log(LL_WARN, "left behind %d busy pool workers", abandoned);
+
+  if( joined > 0 )
+    mce_log(LL_DEBUG, "stopped %d pool workers", joined);
+}
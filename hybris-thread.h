@@ -25,8 +25,19 @@
 # define HYBRIS_THREAD_H_
 
 # include <pthread.h>
+# include <stdbool.h>
 
-pthread_t hybris_thread_start (void (*start)(void *), void* arg);
-void      hybris_thread_stop  (pthread_t tid);
+/** Task executed in a pool worker thread */
+typedef struct hybris_task_t hybris_task_t;
+
+pthread_t      hybris_thread_start     (void (*start)(void *), void* arg);
+void           hybris_thread_stop      (pthread_t tid);
+
+hybris_task_t *hybris_task_start       (const char *name, void (*func)(void *), void *data);
+bool           hybris_task_is_done     (hybris_task_t *task);
+void           hybris_task_wait        (hybris_task_t *task);
+bool           hybris_task_wait_timeout(hybris_task_t *task, int ms);
+void           hybris_task_detach      (hybris_task_t *task);
+void           hybris_thread_pool_quit (void);
 
 #endif /* HYBRIS_THREAD_H_ */
@@ -50,6 +50,9 @@
 #include "hybris-fb.h"
 #include "hybris-lights.h"
 #include "hybris-sensors.h"
+#include "plugin-backlight.h"
+#include "plugin-preload.h"
+#include "hybris-thread.h"
 
 #include "sysfs-led-main.h"
 
@@ -64,6 +67,17 @@
 bool mce_hybris_framebuffer_init          (void);
 void mce_hybris_framebuffer_quit          (void);
 bool mce_hybris_framebuffer_set_power     (bool state);
+bool mce_hybris_framebuffer_set_power_mode(mce_hybris_fb_power_mode_t mode);
+unsigned mce_hybris_framebuffer_get_power_modes(void);
+bool mce_hybris_framebuffer_set_power_async(bool state);
+int  mce_hybris_framebuffer_get_display_count(void);
+bool mce_hybris_framebuffer_set_display_power(int display, bool on);
+bool mce_hybris_framebuffer_set_display_power_async(int display, bool on);
+bool mce_hybris_framebuffer_set_display_power_mode(int display, mce_hybris_fb_power_mode_t mode);
+bool mce_hybris_framebuffer_set_display_power_mode_async(int display, mce_hybris_fb_power_mode_t mode);
+void mce_hybris_framebuffer_set_power_hook(mce_hybris_fb_power_fn cb);
+mce_hybris_fb_method_t mce_hybris_framebuffer_get_power_method(void);
+bool mce_hybris_framebuffer_get_power_stats(mce_hybris_fb_method_t method, mce_hybris_fb_power_stats_t *stats);
 
 /* ------------------------------------------------------------------------- *
  * DISPLAY_BACKLIGHT_BRIGHTNESS
@@ -72,6 +86,12 @@ bool mce_hybris_framebuffer_set_power     (bool state);
 bool mce_hybris_backlight_init            (void);
 void mce_hybris_backlight_quit            (void);
 bool mce_hybris_backlight_set_brightness  (int level);
+bool mce_hybris_backlight_fade            (int level, int duration_ms, mce_hybris_backlight_fade_t curve);
+void mce_hybris_backlight_fade_stop       (void);
+int  mce_hybris_backlight_get_brightness  (void);
+int  mce_hybris_backlight_get_max_level   (void);
+bool mce_hybris_backlight_set_level       (int level);
+bool mce_hybris_backlight_get_stats       (mce_hybris_light_stats_t *stats);
 
 /* ------------------------------------------------------------------------- *
  * KEYPAD_BACKLIGHT_BRIGHTNESS
@@ -80,6 +100,7 @@ bool mce_hybris_backlight_set_brightness  (int level);
 bool mce_hybris_keypad_init               (void);
 void mce_hybris_keypad_quit               (void);
 bool mce_hybris_keypad_set_brightness     (int level);
+bool mce_hybris_keypad_get_stats          (mce_hybris_light_stats_t *stats);
 
 /* ------------------------------------------------------------------------- *
  * INDICATOR_LED_PATTERN
@@ -100,6 +121,7 @@ bool mce_hybris_ps_init                   (void);
 void mce_hybris_ps_quit                   (void);
 bool mce_hybris_ps_set_active             (bool state);
 void mce_hybris_ps_set_hook               (mce_hybris_ps_fn cb);
+bool mce_hybris_ps_set_wakeup             (bool wakeup);
 
 /* ------------------------------------------------------------------------- *
  * AMBIENT_LIGHT_SENSOR
@@ -110,11 +132,24 @@ void mce_hybris_als_quit                  (void);
 bool mce_hybris_als_set_active            (bool state);
 void mce_hybris_als_set_hook              (mce_hybris_als_fn cb);
 
+/* ------------------------------------------------------------------------- *
+ * GENERIC_SENSORS
+ * ------------------------------------------------------------------------- */
+
+bool mce_hybris_sensor_init               (int type);
+void mce_hybris_sensor_quit               (void);
+bool mce_hybris_sensor_set_active         (int type, bool state);
+void mce_hybris_sensor_set_hook           (mce_hybris_sensor_fn cb);
+bool mce_hybris_sensors_get_stats         (mce_hybris_sensor_stats_t *stats);
+
 /* ------------------------------------------------------------------------- *
  * GENERIC
  * ------------------------------------------------------------------------- */
 
 void mce_hybris_quit                      (void);
+const mce_hybris_caps_t *mce_hybris_get_capabilities(void);
+bool mce_hybris_preload_get_timeline      (mce_hybris_preload_timeline_t *timeline);
+const mce_hybris_api_t *mce_hybris_get_api(void);
 
 #ifdef ENABLE_HYBRIS_SUPPORT
 
@@ -129,6 +164,7 @@ void mce_hybris_quit                      (void);
 bool
 mce_hybris_framebuffer_init(void)
 {
+  plugin_preload_wait();
   return hybris_device_fb_init();
 }
 
@@ -152,18 +188,170 @@ mce_hybris_framebuffer_set_power(bool state)
   return hybris_device_fb_set_power(state);
 }
 
+/** Set primary display power mode via libhybris
+ *
+ * If the requested low power mode is not supported, the closest
+ * mode that keeps display content visible is used instead, i.e.
+ * doze-suspend falls back to doze, and doze falls back to on.
+ *
+ * @param mode power mode
+ *
+ * @return true on success, false on failure
+ */
+bool
+mce_hybris_framebuffer_set_power_mode(mce_hybris_fb_power_mode_t mode)
+{
+  return hybris_device_fb_set_power_mode(0, mode);
+}
+
+/** Get display power modes supported by the device
+ *
+ * Allows mce to choose the cheapest mode that the panel supports.
+ *
+ * @return mask of MCE_HYBRIS_FB_POWER_MODE_BIT() values, or 0 if display
+ *         power can't be controlled at all
+ */
+unsigned
+mce_hybris_framebuffer_get_power_modes(void)
+{
+  return hybris_device_fb_get_power_modes();
+}
+
+/** Request frame buffer power state change without blocking the caller
+ *
+ * Rapid toggles are coalesced so that only the latest request
+ * is executed if the worker thread is busy.
+ *
+ * @param state true to power on, false to power off
+ *
+ * @return true if request was queued, false on failure
+ */
+bool
+mce_hybris_framebuffer_set_power_async(bool state)
+{
+  return hybris_device_fb_set_power_async(state);
+}
+
+/** Get number of displays that can be power controlled
+ *
+ * @return number of displays, or 0 if display power can't be controlled
+ */
+int
+mce_hybris_framebuffer_get_display_count(void)
+{
+  return hybris_device_fb_get_display_count();
+}
+
+/** Set display power state via libhybris
+ *
+ * @param display display index, 0 = primary display
+ * @param on      true to power on, false to power off
+ *
+ * @return true on success, false on failure
+ */
+bool
+mce_hybris_framebuffer_set_display_power(int display, bool on)
+{
+  return hybris_device_fb_set_power_mode(display, on ?
+                                         MCE_HYBRIS_FB_POWER_ON :
+                                         MCE_HYBRIS_FB_POWER_OFF);
+}
+
+/** Request display power state change without blocking the caller
+ *
+ * @param display display index, 0 = primary display
+ * @param on      true to power on, false to power off
+ *
+ * @return true if request was queued, false on failure
+ */
+bool
+mce_hybris_framebuffer_set_display_power_async(int display, bool on)
+{
+  return hybris_device_fb_set_power_mode_async(display, on ?
+                                               MCE_HYBRIS_FB_POWER_ON :
+                                               MCE_HYBRIS_FB_POWER_OFF);
+}
+
+/** Set display power mode via libhybris
+ *
+ * Doze modes are available only with hw composer 1.4 and later.
+ *
+ * @param display display index, 0 = primary display
+ * @param mode    power mode
+ *
+ * @return true on success, false on failure
+ */
+bool
+mce_hybris_framebuffer_set_display_power_mode(int display,
+                                              mce_hybris_fb_power_mode_t mode)
+{
+  return hybris_device_fb_set_power_mode(display, mode);
+}
+
+/** Request display power mode change without blocking the caller
+ *
+ * @param display display index, 0 = primary display
+ * @param mode    power mode
+ *
+ * @return true if request was queued, false on failure
+ */
+bool
+mce_hybris_framebuffer_set_display_power_mode_async(int display,
+                                                    mce_hybris_fb_power_mode_t mode)
+{
+  return hybris_device_fb_set_power_mode_async(display, mode);
+}
+
+/** Set callback function for async frame buffer power completion
+ *
+ * Note: the callback function will be called from worker thread.
+ */
+void
+mce_hybris_framebuffer_set_power_hook(mce_hybris_fb_power_fn cb)
+{
+  hybris_device_fb_set_power_hook(cb);
+}
+
+/** Get display power control method in use
+ *
+ * @return method id, or MCE_HYBRIS_FB_METHOD_NONE
+ */
+mce_hybris_fb_method_t
+mce_hybris_framebuffer_get_power_method(void)
+{
+  return hybris_device_fb_get_power_method();
+}
+
+/** Get display power transition statistics
+ *
+ * @param method  power control method to query
+ * @param stats   where to store a snapshot of the statistics
+ *
+ * @return true on success, false if method is not valid
+ */
+bool
+mce_hybris_framebuffer_get_power_stats(mce_hybris_fb_method_t method,
+                                       mce_hybris_fb_power_stats_t *stats)
+{
+  return hybris_device_fb_get_power_stats(method, stats);
+}
+
 /* ========================================================================= *
  * DISPLAY_BACKLIGHT_BRIGHTNESS
  * ========================================================================= */
 
-/** Initialize libhybris display backlight device object
+/** Initialize display backlight control
+ *
+ * Uses sysfs backlight class device if available, libhybris
+ * display backlight device object otherwise.
  *
  * @return true on success, false on failure
  */
 bool
 mce_hybris_backlight_init(void)
 {
-  return hybris_device_backlight_init();
+  plugin_preload_wait();
+  return plugin_backlight_init();
 }
 
 /** Release libhybris display backlight device object
@@ -171,10 +359,11 @@ mce_hybris_backlight_init(void)
 void
 mce_hybris_backlight_quit(void)
 {
+  plugin_backlight_quit();
   hybris_device_backlight_quit();
 }
 
-/** Set display backlight brightness via libhybris
+/** Set display backlight brightness
  *
  * @param level 0=off ... 255=maximum brightness
  *
@@ -183,7 +372,80 @@ mce_hybris_backlight_quit(void)
 bool
 mce_hybris_backlight_set_brightness(int level)
 {
-  return hybris_device_backlight_set_brightness(level);
+  return plugin_backlight_set_brightness(level);
+}
+
+/** Fade display backlight brightness to given level
+ *
+ * The fade is executed from a timer within the plugin; mce does not
+ * need to do anything else than start it. Setting brightness with
+ * mce_hybris_backlight_set_brightness() cancels the fade.
+ *
+ * @param level       0=off ... 255=maximum brightness
+ * @param duration_ms fade duration in milliseconds
+ * @param curve       fade intensity curve
+ *
+ * @return true if fade was started, false on failure
+ */
+bool
+mce_hybris_backlight_fade(int level, int duration_ms,
+                          mce_hybris_backlight_fade_t curve)
+{
+  return plugin_backlight_fade(level, duration_ms, curve);
+}
+
+/** Stop display backlight fade, keeping the level reached so far
+ */
+void
+mce_hybris_backlight_fade_stop(void)
+{
+  plugin_backlight_fade_stop();
+}
+
+/** Get current display backlight brightness
+ *
+ * @return 0=off ... 255=maximum brightness, or -1 if not known
+ */
+int
+mce_hybris_backlight_get_brightness(void)
+{
+  return plugin_backlight_get_brightness();
+}
+
+/** Get maximum native display backlight level
+ *
+ * Depending on backlight driver, this can be more than 255.
+ *
+ * @return maximum level, or 0 if backlight can't be controlled
+ */
+int
+mce_hybris_backlight_get_max_level(void)
+{
+  return plugin_backlight_get_max_level();
+}
+
+/** Set display backlight brightness using native resolution
+ *
+ * @param level 0=off ... mce_hybris_backlight_get_max_level()
+ *
+ * @return true on success, false on failure
+ */
+bool
+mce_hybris_backlight_set_level(int level)
+{
+  return plugin_backlight_set_level(level);
+}
+
+/** Get display backlight HAL write statistics
+ *
+ * @param stats  where to store statistics
+ *
+ * @return true on success, false on failure
+ */
+bool
+mce_hybris_backlight_get_stats(mce_hybris_light_stats_t *stats)
+{
+  return hybris_device_backlight_get_stats(stats);
 }
 
 /* ========================================================================= *
@@ -197,6 +459,7 @@ mce_hybris_backlight_set_brightness(int level)
 bool
 mce_hybris_keypad_init(void)
 {
+  plugin_preload_wait();
   return hybris_device_keypad_init();
 }
 
@@ -220,6 +483,18 @@ mce_hybris_keypad_set_brightness(int level)
   return hybris_device_keypad_set_brightness(level);
 }
 
+/** Get keypad backlight HAL write statistics
+ *
+ * @param stats  where to store statistics
+ *
+ * @return true on success, false on failure
+ */
+bool
+mce_hybris_keypad_get_stats(mce_hybris_light_stats_t *stats)
+{
+  return hybris_device_keypad_get_stats(stats);
+}
+
 #endif //ENABLE_HYBRIS_SUPPORT
 
 /* ========================================================================= *
@@ -243,6 +518,12 @@ clamp_to_range(int lo, int hi, int val)
 /** Flag for: controls for RGB leds exist in sysfs */
 static bool mce_hybris_indicator_uses_sysfs = false;
 
+/** Flag for: mce_hybris_indicator_init() has been called */
+static bool mce_hybris_indicator_initialized = false;
+
+/** Flag for: indicator led can be controlled */
+static bool mce_hybris_indicator_available = false;
+
 /** Initialize libhybris indicator led device object
  *
  * @return true on success, false on failure
@@ -250,14 +531,13 @@ static bool mce_hybris_indicator_uses_sysfs = false;
 bool
 mce_hybris_indicator_init(void)
 {
-  static bool done = false;
-  static bool ack  = false;
-
-  if( done ) {
+  if( mce_hybris_indicator_initialized ) {
     goto cleanup;
   }
 
-  done = true;
+  mce_hybris_indicator_initialized = true;
+
+  plugin_preload_wait();
 
   if( sysfs_led_init() ) {
     mce_hybris_indicator_uses_sysfs = true;
@@ -272,13 +552,14 @@ mce_hybris_indicator_init(void)
   }
 #endif
 
-  ack = true;
+  mce_hybris_indicator_available = true;
 
 cleanup:
 
-  mce_log(LL_DEBUG, "res = %s", ack ? "true" : "false");
+  mce_log(LL_DEBUG, "res = %s",
+          mce_hybris_indicator_available ? "true" : "false");
 
-  return ack;
+  return mce_hybris_indicator_available;
 }
 
 /** Release libhybris indicator led device object
@@ -435,6 +716,7 @@ mce_hybris_indicator_set_brightness(int level)
 bool
 mce_hybris_ps_init(void)
 {
+  plugin_preload_wait();
   return hybris_sensor_ps_init();
 }
 
@@ -468,6 +750,19 @@ mce_hybris_ps_set_hook(mce_hybris_ps_fn cb)
   hybris_sensor_ps_set_hook(cb);
 }
 
+/** Choose between wake-up and non-wake-up proximity sensor
+ *
+ * @param wakeup true to prefer wake-up sensor, e.g. during calls
+ *
+ * @return true if sensor with requested wake-up capability is in use,
+ *         false otherwise
+ */
+bool
+mce_hybris_ps_set_wakeup(bool wakeup)
+{
+  return hybris_sensor_ps_set_wakeup(wakeup);
+}
+
 /* ========================================================================= *
  * AMBIENT_LIGHT_SENSOR
  * ========================================================================= */
@@ -479,6 +774,7 @@ mce_hybris_ps_set_hook(mce_hybris_ps_fn cb)
 bool
 mce_hybris_als_init(void)
 {
+  plugin_preload_wait();
   return hybris_device_als_init();
 }
 
@@ -511,6 +807,67 @@ mce_hybris_als_set_hook(mce_hybris_als_fn cb)
 {
   hybris_device_als_set_hook(cb);
 }
+
+/* ========================================================================= *
+ * GENERIC_SENSORS
+ * ========================================================================= */
+
+/** Start using sensor of given type via libhybris
+ *
+ * Events from all generic sensors are handled by the same worker
+ * thread as proximity and ambient light sensor events.
+ *
+ * @param type MCE_HYBRIS_SENSOR_ACCELEROMETER etc
+ *
+ * @return true on success, false on failure
+ */
+bool
+mce_hybris_sensor_init(int type)
+{
+  plugin_preload_wait();
+  return hybris_device_sensor_init(type);
+}
+
+/** Stop using generic sensors via libhybris
+ */
+void
+mce_hybris_sensor_quit(void)
+{
+  hybris_device_sensor_quit();
+}
+
+/** Set sensor input enabled state
+ *
+ * @param type  MCE_HYBRIS_SENSOR_ACCELEROMETER etc
+ * @param state true to enable input, or false to disable input
+ */
+bool
+mce_hybris_sensor_set_active(int type, bool state)
+{
+  return hybris_device_sensor_set_active(type, state);
+}
+
+/** Set callback function for handling generic sensor events
+ *
+ * Note: the callback function will be called from worker thread.
+ */
+void
+mce_hybris_sensor_set_hook(mce_hybris_sensor_fn cb)
+{
+  hybris_device_sensor_set_hook(cb);
+}
+
+/** Get sensor poll device statistics
+ *
+ * @param stats  where to store statistics
+ *
+ * @return true on success, false on failure
+ */
+bool
+mce_hybris_sensors_get_stats(mce_hybris_sensor_stats_t *stats)
+{
+  return hybris_device_sensors_get_stats(stats);
+}
 #endif //ENABLE_HYBRIS_SUPPORT
 
 /* ========================================================================= *
@@ -522,9 +879,234 @@ mce_hybris_als_set_hook(mce_hybris_als_fn cb)
 void
 mce_hybris_quit(void)
 {
+  plugin_preload_wait();
+
 #ifdef ENABLE_HYBRIS_SUPPORT
+  plugin_backlight_quit();
   hybris_plugin_fb_unload();
   hybris_plugin_lights_unload();
   hybris_plugin_sensors_unload();
+
+  hybris_thread_pool_quit();
 #endif
 }
+
+/** Get plugin capabilities
+ *
+ * Reports what can be known without opening or probing devices: the
+ * state of already initialized components and the sensor list of the
+ * sensors module, if it has been loaded already - e.g. by background
+ * preloading. Capabilities that depend on components that have not
+ * been initialized yet are flagged in the unknown mask - ask again
+ * after calling the respective init functions.
+ *
+ * @return pointer to capabilities, valid until the next call
+ */
+const mce_hybris_caps_t *
+mce_hybris_get_capabilities(void)
+{
+  static mce_hybris_caps_t caps;
+
+  /* Start from scratch - component states may have changed */
+  caps = (mce_hybris_caps_t){ .size = sizeof caps };
+
+  plugin_preload_wait();
+
+#ifdef ENABLE_HYBRIS_SUPPORT
+  /* Display power */
+  if( !hybris_device_fb_is_initialized() ) {
+    caps.unknown |= (MCE_HYBRIS_CAP_DISPLAY_POWER |
+                     MCE_HYBRIS_CAP_DISPLAY_DOZE);
+  }
+  else {
+    if( (caps.display_count = hybris_device_fb_get_display_count()) > 0 ) {
+      caps.flags |= MCE_HYBRIS_CAP_DISPLAY_POWER;
+    }
+
+    caps.display_power_modes  = hybris_device_fb_get_power_modes();
+    caps.display_power_method = hybris_device_fb_get_power_method();
+
+    if( caps.display_power_modes &
+        (MCE_HYBRIS_FB_POWER_MODE_BIT(MCE_HYBRIS_FB_POWER_DOZE) |
+         MCE_HYBRIS_FB_POWER_MODE_BIT(MCE_HYBRIS_FB_POWER_DOZE_SUSPEND)) ) {
+      caps.flags |= MCE_HYBRIS_CAP_DISPLAY_DOZE;
+    }
+  }
+
+  /* Backlights */
+  if( !plugin_backlight_is_initialized() ) {
+    caps.unknown |= MCE_HYBRIS_CAP_BACKLIGHT;
+  }
+  else if( (caps.backlight_max_level = plugin_backlight_get_max_level()) > 0 ) {
+    caps.flags |= MCE_HYBRIS_CAP_BACKLIGHT;
+  }
+
+  if( !hybris_device_keypad_is_initialized() ) {
+    caps.unknown |= MCE_HYBRIS_CAP_KEYPAD;
+  }
+  else if( hybris_device_keypad_init() ) {
+    caps.flags |= MCE_HYBRIS_CAP_KEYPAD;
+  }
+#endif
+
+  /* Indicator led */
+  if( !mce_hybris_indicator_initialized ) {
+    caps.unknown |= (MCE_HYBRIS_CAP_INDICATOR |
+                     MCE_HYBRIS_CAP_INDICATOR_SYSFS |
+                     MCE_HYBRIS_CAP_INDICATOR_BREATHE |
+                     MCE_HYBRIS_CAP_INDICATOR_HW_BLINK);
+  }
+  else if( mce_hybris_indicator_uses_sysfs ) {
+    caps.flags |= (MCE_HYBRIS_CAP_INDICATOR |
+                   MCE_HYBRIS_CAP_INDICATOR_SYSFS);
+    caps.indicator_backend     = sysfs_led_get_backend();
+    caps.indicator_breath_type = sysfs_led_get_breath_type();
+
+    if( caps.indicator_breath_type != LED_RAMP_DISABLED ) {
+      caps.flags |= MCE_HYBRIS_CAP_INDICATOR_BREATHE;
+    }
+
+    if( sysfs_led_can_blink() ) {
+      caps.flags |= MCE_HYBRIS_CAP_INDICATOR_HW_BLINK;
+    }
+  }
+  else if( mce_hybris_indicator_available ) {
+    /* Lights HAL handles blinking on its own */
+    caps.flags |= (MCE_HYBRIS_CAP_INDICATOR |
+                   MCE_HYBRIS_CAP_INDICATOR_HW_BLINK);
+    caps.indicator_backend = "hal";
+  }
+
+#ifdef ENABLE_HYBRIS_SUPPORT
+  /* Sensors: module sensor list only, poll device is not opened */
+  bool ps_wakeup = false;
+
+  if( !hybris_plugin_sensors_get_caps(&caps.sensor_types,
+                                      caps.sensor_min_delay, &ps_wakeup) ) {
+    caps.unknown |= (MCE_HYBRIS_CAP_PROXIMITY |
+                     MCE_HYBRIS_CAP_PROXIMITY_WAKEUP |
+                     MCE_HYBRIS_CAP_LIGHT_SENSOR);
+  }
+
+  if( caps.sensor_types & MCE_HYBRIS_SENSOR_TYPE_BIT(MCE_HYBRIS_SENSOR_PROXIMITY) ) {
+    caps.flags |= MCE_HYBRIS_CAP_PROXIMITY;
+    if( ps_wakeup ) {
+      caps.flags |= MCE_HYBRIS_CAP_PROXIMITY_WAKEUP;
+    }
+  }
+
+  if( caps.sensor_types & MCE_HYBRIS_SENSOR_TYPE_BIT(MCE_HYBRIS_SENSOR_LIGHT) ) {
+    caps.flags |= MCE_HYBRIS_CAP_LIGHT_SENSOR;
+  }
+#endif
+
+  mce_log(LL_DEBUG, "flags=0x%x unknown=0x%x displays=%d modes=0x%x"
+          " backlight=%d indicator=%s sensors=0x%x", caps.flags,
+          caps.unknown, caps.display_count, caps.display_power_modes,
+          caps.backlight_max_level, caps.indicator_backend ?: "none",
+          (unsigned)caps.sensor_types);
+
+  return &caps;
+}
+
+/** Get background preload timeline
+ *
+ * Waits for preloading to finish, if it is still in progress.
+ *
+ * @param timeline where to store the timeline
+ *
+ * @return true if preloading was enabled, false otherwise
+ */
+bool
+mce_hybris_preload_get_timeline(mce_hybris_preload_timeline_t *timeline)
+{
+  return plugin_preload_get_timeline(timeline);
+}
+
+/* ========================================================================= *
+ * FUNCTION_TABLE
+ * ========================================================================= */
+
+/** Plugin function table */
+static const mce_hybris_api_t mce_hybris_api =
+{
+  .size                                     = sizeof (mce_hybris_api_t),
+  .version                                  = MCE_HYBRIS_API_VERSION,
+
+  .set_log_hook                             = mce_hybris_set_log_hook,
+  .quit                                     = mce_hybris_quit,
+  .get_capabilities                         = mce_hybris_get_capabilities,
+  .preload_get_timeline                     = mce_hybris_preload_get_timeline,
+
+#ifdef ENABLE_HYBRIS_SUPPORT
+  .framebuffer_init                         = mce_hybris_framebuffer_init,
+  .framebuffer_quit                         = mce_hybris_framebuffer_quit,
+  .framebuffer_set_power                    = mce_hybris_framebuffer_set_power,
+  .framebuffer_set_power_mode               = mce_hybris_framebuffer_set_power_mode,
+  .framebuffer_get_power_modes              = mce_hybris_framebuffer_get_power_modes,
+  .framebuffer_set_power_async              = mce_hybris_framebuffer_set_power_async,
+  .framebuffer_get_display_count            = mce_hybris_framebuffer_get_display_count,
+  .framebuffer_set_display_power            = mce_hybris_framebuffer_set_display_power,
+  .framebuffer_set_display_power_async      = mce_hybris_framebuffer_set_display_power_async,
+  .framebuffer_set_display_power_mode       = mce_hybris_framebuffer_set_display_power_mode,
+  .framebuffer_set_display_power_mode_async = mce_hybris_framebuffer_set_display_power_mode_async,
+  .framebuffer_set_power_hook               = mce_hybris_framebuffer_set_power_hook,
+  .framebuffer_get_power_method             = mce_hybris_framebuffer_get_power_method,
+  .framebuffer_get_power_stats              = mce_hybris_framebuffer_get_power_stats,
+
+  .backlight_init                           = mce_hybris_backlight_init,
+  .backlight_quit                           = mce_hybris_backlight_quit,
+  .backlight_set_brightness                 = mce_hybris_backlight_set_brightness,
+  .backlight_fade                           = mce_hybris_backlight_fade,
+  .backlight_fade_stop                      = mce_hybris_backlight_fade_stop,
+  .backlight_get_brightness                 = mce_hybris_backlight_get_brightness,
+  .backlight_get_max_level                  = mce_hybris_backlight_get_max_level,
+  .backlight_set_level                      = mce_hybris_backlight_set_level,
+  .backlight_get_stats                      = mce_hybris_backlight_get_stats,
+
+  .keypad_init                              = mce_hybris_keypad_init,
+  .keypad_quit                              = mce_hybris_keypad_quit,
+  .keypad_set_brightness                    = mce_hybris_keypad_set_brightness,
+  .keypad_get_stats                         = mce_hybris_keypad_get_stats,
+#endif
+
+  .indicator_init                           = mce_hybris_indicator_init,
+  .indicator_quit                           = mce_hybris_indicator_quit,
+  .indicator_set_pattern                    = mce_hybris_indicator_set_pattern,
+  .indicator_can_breathe                    = mce_hybris_indicator_can_breathe,
+  .indicator_enable_breathing               = mce_hybris_indicator_enable_breathing,
+  .indicator_set_brightness                 = mce_hybris_indicator_set_brightness,
+
+#ifdef ENABLE_HYBRIS_SUPPORT
+  .ps_init                                  = mce_hybris_ps_init,
+  .ps_quit                                  = mce_hybris_ps_quit,
+  .ps_set_active                            = mce_hybris_ps_set_active,
+  .ps_set_hook                              = mce_hybris_ps_set_hook,
+  .ps_set_wakeup                            = mce_hybris_ps_set_wakeup,
+
+  .als_init                                 = mce_hybris_als_init,
+  .als_quit                                 = mce_hybris_als_quit,
+  .als_set_active                           = mce_hybris_als_set_active,
+  .als_set_hook                             = mce_hybris_als_set_hook,
+
+  .sensor_init                              = mce_hybris_sensor_init,
+  .sensor_quit                              = mce_hybris_sensor_quit,
+  .sensor_set_active                        = mce_hybris_sensor_set_active,
+  .sensor_set_hook                          = mce_hybris_sensor_set_hook,
+  .sensors_get_stats                        = mce_hybris_sensors_get_stats,
+#endif
+};
+
+/** Get plugin function table
+ *
+ * Allows resolving all plugin functionality with a single symbol
+ * lookup. Callers must check table size and version before using
+ * members added after MCE_HYBRIS_API_VERSION 1.
+ *
+ * @return pointer to function table, valid until plugin is unloaded
+ */
+const mce_hybris_api_t *
+mce_hybris_get_api(void)
+{
+  return &mce_hybris_api;
+}
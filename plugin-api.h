@@ -24,6 +24,10 @@
 /* FIXME: This header is included in sourcetrees of both mce and
  *        mce-plugin-libhybris. For now it must be kept in sync
  *        manually.
+ *
+ *        To limit the damage, mce can resolve everything via single
+ *        mce_hybris_get_api() lookup - functions added to the table
+ *        later on do not break older mce / plugin combinations.
  */
 
 #ifndef  MCE_HYBRIS_H_
@@ -48,17 +52,66 @@ extern "C" {
  * frame buffer power state
  * - - - - - - - - - - - - - - - - - - - */
 
+/** Display power modes
+ *
+ * Values match HWC_POWER_MODE_xxx and hwc2 power mode values.
+ *
+ * From highest to lowest power consumption: ON, DOZE, DOZE_SUSPEND, OFF.
+ * In doze modes the panel keeps showing content with reduced refresh
+ * rate, in DOZE_SUSPEND the content is not updated at all.
+ */
+typedef enum
+{
+  MCE_HYBRIS_FB_POWER_OFF          = 0,
+  MCE_HYBRIS_FB_POWER_DOZE         = 1,
+  MCE_HYBRIS_FB_POWER_ON           = 2,
+  MCE_HYBRIS_FB_POWER_DOZE_SUSPEND = 3,
+} mce_hybris_fb_power_mode_t;
+
+/** Bit for power mode in mce_hybris_framebuffer_get_power_modes() mask */
+# define MCE_HYBRIS_FB_POWER_MODE_BIT(mode) (1u << (mode))
+
+typedef void (*mce_hybris_fb_power_fn)(int display, int mode, bool success);
+
 bool mce_hybris_framebuffer_init(void);
 void mce_hybris_framebuffer_quit(void);
 bool mce_hybris_framebuffer_set_power(bool on);
+bool mce_hybris_framebuffer_set_power_mode(mce_hybris_fb_power_mode_t mode);
+unsigned mce_hybris_framebuffer_get_power_modes(void);
+bool mce_hybris_framebuffer_set_power_async(bool on);
+bool mce_hybris_framebuffer_set_power_callback(mce_hybris_fb_power_fn cb);
+int  mce_hybris_framebuffer_get_display_count(void);
+bool mce_hybris_framebuffer_set_display_power(int display, bool on);
+bool mce_hybris_framebuffer_set_display_power_async(int display, bool on);
 
 /* - - - - - - - - - - - - - - - - - - - *
  * display backlight brightness
  * - - - - - - - - - - - - - - - - - - - */
 
+/** Backlight fade intensity curves */
+typedef enum
+{
+  /** Constant rate of change */
+  MCE_HYBRIS_BACKLIGHT_FADE_LINEAR     = 0,
+
+  /** Slow start and end, fastest change mid-fade */
+  MCE_HYBRIS_BACKLIGHT_FADE_SINE       = 1,
+
+  /** Slow start, fast end */
+  MCE_HYBRIS_BACKLIGHT_FADE_ACCELERATE = 2,
+
+  /** Fast start, slow end */
+  MCE_HYBRIS_BACKLIGHT_FADE_DECELERATE = 3,
+} mce_hybris_backlight_fade_t;
+
 bool mce_hybris_backlight_init(void);
 void mce_hybris_backlight_quit(void);
 bool mce_hybris_backlight_set_brightness(int level);
+bool mce_hybris_backlight_fade(int level, int duration_ms, mce_hybris_backlight_fade_t curve);
+void mce_hybris_backlight_fade_stop(void);
+int  mce_hybris_backlight_get_brightness(void);
+int  mce_hybris_backlight_get_max_level(void);
+bool mce_hybris_backlight_set_level(int level);
 
 /* - - - - - - - - - - - - - - - - - - - *
  * keypad backlight brightness
@@ -83,12 +136,16 @@ bool mce_hybris_indicator_can_breathe(void);
  * proximity sensor
  * - - - - - - - - - - - - - - - - - - - */
 
+/* Note: sensor event time stamps are CLOCK_BOOTTIME nanoseconds,
+ *       regardless of what clock the sensor HAL itself uses. */
+
 typedef void (*mce_hybris_ps_fn)(int64_t timestamp, float distance);
 
 bool mce_hybris_ps_init(void);
 void mce_hybris_ps_quit(void);
 bool mce_hybris_ps_set_active(bool active);
 bool mce_hybris_ps_set_callback(mce_hybris_ps_fn cb);
+bool mce_hybris_ps_set_wakeup(bool wakeup);
 
 /* - - - - - - - - - - - - - - - - - - - *
  * ambient light sensor
@@ -101,6 +158,90 @@ void mce_hybris_als_quit(void);
 bool mce_hybris_als_set_active(bool active);
 bool mce_hybris_als_set_callback(mce_hybris_als_fn cb);
 
+/* - - - - - - - - - - - - - - - - - - - *
+ * other sensors
+ * - - - - - - - - - - - - - - - - - - - */
+
+/** Sensor types
+ *
+ * Values match android SENSOR_TYPE_xxx. Proximity and ambient light
+ * sensors are listed for use with capability masks only - they are
+ * available only via their dedicated interfaces, not via the generic
+ * sensor interface.
+ */
+typedef enum
+{
+  MCE_HYBRIS_SENSOR_ACCELEROMETER       = 1,
+  MCE_HYBRIS_SENSOR_MAGNETIC_FIELD      = 2,
+  MCE_HYBRIS_SENSOR_ORIENTATION         = 3,
+  MCE_HYBRIS_SENSOR_GYROSCOPE           = 4,
+  MCE_HYBRIS_SENSOR_LIGHT               = 5, // dedicated interface only
+  MCE_HYBRIS_SENSOR_PRESSURE            = 6,
+  MCE_HYBRIS_SENSOR_TEMPERATURE         = 7,
+  MCE_HYBRIS_SENSOR_PROXIMITY           = 8, // dedicated interface only
+  MCE_HYBRIS_SENSOR_GRAVITY             = 9,
+  MCE_HYBRIS_SENSOR_LINEAR_ACCELERATION = 10,
+  MCE_HYBRIS_SENSOR_ROTATION_VECTOR     = 11,
+  MCE_HYBRIS_SENSOR_RELATIVE_HUMIDITY   = 12,
+  MCE_HYBRIS_SENSOR_AMBIENT_TEMPERATURE = 13,
+} mce_hybris_sensor_type_t;
+
+/** Convert MCE_HYBRIS_SENSOR_xxx to mce_hybris_caps_t sensor_types bit */
+# define MCE_HYBRIS_SENSOR_TYPE_BIT(type) (1u << (type))
+
+/** Maximum number of values passed to mce_hybris_sensor_fn */
+# define MCE_HYBRIS_SENSOR_MAX_VALUES 16
+
+typedef void (*mce_hybris_sensor_fn)(int type, int64_t timestamp,
+                                     const float *values, int count);
+
+bool mce_hybris_sensor_init(int type);
+void mce_hybris_sensor_quit(void);
+bool mce_hybris_sensor_set_active(int type, bool active);
+bool mce_hybris_sensor_set_callback(mce_hybris_sensor_fn cb);
+
+/* - - - - - - - - - - - - - - - - - - - *
+ * capabilities
+ * - - - - - - - - - - - - - - - - - - - */
+
+/** Capability flags */
+typedef enum
+{
+  MCE_HYBRIS_CAP_DISPLAY_POWER      = 1u << 0, // display power control
+  MCE_HYBRIS_CAP_DISPLAY_DOZE       = 1u << 1, // some doze power mode
+  MCE_HYBRIS_CAP_BACKLIGHT          = 1u << 2, // display backlight control
+  MCE_HYBRIS_CAP_KEYPAD             = 1u << 3, // keypad backlight control
+  MCE_HYBRIS_CAP_INDICATOR          = 1u << 4, // indicator led control
+  MCE_HYBRIS_CAP_INDICATOR_SYSFS    = 1u << 5, // indicator led via sysfs
+  MCE_HYBRIS_CAP_INDICATOR_BREATHE  = 1u << 6, // sw breathing supported
+  MCE_HYBRIS_CAP_INDICATOR_HW_BLINK = 1u << 7, // blinking offloaded to hw
+  MCE_HYBRIS_CAP_PROXIMITY          = 1u << 8, // proximity sensor
+  MCE_HYBRIS_CAP_PROXIMITY_WAKEUP   = 1u << 9, // wake-up proximity sensor
+  MCE_HYBRIS_CAP_LIGHT_SENSOR       = 1u << 10, // ambient light sensor
+} mce_hybris_cap_t;
+
+/** Plugin capabilities
+ *
+ * New members are added only at the end; check size before accessing
+ * members that might not exist in older plugin versions.
+ */
+typedef struct
+{
+  unsigned    size;                  // sizeof (mce_hybris_caps_t) in plugin
+  unsigned    flags;                 // mask of mce_hybris_cap_t bits
+  int         display_count;         // number of power controllable displays
+  unsigned    display_power_modes;   // MCE_HYBRIS_FB_POWER_MODE_BIT() mask
+  int         display_power_method;  // internal mce_hybris_fb_method_t value
+  int         backlight_max_level;   // native backlight resolution, or 0
+  const char *indicator_backend;     // sysfs led backend, "hal", or NULL
+  int         indicator_breath_type; // sysfs led ramp type, 0 = none
+  uint32_t    sensor_types;          // mask of 1 << android sensor type
+  int32_t     sensor_min_delay[32];  // fastest sampling interval per type [us]
+  unsigned    unknown;               // mce_hybris_cap_t bits not known until init
+} mce_hybris_caps_t;
+
+const mce_hybris_caps_t *mce_hybris_get_capabilities(void);
+
 /* - - - - - - - - - - - - - - - - - - - *
  * generic
  * - - - - - - - - - - - - - - - - - - - */
@@ -114,12 +255,210 @@ void mce_hybris_quit(void);
 # if MCE_HYBRIS_INTERNAL >= 1
 typedef void (*mce_hybris_log_fn)(int lev, const char *file, const char *func,
                                   const char *text);
+
+/** Display power control methods */
+typedef enum
+{
+  MCE_HYBRIS_FB_METHOD_NONE,
+  MCE_HYBRIS_FB_METHOD_HWC20,  // hw composer 2.0 setPowerMode()
+  MCE_HYBRIS_FB_METHOD_HWC14,  // hw composer 1.4 setPowerMode()
+  MCE_HYBRIS_FB_METHOD_HWC10,  // hw composer 1.0 blank()
+  MCE_HYBRIS_FB_METHOD_FB,     // frame buffer enableScreen()
+  MCE_HYBRIS_FB_METHOD_COUNT
+} mce_hybris_fb_method_t;
+
+/** Number of display power latency histogram buckets
+ *
+ * Bucket upper limits are: 1, 2, 5, 10, 20, 50, 100, 200, 500 ms
+ * and the last bucket holds everything that took longer.
+ */
+#  define MCE_HYBRIS_FB_LATENCY_BUCKETS 10
+
+/** Display power transition statistics for one control method */
+typedef struct
+{
+  const char *method;        // human readable method name
+  unsigned    transitions;   // number of hal calls made
+  unsigned    failures;      // number of failed hal calls
+  unsigned    coalesced;     // superseded requests, all methods
+  int64_t     last_begin_us; // CLOCK_MONOTONIC start of last hal call
+  int64_t     last_us;       // duration of last hal call
+  int64_t     min_us;        // shortest hal call
+  int64_t     max_us;        // longest hal call
+  int64_t     total_us;      // cumulative hal call duration
+  unsigned    histogram[MCE_HYBRIS_FB_LATENCY_BUCKETS];
+} mce_hybris_fb_power_stats_t;
+
+/** Backlight / keypad light write statistics */
+typedef struct
+{
+  unsigned requests;  // brightness change requests
+  unsigned writes;    // hal calls made
+  unsigned failures;  // failed hal calls
+  unsigned skipped;   // requests that would not have changed the level
+  unsigned coalesced; // requests superseded while rate limited
+} mce_hybris_light_stats_t;
+
+/** Sensor HAL event time stamp clock domains */
+typedef enum
+{
+  MCE_HYBRIS_SENSOR_CLOCK_UNKNOWN,   // no events seen yet
+  MCE_HYBRIS_SENSOR_CLOCK_BOOTTIME,  // CLOCK_BOOTTIME, no conversion needed
+  MCE_HYBRIS_SENSOR_CLOCK_MONOTONIC, // CLOCK_MONOTONIC
+  MCE_HYBRIS_SENSOR_CLOCK_REALTIME,  // CLOCK_REALTIME
+  MCE_HYBRIS_SENSOR_CLOCK_ARBITRARY, // unknown clock, fixed offset used
+} mce_hybris_sensor_clock_t;
+
+/** Sensor poll device statistics */
+typedef struct
+{
+  unsigned opens;                  // poll device opens, including resumes
+  unsigned closes;                 // poll device closes due to inactivity
+  int64_t  last_open_us;           // duration of last open + worker start
+  int64_t  max_open_us;            // longest open + worker start
+  unsigned ps_events;              // proximity events received while debouncing
+  unsigned ps_reported;            // proximity state changes reported
+  unsigned ps_suppressed;          // proximity state changes suppressed by debounce
+  unsigned als_events;             // light sensor samples received
+  unsigned als_rejected;           // light sensor samples rejected as spikes
+  unsigned als_delivered;          // light sensor levels delivered after filtering
+  unsigned watchdog_reactivations; // sensor re-activations due to stalled input
+  unsigned watchdog_reopens;       // poll device reopens due to stalled input
+  unsigned watchdog_recoveries;    // stalls after which events resumed
+  int64_t  last_recovery_us;       // latest stall detection to first event
+  int64_t  max_recovery_us;        // longest stall detection to first event
+  int      clock_domain;           // mce_hybris_sensor_clock_t detected for hal
+  unsigned clock_calibrations;     // hal clock domain detections
+  unsigned delay_events;           // events included in delay statistics
+  int64_t  last_delay_us;          // latest event time stamp to dispatch delay
+  int64_t  max_delay_us;           // longest event time stamp to dispatch delay
+  int64_t  total_delay_us;         // cumulative event time stamp to dispatch delay
+} mce_hybris_sensor_stats_t;
+
+/** Background preload stages */
+typedef enum
+{
+  MCE_HYBRIS_PRELOAD_STAGE_FB,      // gralloc / hw composer module load
+  MCE_HYBRIS_PRELOAD_STAGE_LIGHTS,  // lights module load
+  MCE_HYBRIS_PRELOAD_STAGE_SENSORS, // sensors module load and sensor list
+  MCE_HYBRIS_PRELOAD_STAGE_LEDS,    // sysfs led control probing (not preloaded)
+  MCE_HYBRIS_PRELOAD_STAGE_COUNT
+} mce_hybris_preload_stage_t;
+
+/** Background preload stage timing */
+typedef struct
+{
+  const char *name;     // human readable stage name
+  int64_t     begin_us; // stage start, relative to plugin load
+  int64_t     end_us;   // stage finish, relative to plugin load
+  bool        success;  // stage result
+} mce_hybris_preload_step_t;
+
+/** Background preload timeline */
+typedef struct
+{
+  int64_t                   kick_us; // CLOCK_MONOTONIC time of plugin load
+  int64_t                   wait_us; // first wait for preload, relative
+  int64_t                   done_us; // all stages joined, relative
+  mce_hybris_preload_step_t stage[MCE_HYBRIS_PRELOAD_STAGE_COUNT];
+} mce_hybris_preload_timeline_t;
+
+/** Current version of mce_hybris_api_t */
+#  define MCE_HYBRIS_API_VERSION 1
+
+/** Plugin function table
+ *
+ * Members are only ever added at the end. Before accessing a member,
+ * check that it is within the size reported by the plugin - and that
+ * the pointer is not NULL, as functionality that the plugin was built
+ * without is left unset.
+ */
+typedef struct
+{
+  unsigned size;    // sizeof (mce_hybris_api_t) in plugin
+  unsigned version; // MCE_HYBRIS_API_VERSION in plugin
+
+  /* - - - version 1 - - - */
+
+  void (*set_log_hook)(mce_hybris_log_fn cb);
+  void (*quit)(void);
+  const mce_hybris_caps_t *(*get_capabilities)(void);
+  bool (*preload_get_timeline)(mce_hybris_preload_timeline_t *timeline);
+
+  bool (*framebuffer_init)(void);
+  void (*framebuffer_quit)(void);
+  bool (*framebuffer_set_power)(bool on);
+  bool (*framebuffer_set_power_mode)(mce_hybris_fb_power_mode_t mode);
+  unsigned (*framebuffer_get_power_modes)(void);
+  bool (*framebuffer_set_power_async)(bool on);
+  int  (*framebuffer_get_display_count)(void);
+  bool (*framebuffer_set_display_power)(int display, bool on);
+  bool (*framebuffer_set_display_power_async)(int display, bool on);
+  bool (*framebuffer_set_display_power_mode)(int display, mce_hybris_fb_power_mode_t mode);
+  bool (*framebuffer_set_display_power_mode_async)(int display, mce_hybris_fb_power_mode_t mode);
+  void (*framebuffer_set_power_hook)(mce_hybris_fb_power_fn cb);
+  mce_hybris_fb_method_t (*framebuffer_get_power_method)(void);
+  bool (*framebuffer_get_power_stats)(mce_hybris_fb_method_t method, mce_hybris_fb_power_stats_t *stats);
+
+  bool (*backlight_init)(void);
+  void (*backlight_quit)(void);
+  bool (*backlight_set_brightness)(int level);
+  bool (*backlight_fade)(int level, int duration_ms, mce_hybris_backlight_fade_t curve);
+  void (*backlight_fade_stop)(void);
+  int  (*backlight_get_brightness)(void);
+  int  (*backlight_get_max_level)(void);
+  bool (*backlight_set_level)(int level);
+  bool (*backlight_get_stats)(mce_hybris_light_stats_t *stats);
+
+  bool (*keypad_init)(void);
+  void (*keypad_quit)(void);
+  bool (*keypad_set_brightness)(int level);
+  bool (*keypad_get_stats)(mce_hybris_light_stats_t *stats);
+
+  bool (*indicator_init)(void);
+  void (*indicator_quit)(void);
+  bool (*indicator_set_pattern)(int r, int g, int b, int ms_on, int ms_off);
+  bool (*indicator_can_breathe)(void);
+  void (*indicator_enable_breathing)(bool enable);
+  bool (*indicator_set_brightness)(int level);
+
+  bool (*ps_init)(void);
+  void (*ps_quit)(void);
+  bool (*ps_set_active)(bool active);
+  void (*ps_set_hook)(mce_hybris_ps_fn cb);
+  bool (*ps_set_wakeup)(bool wakeup);
+
+  bool (*als_init)(void);
+  void (*als_quit)(void);
+  bool (*als_set_active)(bool active);
+  void (*als_set_hook)(mce_hybris_als_fn cb);
+
+  bool (*sensor_init)(int type);
+  void (*sensor_quit)(void);
+  bool (*sensor_set_active)(int type, bool active);
+  void (*sensor_set_hook)(mce_hybris_sensor_fn cb);
+  bool (*sensors_get_stats)(mce_hybris_sensor_stats_t *stats);
+} mce_hybris_api_t;
 # endif
 
 # if MCE_HYBRIS_INTERNAL >= 2
 void mce_hybris_set_log_hook(mce_hybris_log_fn cb);
 void mce_hybris_ps_set_hook(mce_hybris_ps_fn cb);
 void mce_hybris_als_set_hook(mce_hybris_als_fn cb);
+void mce_hybris_sensor_set_hook(mce_hybris_sensor_fn cb);
+void mce_hybris_framebuffer_set_power_hook(mce_hybris_fb_power_fn cb);
+bool mce_hybris_framebuffer_set_display_power_mode(int display,
+                                                   mce_hybris_fb_power_mode_t mode);
+bool mce_hybris_framebuffer_set_display_power_mode_async(int display,
+                                                         mce_hybris_fb_power_mode_t mode);
+mce_hybris_fb_method_t mce_hybris_framebuffer_get_power_method(void);
+bool mce_hybris_framebuffer_get_power_stats(mce_hybris_fb_method_t method,
+                                            mce_hybris_fb_power_stats_t *stats);
+bool mce_hybris_backlight_get_stats(mce_hybris_light_stats_t *stats);
+bool mce_hybris_keypad_get_stats(mce_hybris_light_stats_t *stats);
+bool mce_hybris_sensors_get_stats(mce_hybris_sensor_stats_t *stats);
+bool mce_hybris_preload_get_timeline(mce_hybris_preload_timeline_t *timeline);
+const mce_hybris_api_t *mce_hybris_get_api(void);
 # endif
 
 # pragma GCC visibility pop
@@ -0,0 +1,592 @@
+/** @file plugin-backlight.c
+ *
+ * mce-plugin-libhybris - Libhybris plugin for Mode Control Entity
+ * <p>
+ * Copyright (c) 2026 Jollyboys Ltd.
+ * <p>
+ * @author Simo Piiroinen <simo.piiroinen@jollamobile.com>
+ *
+ * mce-plugin-libhybris is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * mce-plugin-libhybris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with mce-plugin-libhybris; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* ========================================================================= *
+ * Display backlight fading
+ *
+ * Instead of mce driving brightness transitions by calling the
+ * set brightness function from its own timers - each call crossing
+ * the plugin boundary and resulting in a lights HAL call - mce can
+ * ask the plugin to perform the whole fade.
+ *
+ * The intensity curve for the fade is calculated once when the fade
+ * is started, and then played back from a single glib timer. Steps
+ * that would not change the brightness level are not passed to the
+ * HAL at all.
+ *
+ * Brightness is controlled via sysfs backlight class device when
+ * available, using the native resolution of the backlight driver,
+ * and via lights HAL otherwise. Levels given in 0 ... 255 range are
+ * scaled to native range, and fades are executed in native range.
+ * ========================================================================= */
+
+#include "plugin-backlight.h"
+
+#include "plugin-logging.h"
+#include "plugin-config.h"
+#include "hybris-lights.h"
+#include "hybris-fb.h"
+#include "sysfs-backlight.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <glib.h>
+
+/* ========================================================================= *
+ * CONSTANTS
+ * ========================================================================= */
+
+/** Maximum brightness level in api and lights HAL */
+#define BACKLIGHT_LEVEL_MAX      255
+
+/** Maximum number of steps in precalculated fade curve */
+#define BACKLIGHT_FADE_MAX_STEPS 256
+
+/** Minimum delay between fade steps [ms]; roughly one frame at 60 Hz */
+#define BACKLIGHT_FADE_MIN_DELAY 16
+
+/* ========================================================================= *
+ * PROTOTYPES
+ * ========================================================================= */
+
+/* ------------------------------------------------------------------------- *
+ * BACKLIGHT_WRITE
+ * ------------------------------------------------------------------------- */
+
+static int      backlight_clamp_level        (int level);
+static int      backlight_to_native          (int level);
+static int      backlight_from_native        (int level);
+static unsigned backlight_power_generation   (void);
+static bool     backlight_write              (int level);
+
+/* ------------------------------------------------------------------------- *
+ * BACKLIGHT_FADE
+ * ------------------------------------------------------------------------- */
+
+static float    backlight_fade_curve         (mce_hybris_backlight_fade_t curve, float t);
+static void     backlight_fade_prepare       (int from, int to, int duration, mce_hybris_backlight_fade_t curve);
+static gboolean backlight_fade_step_cb       (gpointer aptr);
+static void     backlight_fade_cancel        (void);
+
+/* ------------------------------------------------------------------------- *
+ * PLUGIN_BACKLIGHT
+ * ------------------------------------------------------------------------- */
+
+bool            plugin_backlight_init          (void);
+bool            plugin_backlight_is_initialized(void);
+bool            plugin_backlight_set_brightness(int level);
+bool            plugin_backlight_set_level     (int level);
+int             plugin_backlight_get_max_level (void);
+bool            plugin_backlight_fade          (int level, int duration, mce_hybris_backlight_fade_t curve);
+void            plugin_backlight_fade_stop     (void);
+int             plugin_backlight_get_brightness(void);
+void            plugin_backlight_quit          (void);
+
+/* ========================================================================= *
+ * BACKLIGHT_WRITE
+ * ========================================================================= */
+
+/** Flag for: plugin_backlight_init() has been called */
+static bool     backlight_initialized = false;
+
+/** Maximum native brightness level, or 0 if not initialized */
+static int      backlight_max     = 0;
+
+/** Flag for: brightness is controlled via sysfs instead of HAL */
+static bool     backlight_sysfs   = false;
+
+/** Last native level successfully written, or -1 if unknown */
+static int      backlight_level   = -1;
+
+/** Display power generation at the time backlight_level was written */
+static unsigned backlight_generation = 0;
+
+/** Number of HAL writes made since the latest fade was started */
+static unsigned backlight_written = 0;
+
+/** Number of fade steps that did not need a HAL write */
+static unsigned backlight_elided  = 0;
+
+/** Clamp native brightness level to supported range
+ *
+ * @param level brightness level
+ *
+ * @return level clamped to [0, backlight_max]
+ */
+static int
+backlight_clamp_level(int level)
+{
+    if( level < 0 )
+        return 0;
+    if( level > backlight_max )
+        return backlight_max;
+    return level;
+}
+
+/** Scale api brightness level to native range
+ *
+ * Non-zero levels are kept non-zero.
+ *
+ * @param level 0 ... BACKLIGHT_LEVEL_MAX
+ *
+ * @return 0 ... backlight_max
+ */
+static int
+backlight_to_native(int level)
+{
+    if( level <= 0 )
+        return 0;
+    if( level >= BACKLIGHT_LEVEL_MAX )
+        return backlight_max;
+    level = (level * backlight_max + BACKLIGHT_LEVEL_MAX / 2) / BACKLIGHT_LEVEL_MAX;
+    return level < 1 ? 1 : level;
+}
+
+/** Scale native brightness level to api range
+ *
+ * @param level 0 ... backlight_max, or -1 for unknown
+ *
+ * @return 0 ... BACKLIGHT_LEVEL_MAX, or -1 for unknown
+ */
+static int
+backlight_from_native(int level)
+{
+    if( level < 0 || backlight_max <= 0 )
+        return -1;
+    return (level * BACKLIGHT_LEVEL_MAX + backlight_max / 2) / backlight_max;
+}
+
+/** Get display power generation, or 0 if display power is not tracked
+ *
+ * @return hybris_device_fb_get_power_generation() value
+ */
+static unsigned
+backlight_power_generation(void)
+{
+#ifdef ENABLE_HYBRIS_SUPPORT
+    return hybris_device_fb_get_power_generation();
+#else
+    return 0;
+#endif
+}
+
+/** Write native brightness level to sysfs or HAL
+ *
+ * Writes that would not change the level are elided, unless display
+ * power has been toggled since the last write - kernel / hal might
+ * have reset the backlight during the transition.
+ *
+ * @param level native brightness level
+ *
+ * @return true on success, false on failure
+ */
+static bool
+backlight_write(int level)
+{
+    bool     ack        = false;
+    unsigned generation = backlight_power_generation();
+    bool     stale      = (generation != backlight_generation);
+
+    if( !stale && level == backlight_level ) {
+        ++backlight_elided;
+        ack = true;
+        goto EXIT;
+    }
+
+    /* Assume unknown state until write succeeds */
+    backlight_level      = -1;
+    backlight_generation = generation;
+
+    /* Lower level write caches are stale too */
+    if( backlight_sysfs ) {
+        if( stale )
+            sysfs_backlight_invalidate();
+
+        if( !sysfs_backlight_set_level(level) )
+            goto EXIT;
+    }
+    else {
+#ifdef ENABLE_HYBRIS_SUPPORT
+        if( stale )
+            hybris_device_backlight_invalidate();
+
+        if( !hybris_device_backlight_set_brightness(level) )
+            goto EXIT;
+#else
+        goto EXIT;
+#endif
+    }
+
+    backlight_level = level;
+    ++backlight_written;
+    ack = true;
+
+EXIT:
+    return ack;
+}
+
+/* ========================================================================= *
+ * BACKLIGHT_FADE
+ * ========================================================================= */
+
+/** Currently active backlight fade */
+static struct
+{
+    /** Timer id for stepping through the curve */
+    guint  timer_id;
+
+    /** Delay between steps [ms] */
+    int    delay;
+
+    /** Index of the next step to apply */
+    size_t step;
+
+    /** Number of steps in the curve */
+    size_t steps;
+
+    /** Precalculated brightness levels */
+    int    level[BACKLIGHT_FADE_MAX_STEPS];
+} backlight_fade =
+{
+    .timer_id = 0,
+    .delay    = 0,
+    .step     = 0,
+    .steps    = 0,
+};
+
+/** Evaluate fade curve
+ *
+ * @param curve fade curve type
+ * @param t     fade progress in [0, 1] range
+ *
+ * @return fraction of brightness change to apply, in [0, 1] range
+ */
+static float
+backlight_fade_curve(mce_hybris_backlight_fade_t curve, float t)
+{
+    switch( curve ) {
+    case MCE_HYBRIS_BACKLIGHT_FADE_SINE:
+        return (1.0f - cosf((float)M_PI * t)) * 0.5f;
+
+    case MCE_HYBRIS_BACKLIGHT_FADE_ACCELERATE:
+        return t * t;
+
+    case MCE_HYBRIS_BACKLIGHT_FADE_DECELERATE:
+        return t * (2.0f - t);
+
+    default:
+    case MCE_HYBRIS_BACKLIGHT_FADE_LINEAR:
+        break;
+    }
+    return t;
+}
+
+/** Precalculate brightness levels for a fade
+ *
+ * The number of steps is limited both by the minimum step delay and
+ * by the number of distinct levels between start and end points, so
+ * that linear fades do not produce redundant steps at all.
+ *
+ * @param from     starting brightness level
+ * @param to       target brightness level
+ * @param duration fade duration [ms]
+ * @param curve    fade curve type
+ */
+static void
+backlight_fade_prepare(int from, int to, int duration,
+                       mce_hybris_backlight_fade_t curve)
+{
+    int delta = to - from;
+    int steps = duration / BACKLIGHT_FADE_MIN_DELAY;
+
+    if( steps > abs(delta) )
+        steps = abs(delta);
+    if( steps > BACKLIGHT_FADE_MAX_STEPS )
+        steps = BACKLIGHT_FADE_MAX_STEPS;
+    if( steps < 1 )
+        steps = 1;
+
+    for( int i = 0; i < steps; ++i ) {
+        float t = (float)(i + 1) / steps;
+        float f = backlight_fade_curve(curve, t);
+        backlight_fade.level[i] = from + (int)lroundf(delta * f);
+    }
+
+    /* Make sure the fade ends exactly at the target level */
+    backlight_fade.level[steps - 1] = to;
+
+    backlight_fade.delay = duration / steps;
+    backlight_fade.step  = 0;
+    backlight_fade.steps = (size_t)steps;
+}
+
+/** Timer callback for applying the next fade step
+ *
+ * @param aptr (unused) user data pointer
+ *
+ * @return G_SOURCE_CONTINUE until all steps have been applied
+ */
+static gboolean
+backlight_fade_step_cb(gpointer aptr)
+{
+    (void)aptr;
+
+    if( !backlight_fade.timer_id )
+        return G_SOURCE_REMOVE;
+
+    if( backlight_fade.step < backlight_fade.steps )
+        backlight_write(backlight_fade.level[backlight_fade.step++]);
+
+    if( backlight_fade.step < backlight_fade.steps )
+        return G_SOURCE_CONTINUE;
+
+    mce_log(LL_DEBUG, "fade to %d finished; %u writes, %u elided",
+            backlight_level, backlight_written, backlight_elided);
+
+    backlight_fade.timer_id = 0;
+    return G_SOURCE_REMOVE;
+}
+
+/** Cancel fade in progress, leaving brightness at the current level
+ */
+static void
+backlight_fade_cancel(void)
+{
+    if( backlight_fade.timer_id ) {
+        mce_log(LL_DEBUG, "fade cancelled at step %zu/%zu",
+                backlight_fade.step, backlight_fade.steps);
+        g_source_remove(backlight_fade.timer_id),
+            backlight_fade.timer_id = 0;
+    }
+    backlight_fade.step  = 0;
+    backlight_fade.steps = 0;
+}
+
+/* ========================================================================= *
+ * PLUGIN_BACKLIGHT
+ * ========================================================================= */
+
+/** Select display backlight control method
+ *
+ * Can be configured via:
+ *
+ *   [LightsConfigHybris]
+ *   BacklightBackend=<auto|sysfs|hal>
+ *
+ * With "hal" (the default) only lights HAL is used, so that vendor
+ * specific brightness remapping and clamping stays in effect. With
+ * "auto" sysfs is used if a backlight class device is found, with
+ * fallback to lights HAL. Ports should opt in to "auto" or "sysfs"
+ * only after verifying that the selected sysfs device is the panel.
+ *
+ * Without hybris support lights HAL is not available and only sysfs
+ * is used, regardless of configuration.
+ *
+ * @return true if backlight can be controlled, false otherwise
+ */
+bool
+plugin_backlight_init(void)
+{
+    gchar *backend = 0;
+
+    if( backlight_initialized )
+        goto EXIT;
+
+    backlight_initialized = true;
+
+    backend = plugin_config_get_string(MCE_CONF_LIGHTS_CONFIG_HYBRIS_GROUP,
+                                       MCE_CONF_LIGHTS_CONFIG_HYBRIS_BACKLIGHT_BACKEND,
+                                       "hal");
+
+#ifdef ENABLE_HYBRIS_SUPPORT
+    bool use_sysfs = strcmp(backend, "hal") != 0;
+#else
+    /* Lights HAL is not available -> sysfs or nothing */
+    bool use_sysfs = true;
+#endif
+
+    if( use_sysfs && sysfs_backlight_init() ) {
+        backlight_sysfs = true;
+        backlight_max   = sysfs_backlight_get_max();
+        backlight_level = sysfs_backlight_get_level();
+    }
+#ifdef ENABLE_HYBRIS_SUPPORT
+    else if( strcmp(backend, "sysfs") && hybris_device_backlight_init() ) {
+        backlight_sysfs = false;
+        backlight_max   = BACKLIGHT_LEVEL_MAX;
+    }
+#endif
+
+    mce_log(LL_DEBUG, "backlight backend: %s, max level %d",
+            backlight_max <= 0 ? "none" : backlight_sysfs ? "sysfs" : "hal",
+            backlight_max);
+
+EXIT:
+    g_free(backend);
+
+    return backlight_max > 0;
+}
+
+/** Check whether backlight backend has been selected already
+ *
+ * @return true if plugin_backlight_init() has been called, false otherwise
+ */
+bool
+plugin_backlight_is_initialized(void)
+{
+    return backlight_initialized;
+}
+
+/** Set display backlight brightness immediately
+ *
+ * Any fade in progress is cancelled.
+ *
+ * @param level 0=off ... 255=maximum brightness
+ *
+ * @return true on success, false on failure
+ */
+bool
+plugin_backlight_set_brightness(int level)
+{
+    if( !plugin_backlight_init() )
+        return false;
+
+    return plugin_backlight_set_level(backlight_to_native(level));
+}
+
+/** Set display backlight brightness immediately using native range
+ *
+ * Any fade in progress is cancelled.
+ *
+ * @param level 0=off ... plugin_backlight_get_max_level()
+ *
+ * @return true on success, false on failure
+ */
+bool
+plugin_backlight_set_level(int level)
+{
+    backlight_fade_cancel();
+
+    if( !plugin_backlight_init() )
+        return false;
+
+    return backlight_write(backlight_clamp_level(level));
+}
+
+/** Get maximum native display backlight level
+ *
+ * @return maximum level, or 0 if backlight can't be controlled
+ */
+int
+plugin_backlight_get_max_level(void)
+{
+    plugin_backlight_init();
+
+    return backlight_max;
+}
+
+/** Start fading display backlight brightness to given level
+ *
+ * Any fade already in progress is replaced, starting from whatever
+ * level it has already reached. If the current level is not known
+ * or the duration is too short for stepping, the target level is
+ * set immediately.
+ *
+ * @param level    target brightness level, 0=off ... 255=maximum
+ * @param duration fade duration [ms]
+ * @param curve    fade curve type
+ *
+ * @return true if fade was started or target level was set,
+ *         false on failure
+ */
+bool
+plugin_backlight_fade(int level, int duration,
+                      mce_hybris_backlight_fade_t curve)
+{
+    bool ack = false;
+
+    backlight_fade_cancel();
+
+    if( !plugin_backlight_init() )
+        goto EXIT;
+
+    level = backlight_to_native(level);
+
+    if( backlight_level < 0 || duration < BACKLIGHT_FADE_MIN_DELAY ) {
+        ack = backlight_write(level);
+        goto EXIT;
+    }
+
+    if( backlight_level == level ) {
+        ack = true;
+        goto EXIT;
+    }
+
+    backlight_fade_prepare(backlight_level, level, duration, curve);
+
+    mce_log(LL_DEBUG, "fade %d -> %d in %d ms; %zu steps @ %d ms",
+            backlight_level, level, duration,
+            backlight_fade.steps, backlight_fade.delay);
+
+    backlight_written = 0;
+    backlight_elided  = 0;
+
+    backlight_fade.timer_id = g_timeout_add(backlight_fade.delay,
+                                            backlight_fade_step_cb, 0);
+    ack = backlight_fade.timer_id != 0;
+
+EXIT:
+    return ack;
+}
+
+/** Stop fade in progress, leaving brightness at the level reached
+ */
+void
+plugin_backlight_fade_stop(void)
+{
+    backlight_fade_cancel();
+}
+
+/** Get the most recently set display backlight brightness
+ *
+ * @return brightness level 0 ... 255, or -1 if not known
+ */
+int
+plugin_backlight_get_brightness(void)
+{
+    return backlight_from_native(backlight_level);
+}
+
+/** Stop fading and release backlight control
+ */
+void
+plugin_backlight_quit(void)
+{
+    backlight_fade_cancel();
+    backlight_level = -1;
+    backlight_max   = 0;
+    sysfs_backlight_quit();
+}
@@ -0,0 +1,45 @@
+/** @file plugin-backlight.h
+ *
+ * mce-plugin-libhybris - Libhybris plugin for Mode Control Entity
+ * <p>
+ * Copyright (c) 2026 Jollyboys Ltd.
+ * <p>
+ * @author Simo Piiroinen <simo.piiroinen@jollamobile.com>
+ *
+ * mce-plugin-libhybris is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * mce-plugin-libhybris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with mce-plugin-libhybris; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef  PLUGIN_BACKLIGHT_H_
+# define PLUGIN_BACKLIGHT_H_
+
+# include "plugin-api.h"
+
+# include <stdbool.h>
+
+/* ========================================================================= *
+ * Prototypes
+ * ========================================================================= */
+
+bool plugin_backlight_init          (void);
+bool plugin_backlight_is_initialized(void);
+bool plugin_backlight_set_brightness(int level);
+bool plugin_backlight_set_level     (int level);
+int  plugin_backlight_get_max_level (void);
+bool plugin_backlight_fade          (int level, int duration, mce_hybris_backlight_fade_t curve);
+void plugin_backlight_fade_stop     (void);
+int  plugin_backlight_get_brightness(void);
+void plugin_backlight_quit          (void);
+
+#endif /* PLUGIN_BACKLIGHT_H_ */
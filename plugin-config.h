@@ -35,6 +35,12 @@
  * CONFIG
  * ========================================================================= */
 
+/** Configuration group for generic plugin values */
+#define MCE_CONF_PLUGIN_CONFIG_HYBRIS_GROUP   "PluginConfigHybris"
+
+/** Optional: load modules in background threads when plugin is loaded */
+#define MCE_CONF_PLUGIN_CONFIG_HYBRIS_PRELOAD "Preload"
+
 /** Configuration group for mce-plugin-libhybris related values */
 #define MCE_CONF_LED_CONFIG_HYBRIS_GROUP   "LEDConfigHybris"
 
@@ -47,6 +53,66 @@
 /** Optional sw breathing type setting */
 #define MCE_CONF_LED_CONFIG_HYBRIS_BREATHING_TYPE   "QuirkBreathingType"
 
+/** Optional led brightness gamma setting, in percent */
+#define MCE_CONF_LED_CONFIG_HYBRIS_GAMMA            "QuirkGamma"
+
+/** Configuration group for display power related values */
+#define MCE_CONF_DISPLAY_CONFIG_HYBRIS_GROUP        "DisplayConfigHybris"
+
+/** Optional: write display power transitions to ftrace trace_marker */
+#define MCE_CONF_DISPLAY_CONFIG_HYBRIS_TRACE_MARKER "TraceMarker"
+
+/** Configuration group for lights HAL related values */
+#define MCE_CONF_LIGHTS_CONFIG_HYBRIS_GROUP         "LightsConfigHybris"
+
+/** Optional: minimum interval between backlight / keypad HAL writes [ms] */
+#define MCE_CONF_LIGHTS_CONFIG_HYBRIS_MIN_INTERVAL  "MinWriteInterval"
+
+/** Optional: display backlight control method, one of hal (default), auto or sysfs */
+#define MCE_CONF_LIGHTS_CONFIG_HYBRIS_BACKLIGHT_BACKEND   "BacklightBackend"
+
+/** Optional: sysfs backlight class device directory to use */
+#define MCE_CONF_LIGHTS_CONFIG_HYBRIS_BACKLIGHT_DIRECTORY "BacklightDirectory"
+
+/** Configuration group for sensor related values */
+#define MCE_CONF_SENSOR_CONFIG_HYBRIS_GROUP         "SensorConfigHybris"
+
+/** Optional: sensor selection policy, either first or lowest-power */
+#define MCE_CONF_SENSOR_CONFIG_HYBRIS_POLICY        "SelectionPolicy"
+
+/** Optional: name of the proximity sensor to use */
+#define MCE_CONF_SENSOR_CONFIG_HYBRIS_PS_NAME       "ProximitySensor"
+
+/** Optional: name of the ambient light sensor to use */
+#define MCE_CONF_SENSOR_CONFIG_HYBRIS_ALS_NAME      "LightSensor"
+
+/** Optional: prefer wake-up proximity sensor by default, true if not set */
+#define MCE_CONF_SENSOR_CONFIG_HYBRIS_PS_WAKEUP     "ProximityWakeUp"
+
+/** Optional: close sensor poll device when no sensors are active, false if not set */
+#define MCE_CONF_SENSOR_CONFIG_HYBRIS_IDLE_SHUTDOWN "IdleShutdown"
+
+/** Optional: time proximity near state must be stable before reporting [ms] */
+#define MCE_CONF_SENSOR_CONFIG_HYBRIS_PS_NEAR_HOLD  "ProximityNearHold"
+
+/** Optional: time proximity far state must be stable before reporting [ms] */
+#define MCE_CONF_SENSOR_CONFIG_HYBRIS_PS_FAR_HOLD   "ProximityFarHold"
+
+/** Optional: light sensor spike rejection ratio */
+#define MCE_CONF_SENSOR_CONFIG_HYBRIS_ALS_SPIKE     "LightFilterSpike"
+
+/** Optional: light sensor sliding median window size */
+#define MCE_CONF_SENSOR_CONFIG_HYBRIS_ALS_MEDIAN    "LightFilterMedian"
+
+/** Optional: light sensor moving average weight for new samples */
+#define MCE_CONF_SENSOR_CONFIG_HYBRIS_ALS_ALPHA     "LightFilterAlpha"
+
+/** Optional: light sensor minimum relative change for delivery [%] */
+#define MCE_CONF_SENSOR_CONFIG_HYBRIS_ALS_DEADBAND  "LightFilterDeadband"
+
+/** Optional: time without sensor events before attempting recovery [ms] */
+#define MCE_CONF_SENSOR_CONFIG_HYBRIS_WATCHDOG      "WatchdogTimeout"
+
 gchar * plugin_config_get_string(const gchar *group, const gchar *key, const gchar *defaultval);
 
 typedef enum
@@ -28,6 +28,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stdbool.h>
+#include <pthread.h>
 
 /* ========================================================================= *
  * PROTOTYPES
@@ -35,6 +37,8 @@
 
 void mce_hybris_set_log_hook(mce_hybris_log_fn cb);
 void mce_hybris_log         (int lev, const char *file, const char *func, const char *fmt, ...);
+void mce_hybris_log_defer   (bool enable);
+void mce_hybris_log_flush   (void);
 
 /* ========================================================================= *
  * DATA
@@ -43,6 +47,30 @@ void mce_hybris_log         (int lev, const char *file, const char *func, const
 /** Callback function for diagnostic output, or NULL for stderr output */
 static mce_hybris_log_fn mce_hybris_log_cb = 0;
 
+/** Deferred diagnostic message */
+typedef struct mce_hybris_log_entry_t mce_hybris_log_entry_t;
+
+struct mce_hybris_log_entry_t
+{
+  mce_hybris_log_entry_t *next;
+  int                     lev;
+  const char             *file;
+  const char             *func;
+  char                   *msg;
+};
+
+/** Flag for: messages from the calling thread are to be deferred */
+static __thread bool mce_hybris_log_deferring = false;
+
+/** Mutex for protecting the deferred message queue */
+static pthread_mutex_t mce_hybris_log_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Deferred messages, oldest first */
+static mce_hybris_log_entry_t *mce_hybris_log_head = 0;
+
+/** Where to link the next deferred message */
+static mce_hybris_log_entry_t **mce_hybris_log_tail = &mce_hybris_log_head;
+
 /* ========================================================================= *
  * FUNCTIONS
  * ========================================================================= */
@@ -76,6 +104,25 @@ mce_hybris_log(int lev, const char *file, const char *func,
   if( vasprintf(&msg, fmt, va) < 0 ) msg = 0;
   va_end(va);
 
+  if( msg && mce_hybris_log_deferring ) {
+    mce_hybris_log_entry_t *entry = calloc(1, sizeof *entry);
+    if( entry ) {
+      /* File and function names are string literals */
+      entry->lev  = lev;
+      entry->file = file;
+      entry->func = func;
+      entry->msg  = msg, msg = 0;
+
+      pthread_mutex_lock(&mce_hybris_log_mutex);
+      *mce_hybris_log_tail = entry;
+      mce_hybris_log_tail  = &entry->next;
+      pthread_mutex_unlock(&mce_hybris_log_mutex);
+    }
+
+    /* Never log directly from deferring thread */
+    free(msg), msg = 0;
+  }
+
   if( msg ) {
     if( mce_hybris_log_cb ) {
       mce_hybris_log_cb(lev, file, func, msg);
@@ -86,3 +133,47 @@ mce_hybris_log(int lev, const char *file, const char *func,
     free(msg);
   }
 }
+
+/** Start / stop deferring diagnostic messages from the calling thread
+ *
+ * Logging in mce is not thread safe. Threads that need to call code
+ * that might emit diagnostic messages can instead have the messages
+ * queued and then emitted from the main thread via
+ * mce_hybris_log_flush().
+ *
+ * @param enable true to start deferring, false to stop
+ */
+void
+mce_hybris_log_defer(bool enable)
+{
+  mce_hybris_log_deferring = enable;
+}
+
+/** Emit deferred diagnostic messages
+ *
+ * Must be called from the main thread.
+ */
+void
+mce_hybris_log_flush(void)
+{
+  pthread_mutex_lock(&mce_hybris_log_mutex);
+  mce_hybris_log_entry_t *head = mce_hybris_log_head;
+  mce_hybris_log_head = 0;
+  mce_hybris_log_tail = &mce_hybris_log_head;
+  pthread_mutex_unlock(&mce_hybris_log_mutex);
+
+  while( head ) {
+    mce_hybris_log_entry_t *entry = head;
+    head = entry->next;
+
+    if( mce_hybris_log_cb ) {
+      mce_hybris_log_cb(entry->lev, entry->file, entry->func, entry->msg);
+    }
+    else {
+      fprintf(stderr, "%s: %s: %s\n", entry->file, entry->func, entry->msg);
+    }
+
+    free(entry->msg);
+    free(entry);
+  }
+}
@@ -25,6 +25,7 @@
 # define PLUGIN_LOGGING_H_
 
 # include <syslog.h>
+# include <stdbool.h>
 
 /** MCE logging priorities
  */
@@ -40,6 +41,8 @@ enum
 
 void mce_hybris_log(int lev, const char *file, const char *func,
                     const char *fmt, ...) __attribute__ ((format (printf, 4, 5)));
+void mce_hybris_log_defer(bool enable);
+void mce_hybris_log_flush(void);
 
 /** Logging from hybris plugin mimics mce-log.h API */
 # define mce_log(LEV,FMT,ARGS...) \
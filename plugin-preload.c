@@ -0,0 +1,314 @@
+/** @file plugin-preload.c
+ *
+ * mce-plugin-libhybris - Libhybris plugin for Mode Control Entity
+ * <p>
+ * Copyright (c) 2026 Jollyboys Ltd.
+ * <p>
+ * @author Simo Piiroinen <simo.piiroinen@jollamobile.com>
+ *
+ * mce-plugin-libhybris is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * mce-plugin-libhybris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with mce-plugin-libhybris; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* ========================================================================= *
+ * Background preloading
+ *
+ * Loading android HAL modules and probing sysfs led controls can take
+ * a noticeable amount of time, and normally happens one module at a
+ * time when mce calls the various init functions during startup.
+ *
+ * When enabled via:
+ *
+ *   [PluginConfigHybris]
+ *   Preload=true
+ *
+ * the work is started as parallel thread pool tasks already when the
+ * plugin gets loaded, and the init functions merely wait for it to
+ * finish. Diagnostic messages from the workers are deferred and
+ * emitted when the main thread has joined the workers.
+ *
+ * Configuration access functions provided by mce are not thread safe,
+ * so the tasks must not read configuration. Work that depends on it -
+ * e.g. sensor selection and sysfs led probing - is left for the main
+ * thread.
+ * ========================================================================= */
+
+#include "plugin-preload.h"
+
+#include "plugin-logging.h"
+#include "plugin-config.h"
+#include "hybris-thread.h"
+#include "hybris-fb.h"
+#include "hybris-lights.h"
+#include "hybris-sensors.h"
+
+#include <string.h>
+#include <time.h>
+
+#include <glib.h>
+
+/* ========================================================================= *
+ * TYPES
+ * ========================================================================= */
+
+/** Preload stage details */
+typedef struct
+{
+    /** Stage name, for diagnostic logging */
+    const char *name;
+
+    /** Function doing the actual work, or NULL if not applicable
+     *
+     *  Must not access configuration. */
+    bool      (*func)(void);
+} preload_stage_t;
+
+/* ========================================================================= *
+ * PROTOTYPES
+ * ========================================================================= */
+
+/* ------------------------------------------------------------------------- *
+ * PRELOAD_STAGE
+ * ------------------------------------------------------------------------- */
+
+static int64_t preload_now_us          (void);
+static bool    preload_enabled         (void);
+#ifdef ENABLE_HYBRIS_SUPPORT
+static void    preload_stage_task_cb   (void *aptr);
+#endif
+
+/* ------------------------------------------------------------------------- *
+ * PLUGIN_PRELOAD
+ * ------------------------------------------------------------------------- */
+
+static void    plugin_preload_kick     (void) __attribute__((constructor));
+void           plugin_preload_wait     (void);
+bool           plugin_preload_get_timeline(mce_hybris_preload_timeline_t *timeline);
+
+/* ========================================================================= *
+ * PRELOAD_STAGE
+ * ========================================================================= */
+
+/** Preload stages, indexed by mce_hybris_preload_stage_t */
+static const preload_stage_t preload_stage_lut[MCE_HYBRIS_PRELOAD_STAGE_COUNT] =
+{
+#ifdef ENABLE_HYBRIS_SUPPORT
+    [MCE_HYBRIS_PRELOAD_STAGE_FB]      = { "fb",      hybris_plugin_fb_load         },
+    [MCE_HYBRIS_PRELOAD_STAGE_LIGHTS]  = { "lights",  hybris_plugin_lights_load     },
+    [MCE_HYBRIS_PRELOAD_STAGE_SENSORS] = { "sensors", hybris_plugin_sensors_preload },
+#else
+    [MCE_HYBRIS_PRELOAD_STAGE_FB]      = { "fb",      0                             },
+    [MCE_HYBRIS_PRELOAD_STAGE_LIGHTS]  = { "lights",  0                             },
+    [MCE_HYBRIS_PRELOAD_STAGE_SENSORS] = { "sensors", 0                             },
+#endif
+    /* Led probing is configuration driven -> done in main thread */
+    [MCE_HYBRIS_PRELOAD_STAGE_LEDS]    = { "leds",    0                             },
+};
+
+#ifdef ENABLE_HYBRIS_SUPPORT
+/** Thread pool tasks, or NULL if not running */
+static hybris_task_t *preload_stage_task[MCE_HYBRIS_PRELOAD_STAGE_COUNT];
+#endif
+
+/** Flag for: calling thread is a preload worker */
+static __thread bool preload_in_worker = false;
+
+/** Flag for: preload workers were started */
+static bool preload_started = false;
+
+/** Flag for: preload workers have been joined */
+static bool preload_finished = false;
+
+/** Mutex for serializing plugin_preload_wait() */
+static pthread_mutex_t preload_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Preload timeline; stage times are written by respective workers */
+static mce_hybris_preload_timeline_t preload_timeline;
+
+/** Get monotonic time stamp
+ *
+ * @return CLOCK_MONOTONIC time in microseconds
+ */
+static int64_t
+preload_now_us(void)
+{
+    struct timespec ts = { 0, 0 };
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * INT64_C(1000000) + ts.tv_nsec / 1000;
+}
+
+/** Predicate for: background preloading is enabled in configuration
+ *
+ * @return true if preloading should be done, false otherwise
+ */
+static bool
+preload_enabled(void)
+{
+    bool   enabled = false;
+    gchar *val     = plugin_config_get_string(MCE_CONF_PLUGIN_CONFIG_HYBRIS_GROUP,
+                                              MCE_CONF_PLUGIN_CONFIG_HYBRIS_PRELOAD,
+                                              0);
+    if( val && (!strcmp(val, "true") || !strcmp(val, "1")) )
+        enabled = true;
+
+    g_free(val);
+
+    return enabled;
+}
+
+#ifdef ENABLE_HYBRIS_SUPPORT
+/** Thread pool task for executing one preload stage
+ *
+ * Logging is deferred, see mce_hybris_log_defer().
+ *
+ * @param aptr stage lookup table entry as void pointer
+ */
+static void
+preload_stage_task_cb(void *aptr)
+{
+    const preload_stage_t *stage = aptr;
+    size_t                 index = stage - preload_stage_lut;
+
+    preload_in_worker = true;
+    mce_hybris_log_defer(true);
+
+    preload_timeline.stage[index].begin_us = preload_now_us() - preload_timeline.kick_us;
+    preload_timeline.stage[index].success  = stage->func();
+    preload_timeline.stage[index].end_us   = preload_now_us() - preload_timeline.kick_us;
+
+    /* Pool worker threads are reused for other tasks */
+    mce_hybris_log_defer(false);
+    preload_in_worker = false;
+}
+#endif
+
+/* ========================================================================= *
+ * PLUGIN_PRELOAD
+ * ========================================================================= */
+
+/** Start background preloading when the plugin is loaded
+ *
+ * Executed as shared object constructor, i.e. before mce has had a
+ * chance to set up logging hook - so messages are deferred also here.
+ */
+static void
+plugin_preload_kick(void)
+{
+    mce_hybris_log_defer(true);
+
+    preload_timeline.kick_us = preload_now_us();
+
+    for( size_t i = 0; i < MCE_HYBRIS_PRELOAD_STAGE_COUNT; ++i )
+        preload_timeline.stage[i].name = preload_stage_lut[i].name;
+
+    if( !preload_enabled() )
+        goto EXIT;
+
+#ifdef ENABLE_HYBRIS_SUPPORT
+    preload_started = true;
+
+    for( size_t i = 0; i < MCE_HYBRIS_PRELOAD_STAGE_COUNT; ++i ) {
+        if( !preload_stage_lut[i].func )
+            continue;
+
+        preload_stage_task[i] = hybris_task_start(preload_stage_lut[i].name,
+                                                  preload_stage_task_cb,
+                                                  (void *)&preload_stage_lut[i]);
+    }
+#endif
+
+EXIT:
+    mce_hybris_log_defer(false);
+}
+
+/** Wait until background preloading has finished
+ *
+ * Returns immediately if preloading is not enabled, has already
+ * finished, or if called from a preload task.
+ *
+ * Also emits diagnostic messages deferred during preloading.
+ */
+void
+plugin_preload_wait(void)
+{
+    if( preload_in_worker )
+        goto EXIT;
+
+    pthread_mutex_lock(&preload_mutex);
+
+    if( preload_finished )
+        goto UNLOCK;
+
+    preload_finished = true;
+
+    if( !preload_started )
+        goto FLUSH;
+
+    preload_timeline.wait_us = preload_now_us() - preload_timeline.kick_us;
+
+#ifdef ENABLE_HYBRIS_SUPPORT
+    for( size_t i = 0; i < MCE_HYBRIS_PRELOAD_STAGE_COUNT; ++i ) {
+        hybris_task_wait(preload_stage_task[i]),
+            preload_stage_task[i] = 0;
+    }
+#endif
+
+    preload_timeline.done_us = preload_now_us() - preload_timeline.kick_us;
+
+FLUSH:
+    mce_hybris_log_flush();
+
+    if( !preload_started )
+        goto UNLOCK;
+
+    for( size_t i = 0; i < MCE_HYBRIS_PRELOAD_STAGE_COUNT; ++i ) {
+        const mce_hybris_preload_step_t *step = &preload_timeline.stage[i];
+
+        if( !preload_stage_lut[i].func )
+            continue;
+
+        mce_log(LL_DEBUG, "preload %s: %lld ... %lld us, %s", step->name,
+                (long long)step->begin_us, (long long)step->end_us,
+                step->success ? "ok" : "failed");
+    }
+
+    mce_log(LL_DEBUG, "preload: waited at %lld us, finished at %lld us",
+            (long long)preload_timeline.wait_us,
+            (long long)preload_timeline.done_us);
+
+UNLOCK:
+    pthread_mutex_unlock(&preload_mutex);
+
+EXIT:
+    return;
+}
+
+/** Get background preload timeline
+ *
+ * All times are relative to the plugin load.
+ *
+ * @param timeline where to store the timeline
+ *
+ * @return true if preloading was done, false otherwise
+ */
+bool
+plugin_preload_get_timeline(mce_hybris_preload_timeline_t *timeline)
+{
+    plugin_preload_wait();
+
+    if( timeline )
+        *timeline = preload_timeline;
+
+    return preload_started;
+}
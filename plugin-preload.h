@@ -0,0 +1,38 @@
+/** @file plugin-preload.h
+ *
+ * mce-plugin-libhybris - Libhybris plugin for Mode Control Entity
+ * <p>
+ * Copyright (c) 2026 Jollyboys Ltd.
+ * <p>
+ * @author Simo Piiroinen <simo.piiroinen@jollamobile.com>
+ *
+ * mce-plugin-libhybris is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * mce-plugin-libhybris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with mce-plugin-libhybris; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef  PLUGIN_PRELOAD_H_
+# define PLUGIN_PRELOAD_H_
+
+# include "plugin-api.h"
+
+# include <stdbool.h>
+
+/* ========================================================================= *
+ * Prototypes
+ * ========================================================================= */
+
+void plugin_preload_wait        (void);
+bool plugin_preload_get_timeline(mce_hybris_preload_timeline_t *timeline);
+
+#endif /* PLUGIN_PRELOAD_H_ */
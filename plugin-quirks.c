@@ -52,6 +52,7 @@ static const char * const quirk_name_lut[QUIRK_COUNT] =
 {
     [QUIRK_BREATHING_ENABLED] = MCE_CONF_LED_CONFIG_HYBRIS_BREATHING_ENABLED,
     [QUIRK_BREATHING_TYPE]    = MCE_CONF_LED_CONFIG_HYBRIS_BREATHING_TYPE,
+    [QUIRK_GAMMA]             = MCE_CONF_LED_CONFIG_HYBRIS_GAMMA,
 };
 
 /** Flag array for: quirk setting has been defined in mce config */
@@ -43,6 +43,9 @@ typedef enum
     /** Override breathing type desicion made by led backend */
     QUIRK_BREATHING_TYPE,
 
+    /** Override brightness gamma [percent] used by led backend */
+    QUIRK_GAMMA,
+
     /** Number of quirks */
     QUIRK_COUNT
 } quirk_t;
@@ -0,0 +1,324 @@
+/** @file sysfs-backlight.c
+ *
+ * mce-plugin-libhybris - Libhybris plugin for Mode Control Entity
+ * <p>
+ * Copyright (c) 2026 Jollyboys Ltd.
+ * <p>
+ * @author Simo Piiroinen <simo.piiroinen@jollamobile.com>
+ *
+ * mce-plugin-libhybris is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * mce-plugin-libhybris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with mce-plugin-libhybris; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* ========================================================================= *
+ * Direct sysfs display backlight control
+ *
+ * The lights HAL interface packs backlight level into an 8-bit ARGB
+ * color value, while panel backlight drivers often support 10-12 bit
+ * resolution. Writing the sysfs backlight class brightness file
+ * directly allows using the native resolution - and avoids the HAL
+ * call overhead.
+ *
+ * The backlight device to use can be configured via:
+ *
+ *   [LightsConfigHybris]
+ *   BacklightDirectory=/sys/class/backlight/<device>
+ *
+ * If not configured, the backlight class directory is scanned and
+ * the device is chosen based on backlight type the same way as the
+ * kernel does it: firmware, then platform, then raw interfaces.
+ * ========================================================================= */
+
+#include "sysfs-backlight.h"
+
+#include "sysfs-val.h"
+#include "plugin-logging.h"
+#include "plugin-config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+
+#include <glib.h>
+
+/* ========================================================================= *
+ * PROTOTYPES
+ * ========================================================================= */
+
+static int   sysfs_backlight_read_number(const char *dir, const char *file);
+static int   sysfs_backlight_type_rank  (const char *dir);
+static char *sysfs_backlight_scan       (void);
+static bool  sysfs_backlight_open       (const char *dir);
+
+bool         sysfs_backlight_init       (void);
+void         sysfs_backlight_quit       (void);
+int          sysfs_backlight_get_max    (void);
+int          sysfs_backlight_get_level  (void);
+bool         sysfs_backlight_set_level  (int level);
+void         sysfs_backlight_invalidate (void);
+
+/* ========================================================================= *
+ * PROBING
+ * ========================================================================= */
+
+/** Backlight brightness control file */
+static sysfsval_t *sysfs_backlight_brightness = 0;
+
+/** Maximum brightness supported by backlight driver */
+static int         sysfs_backlight_max        = 0;
+
+/** Read a number from file within backlight device directory
+ *
+ * @param dir   backlight device directory
+ * @param file  file name
+ *
+ * @return number, or -1 on failure
+ */
+static int
+sysfs_backlight_read_number(const char *dir, const char *file)
+{
+    int         res  = -1;
+    char       *path = g_strdup_printf("%s/%s", dir, file);
+    sysfsval_t *val  = sysfsval_create();
+
+    if( sysfsval_open_ro(val, path) && sysfsval_refresh(val) )
+        res = sysfsval_get(val);
+
+    sysfsval_delete(val);
+    g_free(path);
+
+    return res;
+}
+
+/** Evaluate backlight device preference based on backlight type
+ *
+ * @param dir   backlight device directory
+ *
+ * @return 3 for firmware, 2 for platform, 1 for raw, 0 for unknown
+ */
+static int
+sysfs_backlight_type_rank(const char *dir)
+{
+    static const char * const lut[] = { "raw", "platform", "firmware" };
+
+    int   rank = 0;
+    char  type[32] = "";
+    char *path = g_strdup_printf("%s/type", dir);
+    FILE *file = fopen(path, "r");
+
+    if( !file )
+        goto EXIT;
+
+    if( !fgets(type, sizeof type, file) )
+        goto EXIT;
+
+    type[strcspn(type, "\n")] = 0;
+
+    for( size_t i = 0; i < G_N_ELEMENTS(lut); ++i ) {
+        if( !strcmp(lut[i], type) )
+            rank = (int)i + 1;
+    }
+
+EXIT:
+    if( file )
+        fclose(file);
+    g_free(path);
+
+    return rank;
+}
+
+/** Locate the preferred backlight class device
+ *
+ * @return directory path to release with g_free(), or NULL
+ */
+static char *
+sysfs_backlight_scan(void)
+{
+    char *best = 0;
+    int   rank = -1;
+    DIR  *dir  = opendir(SYSFS_BACKLIGHT_DIRECTORY);
+
+    if( !dir ) {
+        mce_log(LL_DEBUG, "%s: opendir: %m", SYSFS_BACKLIGHT_DIRECTORY);
+        goto EXIT;
+    }
+
+    struct dirent *de;
+
+    while( (de = readdir(dir)) ) {
+        if( de->d_name[0] == '.' )
+            continue;
+
+        char *path = g_strdup_printf("%s/%s", SYSFS_BACKLIGHT_DIRECTORY,
+                                     de->d_name);
+        int   curr = sysfs_backlight_type_rank(path);
+
+        if( curr > rank )
+            g_free(best), best = path, path = 0, rank = curr;
+
+        g_free(path);
+    }
+
+EXIT:
+    if( dir )
+        closedir(dir);
+
+    return best;
+}
+
+/** Take backlight class device in use
+ *
+ * @param dir   backlight device directory
+ *
+ * @return true on success, false on failure
+ */
+static bool
+sysfs_backlight_open(const char *dir)
+{
+    bool  ack  = false;
+    char *path = 0;
+
+    sysfs_backlight_max = sysfs_backlight_read_number(dir, "max_brightness");
+    if( sysfs_backlight_max <= 0 )
+        goto EXIT;
+
+    path = g_strdup_printf("%s/brightness", dir);
+    sysfs_backlight_brightness = sysfsval_create();
+
+    if( !sysfsval_open_rw(sysfs_backlight_brightness, path) )
+        goto EXIT;
+
+    /* Get initial level so that fading can start from it */
+    sysfsval_refresh(sysfs_backlight_brightness);
+
+    mce_log(LL_DEBUG, "%s: max_brightness=%d brightness=%d", dir,
+            sysfs_backlight_max, sysfsval_get(sysfs_backlight_brightness));
+
+    ack = true;
+
+EXIT:
+    if( !ack )
+        sysfs_backlight_quit();
+
+    g_free(path);
+
+    return ack;
+}
+
+/* ========================================================================= *
+ * SYSFS_BACKLIGHT
+ * ========================================================================= */
+
+/** Probe sysfs backlight device
+ *
+ * @return true if backlight can be controlled via sysfs, false otherwise
+ */
+bool
+sysfs_backlight_init(void)
+{
+    static bool done = false;
+
+    gchar *dir = 0;
+
+    if( done )
+        goto EXIT;
+
+    done = true;
+
+    dir = plugin_config_get_string(MCE_CONF_LIGHTS_CONFIG_HYBRIS_GROUP,
+                                   MCE_CONF_LIGHTS_CONFIG_HYBRIS_BACKLIGHT_DIRECTORY,
+                                   0);
+    if( !dir )
+        dir = sysfs_backlight_scan();
+
+    if( !dir ) {
+        mce_log(LL_DEBUG, "no sysfs backlight devices");
+        goto EXIT;
+    }
+
+    if( !sysfs_backlight_open(dir) )
+        mce_log(LL_WARN, "%s: could not use backlight device", dir);
+
+EXIT:
+    g_free(dir);
+
+    return sysfs_backlight_brightness != 0;
+}
+
+/** Release sysfs backlight device
+ */
+void
+sysfs_backlight_quit(void)
+{
+    sysfsval_delete_at(&sysfs_backlight_brightness);
+    sysfs_backlight_max = 0;
+}
+
+/** Get maximum native backlight level
+ *
+ * @return max_brightness, or 0 if sysfs backlight is not in use
+ */
+int
+sysfs_backlight_get_max(void)
+{
+    return sysfs_backlight_brightness ? sysfs_backlight_max : 0;
+}
+
+/** Get most recently set native backlight level
+ *
+ * @return brightness, or -1 if not known
+ */
+int
+sysfs_backlight_get_level(void)
+{
+    return sysfs_backlight_brightness ?
+        sysfsval_get(sysfs_backlight_brightness) : -1;
+}
+
+/** Set native backlight level
+ *
+ * Writing the level that is already in use is skipped.
+ *
+ * @param level  0 ... max_brightness
+ *
+ * @return true on success, false on failure
+ */
+bool
+sysfs_backlight_set_level(int level)
+{
+    bool ack = false;
+
+    if( !sysfs_backlight_brightness )
+        goto EXIT;
+
+    if( level < 0 )
+        level = 0;
+    else if( level > sysfs_backlight_max )
+        level = sysfs_backlight_max;
+
+    if( !(ack = sysfsval_set(sysfs_backlight_brightness, level)) )
+        sysfsval_invalidate(sysfs_backlight_brightness);
+
+EXIT:
+    return ack;
+}
+
+/** Make next sysfs_backlight_set_level() call write unconditionally
+ */
+void
+sysfs_backlight_invalidate(void)
+{
+    if( sysfs_backlight_brightness )
+        sysfsval_invalidate(sysfs_backlight_brightness);
+}
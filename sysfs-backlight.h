@@ -0,0 +1,47 @@
+/** @file sysfs-backlight.h
+ *
+ * mce-plugin-libhybris - Libhybris plugin for Mode Control Entity
+ * <p>
+ * Copyright (c) 2026 Jollyboys Ltd.
+ * <p>
+ * @author Simo Piiroinen <simo.piiroinen@jollamobile.com>
+ *
+ * mce-plugin-libhybris is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * mce-plugin-libhybris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with mce-plugin-libhybris; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef  SYSFS_BACKLIGHT_H_
+# define SYSFS_BACKLIGHT_H_
+
+# include <stdbool.h>
+
+/* ========================================================================= *
+ * CONSTANTS
+ * ========================================================================= */
+
+/** Directory that holds sysfs backlight class devices */
+# define SYSFS_BACKLIGHT_DIRECTORY "/sys/class/backlight"
+
+/* ========================================================================= *
+ * Prototypes
+ * ========================================================================= */
+
+bool sysfs_backlight_init      (void);
+void sysfs_backlight_quit      (void);
+int  sysfs_backlight_get_max   (void);
+int  sysfs_backlight_get_level (void);
+bool sysfs_backlight_set_level (int level);
+void sysfs_backlight_invalidate(void);
+
+#endif /* SYSFS_BACKLIGHT_H_ */
@@ -0,0 +1,869 @@
+/** @file sysfs-led-auto.c
+ *
+ * mce-plugin-libhybris - Libhybris plugin for Mode Control Entity
+ * <p>
+ * Copyright (c) 2026 Jollyboys Ltd.
+ * <p>
+ * @author Simo Piiroinen <simo.piiroinen@jollamobile.com>
+ *
+ * mce-plugin-libhybris is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * mce-plugin-libhybris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with mce-plugin-libhybris; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* ========================================================================= *
+ * Auto-discovered led control
+ *
+ * Instead of matching against static path tables, the led class
+ * directory is scanned once and the entries are classified by:
+ * - color hints in the entry name, e.g. "led:rgb_red", "led_g", "blue"
+ * - presence of 'brightness' and 'max_brightness' control files
+ * - presence of blink delay / blink enable control files
+ * - trigger list: entries bound to flash, backlight, storage activity,
+ *   etc triggers are not indicator leds, while availability of the
+ *   "timer" trigger can be used for blinking
+ *
+ * If red, green and blue channels are found, they are used as RGB led.
+ * Otherwise the best single channel found is used as monochrome led.
+ *
+ * This backend is meant for devices that are not explicitly supported
+ * by other backends. The results of the directory scan are made
+ * available also for the main probing logic, so that it can skip
+ * backends whose led class entries do not exist at all.
+ * ========================================================================= */
+
+#include "sysfs-led-auto.h"
+
+#include "sysfs-led-util.h"
+#include "sysfs-led-cache.h"
+#include "sysfs-val.h"
+#include "plugin-logging.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+
+#include <glib.h>
+
+/* ========================================================================= *
+ * TYPES
+ * ========================================================================= */
+
+/** Color classification of led class entries */
+typedef enum
+{
+    AUTO_COLOR_RED,
+    AUTO_COLOR_GREEN,
+    AUTO_COLOR_BLUE,
+    AUTO_COLOR_WHITE,
+    AUTO_COLOR_OTHER,
+    AUTO_COLOR_COUNT
+} led_color_auto_t;
+
+/** Best led class entry found for a color */
+typedef struct
+{
+    char name[256];
+    int  score;
+} led_candidate_auto_t;
+
+/** Led class entry as seen by the directory scan */
+typedef struct
+{
+    char             name[256];
+    led_color_auto_t color;
+    int              score;
+    bool             multicolor;
+} led_entry_auto_t;
+
+typedef struct
+{
+    sysfsval_t *cached_max_brightness;
+    sysfsval_t *cached_brightness;
+    sysfsval_t *cached_blink_delay_on;
+    sysfsval_t *cached_blink_delay_off;
+    sysfsval_t *cached_blink;
+
+    /** Led class directory, for locating timer trigger controls */
+    char       *directory;
+
+    /** Trigger control file, or -1 if timer trigger is not used */
+    int         fd_trigger;
+
+    /** Whether timer trigger is currently selected */
+    bool        timer_active;
+} led_channel_auto_t;
+
+/* ------------------------------------------------------------------------- *
+ * CLASSIFICATION
+ * ------------------------------------------------------------------------- */
+
+static bool             led_auto_has_token         (const char *name, const char * const *tokens);
+static led_color_auto_t led_auto_classify_name     (const char *name);
+static bool             led_auto_read_file         (int dfd, const char *name, const char *file, char *buff, size_t size);
+static bool             led_auto_has_trigger       (const char *triggers, const char *trigger);
+static const char      *led_auto_current_trigger   (char *triggers);
+static int              led_auto_evaluate_entry    (int dfd, const char *name);
+
+/* ------------------------------------------------------------------------- *
+ * SURVEY
+ * ------------------------------------------------------------------------- */
+
+static int              led_auto_survey_compare    (const void *a, const void *b);
+static void             led_auto_survey_scan       (void);
+bool                    led_auto_survey_has_entry  (const char *name);
+const char             *led_auto_survey_multicolor (void);
+void                    led_auto_survey_forget     (void);
+static int              led_auto_scan              (led_candidate_auto_t *best);
+
+/* ------------------------------------------------------------------------- *
+ * ONE_CHANNEL
+ * ------------------------------------------------------------------------- */
+
+static void             led_channel_auto_init      (led_channel_auto_t *self);
+static void             led_channel_auto_close     (led_channel_auto_t *self);
+static bool             led_channel_auto_probe     (led_channel_auto_t *self, const char *name);
+static void             led_channel_auto_set_value (led_channel_auto_t *self, int value);
+static void             led_channel_auto_set_timer (led_channel_auto_t *self, bool enable);
+static void             led_channel_auto_set_blink (led_channel_auto_t *self, int on_ms, int off_ms);
+
+/* ------------------------------------------------------------------------- *
+ * ALL_CHANNELS
+ * ------------------------------------------------------------------------- */
+
+static void             led_control_auto_blink_cb  (void *data, int on_ms, int off_ms);
+static void             led_control_auto_value_cb  (void *data, int r, int g, int b);
+static void             led_control_auto_close_cb  (void *data);
+
+bool                    led_control_auto_probe     (led_control_t *self);
+
+/* ========================================================================= *
+ * CLASSIFICATION
+ * ========================================================================= */
+
+/** Entry name tokens that suggest red color */
+static const char * const led_auto_red_lut[]   = { "red", "r", 0 };
+
+/** Entry name tokens that suggest green color */
+static const char * const led_auto_green_lut[] = { "green", "g", 0 };
+
+/** Entry name tokens that suggest blue color */
+static const char * const led_auto_blue_lut[]  = { "blue", "b", 0 };
+
+/** Entry name tokens that suggest white color */
+static const char * const led_auto_white_lut[] = { "white", "w", 0 };
+
+/** Entry name tokens that suggest monochrome indicator led */
+static const char * const led_auto_other_lut[] =
+{
+    "indicator", "notification", "status", "charging", "led", 0
+};
+
+/** Entry name tokens that rule out use as indicator led */
+static const char * const led_auto_ignore_lut[] =
+{
+    "backlight", "lcd", "wled", "panel", "flash", "torch", "camera",
+    "button", "keyboard", "kbd", "mmc", "vibrator", 0
+};
+
+/** Triggers that rule out use as indicator led
+ *
+ * Matched as substrings of the currently selected trigger, so that
+ * e.g. "battery" covers also "bq27xxx-battery-charging-or-full".
+ */
+static const char * const led_auto_ignore_trigger_lut[] =
+{
+    "backlight", "flash", "torch", "mmc", "disk", "kbd",
+    /* Leds driven by charger / fuel gauge drivers */
+    "battery", "charg", "usb", "bms",
+    /* Leds driven by other kernel subsystems */
+    "default-on", "heartbeat", "cpu", "panic", "netdev", "phy",
+    "rfkill", "bluetooth", "wlan", "audio",
+    0
+};
+
+/** Check if led class entry name contains any of the given tokens
+ *
+ * Tokens are sequences of alphanumeric characters and matching
+ * is done case insensitively.
+ *
+ * @param name    led class entry name
+ * @param tokens  NULL terminated array of lowercase tokens
+ *
+ * @return true if a match is found, false otherwise
+ */
+static bool
+led_auto_has_token(const char *name, const char * const *tokens)
+{
+    char tok[64];
+
+    while( *name ) {
+        size_t len = 0;
+
+        while( *name && !isalnum((unsigned char)*name) )
+            ++name;
+
+        while( isalnum((unsigned char)*name) ) {
+            if( len < sizeof tok - 1 )
+                tok[len++] = tolower((unsigned char)*name);
+            ++name;
+        }
+
+        if( len == 0 )
+            continue;
+
+        tok[len] = 0;
+
+        for( size_t i = 0; tokens[i]; ++i )
+            if( !strcmp(tokens[i], tok) )
+                return true;
+    }
+
+    return false;
+}
+
+/** Classify led class entry by name
+ *
+ * @param name  led class entry name
+ *
+ * @return AUTO_COLOR_RED, ..., or AUTO_COLOR_COUNT if entry should
+ *         not be used as indicator led
+ */
+static led_color_auto_t
+led_auto_classify_name(const char *name)
+{
+    if( led_auto_has_token(name, led_auto_ignore_lut) )
+        return AUTO_COLOR_COUNT;
+
+    if( led_auto_has_token(name, led_auto_red_lut) )
+        return AUTO_COLOR_RED;
+
+    if( led_auto_has_token(name, led_auto_green_lut) )
+        return AUTO_COLOR_GREEN;
+
+    if( led_auto_has_token(name, led_auto_blue_lut) )
+        return AUTO_COLOR_BLUE;
+
+    if( led_auto_has_token(name, led_auto_white_lut) )
+        return AUTO_COLOR_WHITE;
+
+    if( led_auto_has_token(name, led_auto_other_lut) )
+        return AUTO_COLOR_OTHER;
+
+    return AUTO_COLOR_COUNT;
+}
+
+/** Read content of a file within led class entry directory
+ *
+ * @param dfd   led class directory file descriptor
+ * @param name  led class entry name
+ * @param file  control file name
+ * @param buff  buffer to read content to
+ * @param size  size of buff
+ *
+ * @return true if non-empty content was read, false otherwise
+ */
+static bool
+led_auto_read_file(int dfd, const char *name, const char *file,
+                   char *buff, size_t size)
+{
+    bool ack = false;
+    int  fd  = -1;
+    char path[512];
+
+    snprintf(path, sizeof path, "%s/%s", name, file);
+
+    if( (fd = openat(dfd, path, O_RDONLY)) == -1 )
+        goto EXIT;
+
+    ssize_t rc = read(fd, buff, size - 1);
+    if( rc <= 0 )
+        goto EXIT;
+
+    buff[rc] = 0;
+    ack = true;
+
+EXIT:
+    if( fd != -1 )
+        close(fd);
+
+    return ack;
+}
+
+/** Check if trigger is listed in led class trigger file content
+ *
+ * @param triggers  content of trigger file, e.g. "none [timer] mmc0"
+ * @param trigger   trigger name to look for
+ *
+ * @return true if trigger is available, false otherwise
+ */
+static bool
+led_auto_has_trigger(const char *triggers, const char *trigger)
+{
+    size_t len = strlen(trigger);
+
+    for( const char *pos = triggers; (pos = strstr(pos, trigger)); pos += len ) {
+        bool head = (pos == triggers || pos[-1] == ' ' || pos[-1] == '[');
+        bool tail = (!pos[len] || isspace((unsigned char)pos[len]) || pos[len] == ']');
+        if( head && tail )
+            return true;
+    }
+
+    return false;
+}
+
+/** Locate currently selected trigger in led class trigger file content
+ *
+ * Note: Modifies the content of the given buffer.
+ *
+ * @param triggers  content of trigger file, e.g. "none [timer] mmc0"
+ *
+ * @return name of selected trigger, or "none"
+ */
+static const char *
+led_auto_current_trigger(char *triggers)
+{
+    char *beg = strchr(triggers, '[');
+    char *end = beg ? strchr(beg, ']') : 0;
+
+    if( !end )
+        return "none";
+
+    *end = 0;
+    return beg + 1;
+}
+
+/** Evaluate suitability of led class entry for use as indicator led
+ *
+ * @param dfd   led class directory file descriptor
+ * @param name  led class entry name
+ *
+ * @return score value, or zero if entry is not usable
+ */
+static int
+led_auto_evaluate_entry(int dfd, const char *name)
+{
+    int  score = 0;
+    char path[512];
+    char data[512];
+
+    /* Must have writable brightness control */
+    snprintf(path, sizeof path, "%s/brightness", name);
+    if( faccessat(dfd, path, W_OK, 0) == -1 )
+        goto EXIT;
+
+    score += 1;
+
+    /* Entries bound to non-indicator triggers are ignored */
+    if( led_auto_read_file(dfd, name, "trigger", data, sizeof data) ) {
+        if( led_auto_has_trigger(data, "timer") )
+            score += 1;
+
+        const char *curr = led_auto_current_trigger(data);
+        for( size_t i = 0; led_auto_ignore_trigger_lut[i]; ++i ) {
+            if( strstr(curr, led_auto_ignore_trigger_lut[i]) ) {
+                score = 0;
+                goto EXIT;
+            }
+        }
+    }
+
+    /* Prefer entries where scaling can be done */
+    if( led_auto_read_file(dfd, name, "max_brightness", data, sizeof data) &&
+        strtol(data, 0, 0) > 0 )
+        score += 4;
+
+    /* Prefer entries that support hw blinking */
+    snprintf(path, sizeof path, "%s/blink_delay_on", name);
+    if( faccessat(dfd, path, W_OK, 0) == 0 )
+        score += 2;
+
+    snprintf(path, sizeof path, "%s/blink", name);
+    if( faccessat(dfd, path, W_OK, 0) == 0 )
+        score += 1;
+
+EXIT:
+    return score;
+}
+
+/* ========================================================================= *
+ * SURVEY
+ * ========================================================================= */
+
+/** Led class entries found during directory scan, sorted by name */
+static led_entry_auto_t *led_auto_survey_entry = 0;
+
+/** Number of led class entries found during directory scan */
+static size_t            led_auto_survey_count = 0;
+
+/** Whether led class directory has been scanned */
+static bool              led_auto_survey_done  = false;
+
+/** Compare led class entries by name, for qsort()
+ */
+static int
+led_auto_survey_compare(const void *a, const void *b)
+{
+    const led_entry_auto_t *lhs = a;
+    const led_entry_auto_t *rhs = b;
+
+    return strcmp(lhs->name, rhs->name);
+}
+
+/** Scan and classify led class directory entries
+ *
+ * The directory is read only once - subsequent calls return
+ * immediately until led_auto_survey_forget() is called.
+ */
+static void
+led_auto_survey_scan(void)
+{
+    DIR           *dir = 0;
+    struct dirent *de;
+    size_t         size = 0;
+
+    if( led_auto_survey_done )
+        goto EXIT;
+
+    led_auto_survey_done = true;
+
+    if( !(dir = opendir(LED_CACHE_SYSFS_DIRECTORY)) ) {
+        mce_log(LL_DEBUG, "%s: opendir: %m", LED_CACHE_SYSFS_DIRECTORY);
+        goto EXIT;
+    }
+
+    while( (de = readdir(dir)) ) {
+        if( de->d_name[0] == '.' )
+            continue;
+
+        if( led_auto_survey_count == size ) {
+            size_t            want = size ? size * 2 : 16;
+            led_entry_auto_t *temp = realloc(led_auto_survey_entry,
+                                             want * sizeof *temp);
+            if( !temp )
+                break;
+            led_auto_survey_entry = temp, size = want;
+        }
+
+        led_entry_auto_t *entry = led_auto_survey_entry + led_auto_survey_count++;
+        char              path[512];
+
+        snprintf(entry->name, sizeof entry->name, "%s", de->d_name);
+
+        snprintf(path, sizeof path, "%s/multi_index", entry->name);
+        entry->multicolor = (faccessat(dirfd(dir), path, R_OK, 0) == 0);
+
+        entry->color = led_auto_classify_name(entry->name);
+        entry->score = 0;
+        if( entry->color != AUTO_COLOR_COUNT )
+            entry->score = led_auto_evaluate_entry(dirfd(dir), entry->name);
+
+        mce_log(LL_DEBUG, "%s: color=%d score=%d multicolor=%d", entry->name,
+                entry->color, entry->score, entry->multicolor);
+    }
+
+    if( led_auto_survey_count > 1 )
+        qsort(led_auto_survey_entry, led_auto_survey_count,
+              sizeof *led_auto_survey_entry, led_auto_survey_compare);
+
+EXIT:
+    if( dir )
+        closedir(dir);
+
+    return;
+}
+
+/** Check if led class entry exists
+ *
+ * @param name  led class entry name, e.g. "red"
+ *
+ * @return true if entry was seen during directory scan, false otherwise
+ */
+bool
+led_auto_survey_has_entry(const char *name)
+{
+    led_entry_auto_t key;
+
+    led_auto_survey_scan();
+
+    if( !led_auto_survey_count )
+        return false;
+
+    snprintf(key.name, sizeof key.name, "%s", name);
+
+    return bsearch(&key, led_auto_survey_entry, led_auto_survey_count,
+                   sizeof *led_auto_survey_entry,
+                   led_auto_survey_compare) != 0;
+}
+
+/** Locate led class entry that uses multicolor led class
+ *
+ * @return name of the first such entry, or NULL if none exist
+ */
+const char *
+led_auto_survey_multicolor(void)
+{
+    led_auto_survey_scan();
+
+    for( size_t i = 0; i < led_auto_survey_count; ++i ) {
+        if( led_auto_survey_entry[i].multicolor )
+            return led_auto_survey_entry[i].name;
+    }
+
+    return 0;
+}
+
+/** Release led class directory scan results
+ *
+ * Should be called after probing is finished.
+ */
+void
+led_auto_survey_forget(void)
+{
+    free(led_auto_survey_entry);
+    led_auto_survey_entry = 0;
+    led_auto_survey_count = 0;
+    led_auto_survey_done  = false;
+}
+
+/** Pick indicator led candidates from led class directory scan results
+ *
+ * @param best  array of AUTO_COLOR_COUNT candidate slots to fill in
+ *
+ * @return number of usable entries found
+ */
+static int
+led_auto_scan(led_candidate_auto_t *best)
+{
+    int found = 0;
+
+    memset(best, 0, AUTO_COLOR_COUNT * sizeof *best);
+
+    led_auto_survey_scan();
+
+    /* Note: Entries are sorted by name, so on tie the alphabetically
+     *       first entry wins regardless of directory enumeration order */
+    for( size_t i = 0; i < led_auto_survey_count; ++i ) {
+        const led_entry_auto_t *entry = led_auto_survey_entry + i;
+
+        if( entry->color == AUTO_COLOR_COUNT || entry->score <= 0 )
+            continue;
+
+        ++found;
+
+        if( entry->score > best[entry->color].score ) {
+            snprintf(best[entry->color].name, sizeof best[entry->color].name,
+                     "%s", entry->name);
+            best[entry->color].score = entry->score;
+        }
+    }
+
+    return found;
+}
+
+/* ========================================================================= *
+ * ONE_CHANNEL
+ * ========================================================================= */
+
+static void
+led_channel_auto_init(led_channel_auto_t *self)
+{
+    self->cached_max_brightness  = sysfsval_create();
+    self->cached_brightness      = sysfsval_create();
+    self->cached_blink_delay_on  = sysfsval_create();
+    self->cached_blink_delay_off = sysfsval_create();
+    self->cached_blink           = sysfsval_create();
+    self->directory              = 0;
+    self->fd_trigger             = -1;
+    self->timer_active           = false;
+}
+
+static void
+led_channel_auto_close(led_channel_auto_t *self)
+{
+    if( self->timer_active )
+        led_channel_auto_set_timer(self, false);
+
+    sysfsval_delete_at(&self->cached_max_brightness);
+    sysfsval_delete_at(&self->cached_brightness);
+    sysfsval_delete_at(&self->cached_blink_delay_on);
+    sysfsval_delete_at(&self->cached_blink_delay_off);
+    sysfsval_delete_at(&self->cached_blink);
+
+    led_util_close_file(&self->fd_trigger);
+
+    free(self->directory), self->directory = 0;
+}
+
+static bool
+led_channel_auto_probe(led_channel_auto_t *self, const char *name)
+{
+    bool res = false;
+    char path[512];
+    char data[512];
+
+    snprintf(path, sizeof path, "%s/%s", LED_CACHE_SYSFS_DIRECTORY, name);
+    free(self->directory), self->directory = strdup(path);
+
+    snprintf(path, sizeof path, "%s/max_brightness", self->directory);
+    if( sysfsval_open_ro(self->cached_max_brightness, path) )
+        sysfsval_refresh(self->cached_max_brightness);
+
+    /* Without max_brightness assume 8-bit range */
+    if( sysfsval_get(self->cached_max_brightness) <= 0 )
+        sysfsval_assume(self->cached_max_brightness, 255);
+
+    led_util_prepare_gamma(sysfsval_get(self->cached_max_brightness));
+
+    snprintf(path, sizeof path, "%s/brightness", self->directory);
+    if( !sysfsval_open_rw(self->cached_brightness, path) )
+        goto cleanup;
+
+    /* Prefer dedicated blink delay controls ... */
+    bool delays = false;
+
+    snprintf(path, sizeof path, "%s/blink_delay_on", self->directory);
+    if( sysfsval_open_rw(self->cached_blink_delay_on, path) ) {
+        snprintf(path, sizeof path, "%s/blink_delay_off", self->directory);
+        if( sysfsval_open_rw(self->cached_blink_delay_off, path) )
+            delays = true;
+        else
+            sysfsval_close(self->cached_blink_delay_on);
+    }
+
+    snprintf(path, sizeof path, "%s/blink", self->directory);
+    sysfsval_open_rw(self->cached_blink, path);
+
+    /* ... and fall back to using timer trigger */
+    if( !delays ) {
+        if( led_auto_read_file(AT_FDCWD, self->directory, "trigger",
+                               data, sizeof data) &&
+            led_auto_has_trigger(data, "timer") ) {
+            snprintf(path, sizeof path, "%s/trigger", self->directory);
+            led_util_open_file(&self->fd_trigger, path);
+        }
+    }
+
+    mce_log(LL_DEBUG, "%s: max=%d blink=%s", name,
+            sysfsval_get(self->cached_max_brightness),
+            self->fd_trigger != -1 ? "timer" : "delay/none");
+
+    res = true;
+
+cleanup:
+
+    /* Always close the max_brightness file */
+    sysfsval_close(self->cached_max_brightness);
+
+    /* On failure close the other files too */
+    if( !res ) {
+        sysfsval_close(self->cached_brightness);
+        sysfsval_close(self->cached_blink_delay_on);
+        sysfsval_close(self->cached_blink_delay_off);
+        sysfsval_close(self->cached_blink);
+    }
+
+    return res;
+}
+
+static void
+led_channel_auto_set_value(led_channel_auto_t *self, int value)
+{
+    value = led_util_scale_value(value,
+                                 sysfsval_get(self->cached_max_brightness));
+    sysfsval_set(self->cached_brightness, value);
+
+    value = (sysfsval_get(self->cached_blink_delay_on) > 0 &&
+             sysfsval_get(self->cached_blink_delay_off) > 0);
+    sysfsval_set(self->cached_blink, value);
+}
+
+static void
+led_channel_auto_set_timer(led_channel_auto_t *self, bool enable)
+{
+    char path[512];
+
+    if( self->fd_trigger == -1 || self->timer_active == enable )
+        goto EXIT;
+
+    self->timer_active = enable;
+
+    /* Note: Timer specific delay_on/off controls exist only
+     *       while the timer trigger is selected */
+    sysfsval_close(self->cached_blink_delay_on);
+    sysfsval_close(self->cached_blink_delay_off);
+
+    dprintf(self->fd_trigger, "%s", enable ? "timer" : "none");
+
+    if( enable ) {
+        snprintf(path, sizeof path, "%s/delay_on", self->directory);
+        sysfsval_open_rw(self->cached_blink_delay_on, path);
+        snprintf(path, sizeof path, "%s/delay_off", self->directory);
+        sysfsval_open_rw(self->cached_blink_delay_off, path);
+    }
+
+    /* Kernel resets delays when trigger changes */
+    sysfsval_invalidate(self->cached_blink_delay_on);
+    sysfsval_invalidate(self->cached_blink_delay_off);
+
+    /* Changing trigger affects brightness too */
+    sysfsval_invalidate(self->cached_brightness);
+
+EXIT:
+    return;
+}
+
+static void
+led_channel_auto_set_blink(led_channel_auto_t *self, int on_ms, int off_ms)
+{
+    led_channel_auto_set_timer(self, on_ms > 0 && off_ms > 0);
+
+    /* Note: Blinking config is taken in use when brightness
+     *       sysfs is written to -> we need to invalidate
+     *       cached brightness value if blinking changes
+     *       are made.
+     */
+    sysfsval_set(self->cached_blink_delay_on,   on_ms);
+    sysfsval_set(self->cached_blink_delay_off, off_ms);
+    sysfsval_invalidate(self->cached_brightness);
+    sysfsval_invalidate(self->cached_blink);
+}
+
+/* ========================================================================= *
+ * ALL_CHANNELS
+ * ========================================================================= */
+
+#define AUTO_CHANNELS 3
+
+/** Number of channels in use: 3 for RGB, 1 for monochrome */
+static int led_control_auto_channels = 0;
+
+static void
+led_control_auto_blink_cb(void *data, int on_ms, int off_ms)
+{
+    led_channel_auto_t *channel = data;
+
+    for( int i = 0; i < led_control_auto_channels; ++i )
+        led_channel_auto_set_blink(channel + i, on_ms, off_ms);
+}
+
+static void
+led_control_auto_value_cb(void *data, int r, int g, int b)
+{
+    led_channel_auto_t *channel = data;
+
+    if( led_control_auto_channels == AUTO_CHANNELS ) {
+        led_channel_auto_set_value(channel + 0, r);
+        led_channel_auto_set_value(channel + 1, g);
+        led_channel_auto_set_value(channel + 2, b);
+    }
+    else {
+        led_channel_auto_set_value(channel + 0, led_util_max3(r, g, b));
+    }
+}
+
+static void
+led_control_auto_close_cb(void *data)
+{
+    led_channel_auto_t *channel = data;
+
+    for( int i = 0; i < AUTO_CHANNELS; ++i )
+        led_channel_auto_close(channel + i);
+
+    led_control_auto_channels = 0;
+}
+
+static bool
+led_control_auto_discover(led_channel_auto_t *channel)
+{
+    /** Preference order for monochrome led */
+    static const led_color_auto_t mono[] =
+    {
+        AUTO_COLOR_WHITE,
+        AUTO_COLOR_OTHER,
+        AUTO_COLOR_GREEN,
+        AUTO_COLOR_BLUE,
+        AUTO_COLOR_RED,
+    };
+
+    bool                 ack = false;
+    led_candidate_auto_t best[AUTO_COLOR_COUNT];
+
+    if( led_auto_scan(best) <= 0 )
+        goto EXIT;
+
+    if( best[AUTO_COLOR_RED].score > 0 &&
+        best[AUTO_COLOR_GREEN].score > 0 &&
+        best[AUTO_COLOR_BLUE].score > 0 ) {
+        if( led_channel_auto_probe(channel + 0, best[AUTO_COLOR_RED].name) &&
+            led_channel_auto_probe(channel + 1, best[AUTO_COLOR_GREEN].name) &&
+            led_channel_auto_probe(channel + 2, best[AUTO_COLOR_BLUE].name) ) {
+            led_control_auto_channels = 3;
+            ack = true;
+            goto EXIT;
+        }
+        for( int i = 0; i < AUTO_CHANNELS; ++i ) {
+            led_channel_auto_close(channel + i);
+            led_channel_auto_init(channel + i);
+        }
+    }
+
+    for( size_t i = 0; i < G_N_ELEMENTS(mono); ++i ) {
+        if( best[mono[i]].score <= 0 )
+            continue;
+        if( led_channel_auto_probe(channel + 0, best[mono[i]].name) ) {
+            led_control_auto_channels = 1;
+            ack = true;
+            goto EXIT;
+        }
+    }
+
+EXIT:
+    mce_log(LL_DEBUG, "discovered %d channel(s)", led_control_auto_channels);
+
+    return ack;
+}
+
+bool
+led_control_auto_probe(led_control_t *self)
+{
+    static led_channel_auto_t channel[AUTO_CHANNELS];
+
+    bool res = false;
+
+    for( int i = 0; i < AUTO_CHANNELS; ++i )
+        led_channel_auto_init(channel + i);
+
+    self->name   = "auto";
+    self->data   = channel;
+    self->enable = 0;
+    self->blink  = led_control_auto_blink_cb;
+    self->value  = led_control_auto_value_cb;
+    self->close  = led_control_auto_close_cb;
+
+    /* We can use sw breathing logic */
+    self->can_breathe = true;
+
+    /* Note: There is nothing to configure - the whole point
+     *       is to work without device specific configuration */
+    res = led_control_auto_discover(channel);
+
+    if( !res )
+        led_control_close(self);
+
+    return res;
+}
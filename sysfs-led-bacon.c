@@ -126,6 +126,8 @@ led_channel_bacon_probe(led_channel_bacon_t *self,
 
   led_channel_bacon_close(self);
 
+  led_util_prepare_gamma(self->maxval);
+
   if( !led_util_open_file(&self->fd_brightness, path->brightness) ||
       !led_util_open_file(&self->fd_grpfreq, path->grpfreq) ||
       !led_util_open_file(&self->fd_grppwm, path->grppwm) ||
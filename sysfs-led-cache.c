@@ -0,0 +1,245 @@
+/** @file sysfs-led-cache.c
+ *
+ * mce-plugin-libhybris - Libhybris plugin for Mode Control Entity
+ * <p>
+ * Copyright (c) 2026 Jollyboys Ltd.
+ * <p>
+ * @author Simo Piiroinen <simo.piiroinen@jollamobile.com>
+ *
+ * mce-plugin-libhybris is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * mce-plugin-libhybris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with mce-plugin-libhybris; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* ========================================================================= *
+ * Persistent led backend probe cache
+ *
+ * Probing for a suitable led backend means trying out backends one
+ * by one, each of which attempts to open a number of sysfs control
+ * files - most of which do not exist on any given device.
+ *
+ * To avoid repeating the same failing open() calls on every mce
+ * startup, the name of the backend that was found to work is stored
+ * in a cache file together with a fingerprint of the sysfs led class
+ * directory content. On subsequent startups the fingerprint is
+ * re-evaluated with a single directory scan and, if it still matches,
+ * the cached backend is probed first.
+ *
+ * The cache is just a hint: if the cached backend can't be taken in
+ * use, the normal probing sequence is executed and the cache is
+ * updated accordingly.
+ * ========================================================================= */
+
+#include "sysfs-led-cache.h"
+
+#include "plugin-logging.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+/* ========================================================================= *
+ * CONSTANTS
+ * ========================================================================= */
+
+/** Cache file format version; bump if content semantics change */
+#define LED_CACHE_VERSION 1
+
+/* ========================================================================= *
+ * PROTOTYPES
+ * ========================================================================= */
+
+static uint64_t    led_cache_hash_string (const char *str);
+static uint64_t    led_cache_fingerprint (void);
+
+char              *led_cache_lookup      (void);
+void               led_cache_store       (const char *backend);
+
+/* ========================================================================= *
+ * FINGERPRINT
+ * ========================================================================= */
+
+/** Calculate FNV-1a hash for a string
+ *
+ * @param str  c-string
+ *
+ * @return 64-bit hash value
+ */
+static uint64_t
+led_cache_hash_string(const char *str)
+{
+    uint64_t hash = 14695981039346656037ull;
+
+    while( *str )
+        hash = (hash ^ (unsigned char)*str++) * 1099511628211ull;
+
+    return hash;
+}
+
+/** Calculate fingerprint for sysfs led class directory content
+ *
+ * The result does not depend on the order in which directory
+ * entries are enumerated.
+ *
+ * The value is evaluated only once and cached for later use.
+ *
+ * @return fingerprint value, or zero if directory can't be read
+ */
+static uint64_t
+led_cache_fingerprint(void)
+{
+    static bool     done  = false;
+    static uint64_t value = 0;
+
+    if( done )
+        goto EXIT;
+
+    done = true;
+
+    DIR *dir = opendir(LED_CACHE_SYSFS_DIRECTORY);
+    if( !dir ) {
+        mce_log(LL_DEBUG, "%s: opendir: %m", LED_CACHE_SYSFS_DIRECTORY);
+        goto EXIT;
+    }
+
+    uint64_t       sum = 0;
+    uint64_t       cnt = 0;
+    struct dirent *de;
+
+    while( (de = readdir(dir)) ) {
+        if( de->d_name[0] == '.' )
+            continue;
+        sum += led_cache_hash_string(de->d_name);
+        cnt += 1;
+    }
+
+    closedir(dir);
+
+    /* Mix in entry count; zero is reserved for "not available" */
+    value = (sum ^ (cnt * 0x9e3779b97f4a7c15ull)) ?: 1;
+
+    mce_log(LL_DEBUG, "%s: %llu entries, fingerprint %016llx",
+            LED_CACHE_SYSFS_DIRECTORY,
+            (unsigned long long)cnt, (unsigned long long)value);
+
+EXIT:
+    return value;
+}
+
+/* ========================================================================= *
+ * CACHE_FILE
+ * ========================================================================= */
+
+/** Get name of the led backend cached for current sysfs content
+ *
+ * @return backend name to be released with free(), or NULL
+ */
+char *
+led_cache_lookup(void)
+{
+    char     *res  = 0;
+    FILE     *file = 0;
+    uint64_t  key  = led_cache_fingerprint();
+
+    if( !key )
+        goto EXIT;
+
+    if( !(file = fopen(LED_CACHE_FILE, "r")) ) {
+        if( errno != ENOENT )
+            mce_log(LL_WARN, "%s: open: %m", LED_CACHE_FILE);
+        goto EXIT;
+    }
+
+    int                vers = 0;
+    unsigned long long hash = 0;
+    char               name[64];
+
+    if( fscanf(file, "%d %llx %63s", &vers, &hash, name) != 3 ) {
+        mce_log(LL_WARN, "%s: parse error", LED_CACHE_FILE);
+        goto EXIT;
+    }
+
+    if( vers != LED_CACHE_VERSION || hash != key ) {
+        mce_log(LL_DEBUG, "%s: stale", LED_CACHE_FILE);
+        goto EXIT;
+    }
+
+    res = strdup(name);
+
+EXIT:
+    if( file )
+        fclose(file);
+
+    mce_log(LL_DEBUG, "cached backend: %s", res ?: "N/A");
+
+    return res;
+}
+
+/** Store name of the led backend to use with current sysfs content
+ *
+ * The cache file is replaced atomically so that concurrent or
+ * interrupted updates can't leave behind partial content.
+ *
+ * @param backend  backend name, or NULL to invalidate cache
+ */
+void
+led_cache_store(const char *backend)
+{
+    static const char temp[] = LED_CACHE_FILE ".tmp";
+
+    FILE     *file = 0;
+    uint64_t  key  = led_cache_fingerprint();
+
+    if( !backend || !key ) {
+        if( unlink(LED_CACHE_FILE) == -1 && errno != ENOENT )
+            mce_log(LL_WARN, "%s: unlink: %m", LED_CACHE_FILE);
+        goto EXIT;
+    }
+
+    if( mkdir(LED_CACHE_DIRECTORY, 0755) == -1 && errno != EEXIST ) {
+        mce_log(LL_WARN, "%s: mkdir: %m", LED_CACHE_DIRECTORY);
+        goto EXIT;
+    }
+
+    if( !(file = fopen(temp, "w")) ) {
+        mce_log(LL_WARN, "%s: open: %m", temp);
+        goto EXIT;
+    }
+
+    fprintf(file, "%d %016llx %s\n", LED_CACHE_VERSION,
+            (unsigned long long)key, backend);
+
+    if( fclose(file) == EOF ) {
+        mce_log(LL_WARN, "%s: close: %m", temp);
+        unlink(temp);
+    }
+    else if( rename(temp, LED_CACHE_FILE) == -1 ) {
+        mce_log(LL_WARN, "%s: rename: %m", temp);
+        unlink(temp);
+    }
+    else {
+        mce_log(LL_DEBUG, "cached backend: %s", backend);
+    }
+
+    file = 0;
+
+EXIT:
+    if( file )
+        fclose(file);
+}
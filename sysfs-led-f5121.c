@@ -144,6 +144,8 @@ led_channel_f5121_probe(led_channel_f5121_t *self,
     if( !sysfsval_open_rw(self->cached_brightness, path->brightness) )
         goto cleanup;
 
+    led_util_prepare_gamma(sysfsval_get(self->cached_max_brightness));
+
     ack = true;
 
 cleanup:
@@ -0,0 +1,654 @@
+/** @file sysfs-led-generic.c
+ *
+ * mce-plugin-libhybris - Libhybris plugin for Mode Control Entity
+ * <p>
+ * Copyright (c) 2026 Jollyboys Ltd.
+ * <p>
+ * @author Simo Piiroinen <simo.piiroinen@jollamobile.com>
+ *
+ * mce-plugin-libhybris is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * mce-plugin-libhybris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with mce-plugin-libhybris; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* ========================================================================= *
+ * Generic led control: topology described in configuration
+ *
+ * One to GENERIC_MAX_CHANNELS channels, each of which:
+ * - must have 'brightness' control file
+ * - can have 'max_brightness' control file
+ * - can have blink controls matching the configured blink method
+ *
+ * Plus optionally a master power control file that is enabled
+ * while any of the channels is lit.
+ *
+ * Nothing is hardcoded - the backend is usable only when explicitly
+ * selected via BackEnd=generic and all details are taken from the
+ * LEDConfigHybris configuration group:
+ *
+ *   Channels=Red,Green,Blue      channel names / config key prefixes
+ *   BlinkMethod=none|delay|timer how hw blinking is done
+ *   WriteOrder=config|off-first  order of brightness writes
+ *   PowerFile=/path              optional master power toggle
+ *   PowerOnValue=1               value written to enable power
+ *   PowerOffValue=0              value written to disable power
+ *
+ * Per channel settings, looked up as <CHANNEL><KEY> first and then
+ * as plain <KEY>:
+ *
+ *   Source=red|green|blue|max    which rgb component drives channel
+ *   Map=linear|binary            how 0-255 value maps to brightness
+ *   OnValue=N / OffValue=N       brightness values for binary map
+ *
+ * Control files are configured as in other backends, i.e. via
+ * <CHANNEL>Directory and/or <CHANNEL><FILE>File keys.
+ *
+ * Assumptions built into code:
+ *
+ * - Sysfs writes are done via sysfsval_t -> values that do not change
+ *   are not written at all.
+ *
+ * - With "off-first" write order channels that are dimmed are written
+ *   before channels that are brightened, so that transient states do
+ *   not have more channels lit than either the old or the new color.
+ * ========================================================================= */
+
+#include "sysfs-led-generic.h"
+
+#include "sysfs-led-util.h"
+#include "sysfs-val.h"
+#include "plugin-config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+/* ========================================================================= *
+ * PROTOTYPES
+ * ========================================================================= */
+
+/** Maximum number of configurable channels */
+#define GENERIC_MAX_CHANNELS 4
+
+/** How hw blinking is done */
+typedef enum
+{
+    /** No hw blinking, rely on sw breathing */
+    GENERIC_BLINK_NONE,
+
+    /** Per channel blink_delay_on/off + optional blink enable file */
+    GENERIC_BLINK_DELAY,
+
+    /** Per channel "timer" trigger + delay_on/off files */
+    GENERIC_BLINK_TIMER,
+} led_blink_generic_t;
+
+/** Which rgb component drives a channel */
+typedef enum
+{
+    GENERIC_SOURCE_RED,
+    GENERIC_SOURCE_GREEN,
+    GENERIC_SOURCE_BLUE,
+    GENERIC_SOURCE_MAX,
+} led_source_generic_t;
+
+/** How 0-255 values are mapped to brightness */
+typedef enum
+{
+    GENERIC_MAP_LINEAR,
+    GENERIC_MAP_BINARY,
+} led_map_generic_t;
+
+typedef struct
+{
+    const char *brightness;      // W
+    const char *max_brightness;  // R
+    const char *blink_delay_on;  // W
+    const char *blink_delay_off; // W
+    const char *blink;           // W
+    const char *trigger;         // W
+    const char *delay_on;        // W
+    const char *delay_off;       // W
+
+    const char *source;
+    const char *map;
+    const char *on_string;
+    const char *off_string;
+} led_paths_generic_t;
+
+typedef struct
+{
+    sysfsval_t           *cached_max_brightness;
+    sysfsval_t           *cached_brightness;
+    sysfsval_t           *cached_delay_on;
+    sysfsval_t           *cached_delay_off;
+    sysfsval_t           *cached_blink;
+
+    int                   fd_trigger;
+    bool                  timer_active;
+    char                 *delay_on_path;
+    char                 *delay_off_path;
+
+    led_source_generic_t  source;
+    led_map_generic_t     map;
+    int                   on_value;
+    int                   off_value;
+} led_channel_generic_t;
+
+typedef struct
+{
+    int                   channels;
+    led_channel_generic_t channel[GENERIC_MAX_CHANNELS];
+
+    led_blink_generic_t   blink;
+    bool                  off_first;
+
+    sysfsval_t           *cached_power;
+    int                   power_on;
+    int                   power_off;
+} led_state_generic_t;
+
+/* ------------------------------------------------------------------------- *
+ * ONE_CHANNEL
+ * ------------------------------------------------------------------------- */
+
+static void        led_channel_generic_init          (led_channel_generic_t *self);
+static void        led_channel_generic_close         (led_channel_generic_t *self);
+static bool        led_channel_generic_probe         (led_channel_generic_t *self, const led_paths_generic_t *path, led_blink_generic_t blink);
+static int         led_channel_generic_map_value     (const led_channel_generic_t *self, int r, int g, int b);
+static void        led_channel_generic_set_value     (led_channel_generic_t *self, int value, led_blink_generic_t blink);
+static void        led_channel_generic_set_timer     (led_channel_generic_t *self, bool enable);
+static void        led_channel_generic_set_blink     (led_channel_generic_t *self, int on_ms, int off_ms, led_blink_generic_t blink);
+
+/* ------------------------------------------------------------------------- *
+ * ALL_CHANNELS
+ * ------------------------------------------------------------------------- */
+
+static void        led_control_generic_blink_cb      (void *data, int on_ms, int off_ms);
+static void        led_control_generic_value_cb      (void *data, int r, int g, int b);
+static void        led_control_generic_close_cb      (void *data);
+static int         led_control_generic_parse_int     (const char *key, int def);
+static bool        led_control_generic_parse_global  (led_state_generic_t *state, char ***names);
+static bool        led_control_generic_dynamic_probe (led_state_generic_t *state);
+
+bool               led_control_generic_probe         (led_control_t *self);
+
+/* ========================================================================= *
+ * ONE_CHANNEL
+ * ========================================================================= */
+
+static void
+led_channel_generic_init(led_channel_generic_t *self)
+{
+    self->cached_max_brightness = sysfsval_create();
+    self->cached_brightness     = sysfsval_create();
+    self->cached_delay_on       = sysfsval_create();
+    self->cached_delay_off      = sysfsval_create();
+    self->cached_blink          = sysfsval_create();
+
+    self->fd_trigger            = -1;
+    self->timer_active          = false;
+    self->delay_on_path         = 0;
+    self->delay_off_path        = 0;
+
+    self->source                = GENERIC_SOURCE_MAX;
+    self->map                   = GENERIC_MAP_LINEAR;
+    self->on_value              = 0;
+    self->off_value             = 0;
+}
+
+static void
+led_channel_generic_close(led_channel_generic_t *self)
+{
+    if( self->timer_active )
+        led_channel_generic_set_timer(self, false);
+
+    sysfsval_delete_at(&self->cached_max_brightness);
+    sysfsval_delete_at(&self->cached_brightness);
+    sysfsval_delete_at(&self->cached_delay_on);
+    sysfsval_delete_at(&self->cached_delay_off);
+    sysfsval_delete_at(&self->cached_blink);
+
+    led_util_close_file(&self->fd_trigger);
+
+    free(self->delay_on_path),  self->delay_on_path  = 0;
+    free(self->delay_off_path), self->delay_off_path = 0;
+}
+
+static bool
+led_channel_generic_probe(led_channel_generic_t *self,
+                          const led_paths_generic_t *path,
+                          led_blink_generic_t blink)
+{
+    bool res = false;
+
+    /* Value mapping */
+    if( !g_strcmp0(path->source, "red") )
+        self->source = GENERIC_SOURCE_RED;
+    else if( !g_strcmp0(path->source, "green") )
+        self->source = GENERIC_SOURCE_GREEN;
+    else if( !g_strcmp0(path->source, "blue") )
+        self->source = GENERIC_SOURCE_BLUE;
+    else
+        self->source = GENERIC_SOURCE_MAX;
+
+    if( !g_strcmp0(path->map, "binary") )
+        self->map = GENERIC_MAP_BINARY;
+    else
+        self->map = GENERIC_MAP_LINEAR;
+
+    // we always must have brightness control
+    if( !sysfsval_open_rw(self->cached_brightness, path->brightness) )
+        goto cleanup;
+
+    if( sysfsval_open_ro(self->cached_max_brightness, path->max_brightness) )
+        sysfsval_refresh(self->cached_max_brightness);
+
+    if( sysfsval_get(self->cached_max_brightness) <= 0 )
+        sysfsval_assume(self->cached_max_brightness, 255);
+
+    led_util_prepare_gamma(sysfsval_get(self->cached_max_brightness));
+
+    self->off_value = path->off_string ? strtol(path->off_string, 0, 0) : 0;
+    self->on_value  = (path->on_string ? strtol(path->on_string, 0, 0) :
+                       sysfsval_get(self->cached_max_brightness));
+
+    // blink controls are needed only for configured method
+    switch( blink ) {
+    case GENERIC_BLINK_DELAY:
+        if( !sysfsval_open_rw(self->cached_delay_on,  path->blink_delay_on) ||
+            !sysfsval_open_rw(self->cached_delay_off, path->blink_delay_off) )
+            goto cleanup;
+
+        // having "blink" control file is optional
+        sysfsval_open_rw(self->cached_blink, path->blink);
+        break;
+
+    case GENERIC_BLINK_TIMER:
+        if( !path->delay_on || !path->delay_off )
+            goto cleanup;
+
+        if( !led_util_open_file(&self->fd_trigger, path->trigger) )
+            goto cleanup;
+
+        self->delay_on_path  = strdup(path->delay_on);
+        self->delay_off_path = strdup(path->delay_off);
+        break;
+
+    default:
+        break;
+    }
+
+    mce_log(LL_DEBUG, "source=%d map=%d on_value=%d off_value=%d",
+            self->source, self->map, self->on_value, self->off_value);
+
+    res = true;
+
+cleanup:
+
+    /* Always close the max_brightness file */
+    sysfsval_close(self->cached_max_brightness);
+
+    /* On failure close the other files too */
+    if( !res ) {
+        sysfsval_close(self->cached_brightness);
+        sysfsval_close(self->cached_delay_on);
+        sysfsval_close(self->cached_delay_off);
+        sysfsval_close(self->cached_blink);
+        led_util_close_file(&self->fd_trigger);
+    }
+
+    return res;
+}
+
+static int
+led_channel_generic_map_value(const led_channel_generic_t *self,
+                              int r, int g, int b)
+{
+    int value = 0;
+
+    switch( self->source ) {
+    case GENERIC_SOURCE_RED:   value = r; break;
+    case GENERIC_SOURCE_GREEN: value = g; break;
+    case GENERIC_SOURCE_BLUE:  value = b; break;
+    default:                   value = led_util_max3(r, g, b); break;
+    }
+
+    if( self->map == GENERIC_MAP_BINARY )
+        value = value ? self->on_value : self->off_value;
+    else
+        value = led_util_scale_value(value,
+                                     sysfsval_get(self->cached_max_brightness));
+    return value;
+}
+
+static void
+led_channel_generic_set_value(led_channel_generic_t *self, int value,
+                              led_blink_generic_t blink)
+{
+    sysfsval_set(self->cached_brightness, value);
+
+    /* Note: Blinking enabled/disabled needs to happen
+     *       after the brightness has been set
+     */
+    if( blink == GENERIC_BLINK_DELAY ) {
+        value = (sysfsval_get(self->cached_delay_on) &&
+                 sysfsval_get(self->cached_delay_off));
+        sysfsval_set(self->cached_blink, value);
+    }
+}
+
+static void
+led_channel_generic_set_timer(led_channel_generic_t *self, bool enable)
+{
+    if( self->fd_trigger == -1 || self->timer_active == enable )
+        goto EXIT;
+
+    self->timer_active = enable;
+
+    /* Note: Timer specific delay_on/off controls exist only
+     *       while the timer trigger is selected */
+    sysfsval_close(self->cached_delay_on);
+    sysfsval_close(self->cached_delay_off);
+
+    dprintf(self->fd_trigger, "%s", enable ? "timer" : "none");
+
+    if( enable ) {
+        sysfsval_open_rw(self->cached_delay_on,  self->delay_on_path);
+        sysfsval_open_rw(self->cached_delay_off, self->delay_off_path);
+    }
+
+    /* Kernel resets delays when trigger changes */
+    sysfsval_invalidate(self->cached_delay_on);
+    sysfsval_invalidate(self->cached_delay_off);
+
+EXIT:
+    return;
+}
+
+static void
+led_channel_generic_set_blink(led_channel_generic_t *self,
+                              int on_ms, int off_ms,
+                              led_blink_generic_t blink)
+{
+    switch( blink ) {
+    case GENERIC_BLINK_DELAY:
+        sysfsval_set(self->cached_delay_on,  on_ms);
+        sysfsval_set(self->cached_delay_off, off_ms);
+
+        /* Blinking config is taken in use when brightness
+         * sysfs is written to */
+        sysfsval_invalidate(self->cached_brightness);
+        sysfsval_invalidate(self->cached_blink);
+        break;
+
+    case GENERIC_BLINK_TIMER:
+        led_channel_generic_set_timer(self, on_ms > 0 && off_ms > 0);
+        sysfsval_set(self->cached_delay_on,  on_ms);
+        sysfsval_set(self->cached_delay_off, off_ms);
+
+        /* Changing trigger can turn the led off */
+        sysfsval_invalidate(self->cached_brightness);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/* ========================================================================= *
+ * ALL_CHANNELS
+ * ========================================================================= */
+
+static void
+led_control_generic_blink_cb(void *data, int on_ms, int off_ms)
+{
+    led_state_generic_t *state = data;
+
+    for( int i = 0; i < state->channels; ++i )
+        led_channel_generic_set_blink(state->channel + i, on_ms, off_ms,
+                                      state->blink);
+}
+
+static void
+led_control_generic_value_cb(void *data, int r, int g, int b)
+{
+    led_state_generic_t *state = data;
+
+    int  value[GENERIC_MAX_CHANNELS];
+    bool power = false;
+
+    for( int i = 0; i < state->channels; ++i ) {
+        value[i] = led_channel_generic_map_value(state->channel + i, r, g, b);
+        if( value[i] != state->channel[i].off_value )
+            power = true;
+    }
+
+    /* Power up before channels are lit */
+    if( power )
+        sysfsval_set(state->cached_power, state->power_on);
+
+    /* Pass 0: dimmed channels, if off-first ordering is used
+     * Pass 1: remaining channels in configuration order */
+    for( int pass = state->off_first ? 0 : 1; pass < 2; ++pass ) {
+        for( int i = 0; i < state->channels; ++i ) {
+            led_channel_generic_t *channel = state->channel + i;
+            bool dimmed = value[i] < sysfsval_get(channel->cached_brightness);
+
+            if( pass == 0 && !dimmed )
+                continue;
+
+            if( pass == 1 && state->off_first && dimmed )
+                continue;
+
+            led_channel_generic_set_value(channel, value[i], state->blink);
+        }
+    }
+
+    /* Power down after channels are dark */
+    if( !power )
+        sysfsval_set(state->cached_power, state->power_off);
+}
+
+static void
+led_control_generic_close_cb(void *data)
+{
+    led_state_generic_t *state = data;
+
+    for( int i = 0; i < GENERIC_MAX_CHANNELS; ++i )
+        led_channel_generic_close(state->channel + i);
+
+    sysfsval_delete_at(&state->cached_power);
+    state->channels = 0;
+}
+
+static int
+led_control_generic_parse_int(const char *key, int def)
+{
+    gchar *str = plugin_config_get_string(MCE_CONF_LED_CONFIG_HYBRIS_GROUP,
+                                          key, 0);
+    int    res = str ? strtol(str, 0, 0) : def;
+    g_free(str);
+    return res;
+}
+
+static bool
+led_control_generic_parse_global(led_state_generic_t *state, char ***names)
+{
+    bool   ack    = false;
+    gchar *str    = 0;
+    gchar *blink  = 0;
+    gchar *order  = 0;
+    gchar *power  = 0;
+
+    str = plugin_config_get_string(MCE_CONF_LED_CONFIG_HYBRIS_GROUP,
+                                   "Channels", 0);
+    if( !str )
+        goto EXIT;
+
+    *names = g_strsplit(str, ",", GENERIC_MAX_CHANNELS + 1);
+
+    state->channels = 0;
+    for( char **pos = *names; *pos; ++pos ) {
+        g_strstrip(*pos);
+        if( ++state->channels > GENERIC_MAX_CHANNELS ) {
+            mce_log(LL_WARN, "more than %d channels configured",
+                    GENERIC_MAX_CHANNELS);
+            goto EXIT;
+        }
+    }
+
+    if( state->channels < 1 )
+        goto EXIT;
+
+    blink = plugin_config_get_string(MCE_CONF_LED_CONFIG_HYBRIS_GROUP,
+                                     "BlinkMethod", "none");
+    if( !strcmp(blink, "delay") )
+        state->blink = GENERIC_BLINK_DELAY;
+    else if( !strcmp(blink, "timer") )
+        state->blink = GENERIC_BLINK_TIMER;
+    else
+        state->blink = GENERIC_BLINK_NONE;
+
+    order = plugin_config_get_string(MCE_CONF_LED_CONFIG_HYBRIS_GROUP,
+                                     "WriteOrder", "config");
+    state->off_first = !strcmp(order, "off-first");
+
+    power = plugin_config_get_string(MCE_CONF_LED_CONFIG_HYBRIS_GROUP,
+                                     "PowerFile", 0);
+    if( power ) {
+        if( !sysfsval_open_rw(state->cached_power, power) )
+            goto EXIT;
+
+        state->power_on  = led_control_generic_parse_int("PowerOnValue",  1);
+        state->power_off = led_control_generic_parse_int("PowerOffValue", 0);
+    }
+
+    ack = true;
+
+EXIT:
+    g_free(power);
+    g_free(order);
+    g_free(blink);
+    g_free(str);
+
+    return ack;
+}
+
+static bool
+led_control_generic_dynamic_probe(led_state_generic_t *state)
+{
+    static const objconf_t generic_conf[] =
+    {
+        OBJCONF_FILE(led_paths_generic_t, brightness,      Brightness),
+        OBJCONF_FILE(led_paths_generic_t, max_brightness,  MaxBrightness),
+        OBJCONF_FILE(led_paths_generic_t, blink_delay_on,  BlinkDelayOn),
+        OBJCONF_FILE(led_paths_generic_t, blink_delay_off, BlinkDelayOff),
+        OBJCONF_FILE(led_paths_generic_t, blink,           Blink),
+        OBJCONF_FILE(led_paths_generic_t, trigger,         Trigger),
+        OBJCONF_FILE(led_paths_generic_t, delay_on,        DelayOn),
+        OBJCONF_FILE(led_paths_generic_t, delay_off,       DelayOff),
+
+        OBJCONF_STRING(led_paths_generic_t, source,     Source,   0),
+        OBJCONF_STRING(led_paths_generic_t, map,        Map,      0),
+        OBJCONF_STRING(led_paths_generic_t, on_string,  OnValue,  0),
+        OBJCONF_STRING(led_paths_generic_t, off_string, OffValue, 0),
+
+        OBJCONF_STOP
+    };
+
+    bool   ack   = false;
+    char **names = 0;
+
+    led_paths_generic_t paths[GENERIC_MAX_CHANNELS];
+
+    memset(paths, 0, sizeof paths);
+    for( size_t i = 0; i < GENERIC_MAX_CHANNELS; ++i )
+        objconf_init(generic_conf, &paths[i]);
+
+    if( !led_control_generic_parse_global(state, &names) )
+        goto cleanup;
+
+    for( int i = 0; i < state->channels; ++i ) {
+        if( !objconf_parse(generic_conf, &paths[i], names[i]) )
+            goto cleanup;
+
+        /* Default source: channel name, if it is a color */
+        if( !paths[i].source ) {
+            gchar *lc = g_ascii_strdown(names[i], -1);
+            paths[i].source = strdup(lc);
+            g_free(lc);
+        }
+
+        if( !led_channel_generic_probe(state->channel + i, &paths[i],
+                                       state->blink) )
+            goto cleanup;
+    }
+
+    ack = true;
+
+cleanup:
+
+    for( size_t i = 0; i < GENERIC_MAX_CHANNELS; ++i )
+        objconf_quit(generic_conf, &paths[i]);
+
+    g_strfreev(names);
+
+    return ack;
+}
+
+bool
+led_control_generic_probe(led_control_t *self)
+{
+    static led_state_generic_t state;
+
+    bool res = false;
+
+    for( int i = 0; i < GENERIC_MAX_CHANNELS; ++i )
+        led_channel_generic_init(state.channel + i);
+    state.cached_power = sysfsval_create();
+    state.channels     = 0;
+
+    self->name   = "generic";
+    self->data   = &state;
+    self->enable = 0;
+    self->blink  = 0;
+    self->value  = led_control_generic_value_cb;
+    self->close  = led_control_generic_close_cb;
+
+    /* There is nothing to probe without configuration */
+    if( self->use_config )
+        res = led_control_generic_dynamic_probe(&state);
+
+    if( !res ) {
+        led_control_close(self);
+        goto EXIT;
+    }
+
+    if( state.blink != GENERIC_BLINK_NONE )
+        self->blink = led_control_generic_blink_cb;
+
+    /* We can use sw breathing logic, but binary on/off
+     * channels can't do anything but hard steps */
+    self->can_breathe = true;
+    for( int i = 0; i < state.channels; ++i ) {
+        if( state.channel[i].map == GENERIC_MAP_BINARY )
+            self->breath_type = LED_RAMP_HARD_STEP;
+    }
+
+EXIT:
+    return res;
+}
@@ -124,6 +124,8 @@ led_channel_hammerhead_probe(led_channel_hammerhead_t *self,
     goto cleanup;
   }
 
+  led_util_prepare_gamma(self->cached_max_brightness);
+
   if( !led_util_open_file(&self->fd_brightness,    path->brightness)    ||
       !led_util_open_file(&self->fd_on_off_ms, path->on_off_ms) ||
       !led_util_open_file(&self->fd_rgb_start, path->rgb_start) )
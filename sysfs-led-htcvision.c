@@ -128,6 +128,8 @@ led_channel_htcvision_probe(led_channel_htcvision_t *self,
   if( sysfsval_get(self->cached_max_brightness) <= 0 )
     sysfsval_assume(self->cached_max_brightness, 1);
 
+  led_util_prepare_gamma(sysfsval_get(self->cached_max_brightness));
+
   res = true;
 
 cleanup:
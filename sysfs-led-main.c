@@ -25,6 +25,7 @@
 #include "sysfs-led-main.h"
 
 #include "sysfs-led-util.h"
+#include "sysfs-led-cache.h"
 #include "sysfs-led-vanilla.h"
 #include "sysfs-led-hammerhead.h"
 #include "sysfs-led-bacon.h"
@@ -35,12 +36,16 @@
 #include "sysfs-led-white.h"
 #include "sysfs-led-mind2-v1.h"
 #include "sysfs-led-mind2-v2.h"
+#include "sysfs-led-multicolor.h"
+#include "sysfs-led-generic.h"
+#include "sysfs-led-auto.h"
 
 #include "plugin-logging.h"
 #include "plugin-config.h"
 #include "plugin-quirks.h"
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <math.h>
@@ -82,6 +87,7 @@ static void        led_control_init                  (led_control_t *self);
 static bool        led_control_can_breathe           (const led_control_t *self);
 static led_ramp_t  led_control_breath_type           (const led_control_t *self);
 
+static bool        led_control_is_plausible          (const char *entries);
 static bool        led_control_probe                 (led_control_t *self);
 void               led_control_close                 (led_control_t *self);
 
@@ -148,6 +154,9 @@ void               sysfs_led_quit                    (void);
 
 bool               sysfs_led_set_pattern             (int r, int g, int b, int ms_on, int ms_off);
 bool               sysfs_led_can_breathe             (void);
+const char        *sysfs_led_get_backend             (void);
+led_ramp_t         sysfs_led_get_breath_type         (void);
+bool               sysfs_led_can_blink               (void);
 void               sysfs_led_set_breathing           (bool enable);
 void               sysfs_led_set_brightness          (int level);
 
@@ -253,7 +262,46 @@ led_control_breath_type(const led_control_t *self)
   return self->can_breathe ? self->breath_type : LED_RAMP_DISABLED;
 }
 
+/** Check if led class entries used by a backend exist
+ *
+ * @param entries  space separated list of alternative led class entry
+ *                 names, or NULL if backend can't be ruled out by name
+ *
+ * @return true if at least one of the entries exists, false otherwise
+ */
+static bool
+led_control_is_plausible(const char *entries)
+{
+  bool ack = true;
+
+  if( !entries )
+    goto EXIT;
+
+  ack = false;
+
+  for( const char *pos = entries; !ack && *pos; ) {
+    char   name[64];
+    size_t len = strcspn(pos, " ");
+
+    if( len > 0 && len < sizeof name ) {
+      memcpy(name, pos, len), name[len] = 0;
+      ack = led_auto_survey_has_entry(name);
+    }
+
+    pos += len;
+    pos += strspn(pos, " ");
+  }
+
+EXIT:
+  return ack;
+}
+
 /** Probe sysfs for RGB LED controls
+ *
+ * Unless the backend is configured or known from previous startup,
+ * the led class directory is scanned once and backends whose static
+ * control paths refer to non-existing led class entries are skipped
+ * without probing.
  *
  * @param self control object
  *
@@ -271,89 +319,149 @@ led_control_probe(led_control_t *self)
   {
     const char          *name;
     led_control_probe_fn func;
+    const char          *entries;
   } lut[] =
   {
+    /* The multicolor backend requires presense of
+     * unique 'multi_index' and 'multi_intensity' files. */
+    { "multicolor", led_control_multicolor_probe, 0 },
+
     /* The hammerhead backend requires presense of
      * unique 'on_off_ms' and 'rgb_start' files. */
-    { "hammerhead", led_control_hammerhead_probe },
+    { "hammerhead", led_control_hammerhead_probe, "red" },
 
     /* The htc vision backend requires presense of
      * unique 'amber' control directory. */
-    { "htcvision", led_control_htcvision_probe },
+    { "htcvision", led_control_htcvision_probe, "amber" },
 
     /* The bacon backend  */
-    { "bacon", led_control_bacon_probe },
+    { "bacon", led_control_bacon_probe, "red" },
 
     /* The f5121 requires  'brightness', 'max_brightness' and 'blink'
      * control files to be present for red, green and blue channels. */
-    { "f5121", led_control_f5121_probe },
+    { "f5121", led_control_f5121_probe, "led:rgb_red red" },
 
     /* The vanilla backend requires only 'brightness'
      * control file, but still needs three directories
      * to be present for red, green and blue channels. */
-    { "vanilla", led_control_vanilla_probe },
+    { "vanilla", led_control_vanilla_probe, "led:rgb_red led_r lm3533-red red" },
 
     /* The redgreen uses subset of "standard" rgb led
      * control paths, so to avoid false positive matches
      * it must be probed after rgb led controls. */
-    { "redgreen", led_control_redgreen_probe },
+    { "redgreen", led_control_redgreen_probe, "red" },
 
     /* Single control channel with actually working
      * brightness control and max_brightness. */
-    { "white", led_control_white_probe },
+    { "white", led_control_white_probe, "white" },
 
     /* The binary backend needs just one directory
      * that has 'brightness' control file. */
-    { "binary", led_control_binary_probe },
+    { "binary", led_control_binary_probe, "button-backlight" },
 
     /* Arrangement of two rgb leds
      *    with 0/1 red, green, blue color selection
      *    and 0-N brightness control
      * plus master power toggle governing both leds. */
-    { "mind2v1", led_control_mind2v1_probe },
+    { "mind2v1", led_control_mind2v1_probe, "Power" },
 
     /* Arrangement of two rgb leds
      *    with 0-N red, green, blue color selection
      * plus master power toggle governing both leds. */
-    { "mind2v2", led_control_mind2v2_probe },
+    { "mind2v2", led_control_mind2v2_probe, "Led" },
+
+    /* Topology described entirely in configuration,
+     * usable only when explicitly selected. */
+    { "generic", led_control_generic_probe, 0 },
+
+    /* Discovery based on led class directory scan, for
+     * devices not covered by any of the above. Must be
+     * probed last as it accepts pretty much anything. */
+    { "auto", led_control_auto_probe, 0 },
   };
 
-  bool   ack  = false;
-  gchar *name = plugin_config_get_string(MCE_CONF_LED_CONFIG_HYBRIS_GROUP,
-                                         MCE_CONF_LED_CONFIG_HYBRIS_BACKEND,
-                                         0);
+  bool        ack    = false;
+  const char *winner = 0;
+  char       *hint   = 0;
+  gchar      *name   = plugin_config_get_string(MCE_CONF_LED_CONFIG_HYBRIS_GROUP,
+                                                MCE_CONF_LED_CONFIG_HYBRIS_BACKEND,
+                                                0);
+
+  /* Explicitly configured backend overrides cached probe results */
+  if( !name )
+    hint = led_cache_lookup();
 
-  for( size_t i = 0; i < G_N_ELEMENTS(lut); ++i )
+  /* Pass 0: try backend that was found to work on previous startup
+   * Pass 1: try all backends in order of preference */
+  for( int pass = hint ? 0 : 1; !ack && pass < 2; ++pass )
   {
-    led_control_close(self);
+    for( size_t i = 0; i < G_N_ELEMENTS(lut); ++i )
+    {
+      led_control_close(self);
 
-    if( name ) {
-      if( strcmp(lut[i].name, name) ) {
+      if( pass == 0 ) {
+        if( strcmp(lut[i].name, hint) ) {
+          continue;
+        }
+      }
+      else if( hint && !strcmp(lut[i].name, hint) ) {
+        /* Already tried and failed during pass 0 */
         continue;
       }
 
-      self->use_config = true;
-    }
+      if( name ) {
+        if( strcmp(lut[i].name, name) ) {
+          continue;
+        }
 
-    if( name && strcmp(lut[i].name, name) )
-    {
-      continue;
-    }
+        self->use_config = true;
+      }
 
-    mce_log(LL_DEBUG, "probing sysfs led backend: %s", lut[i].name);
+      if( name && strcmp(lut[i].name, name) )
+      {
+        continue;
+      }
 
-    if( !lut[i].func(self) )
-    {
-      continue;
-    }
+      /* Static control paths can't work without led class entries */
+      if( !name && pass == 1 && !led_control_is_plausible(lut[i].entries) )
+      {
+        mce_log(LL_DEBUG, "skipping sysfs led backend: %s", lut[i].name);
+        continue;
+      }
 
-    self->can_breathe = QUIRK(QUIRK_BREATHING_ENABLED, self->can_breathe);
-    self->breath_type = QUIRK(QUIRK_BREATHING_TYPE, self->breath_type);
+      mce_log(LL_DEBUG, "probing sysfs led backend: %s", lut[i].name);
 
-    ack = true;
-    break;
+      /* Backends that benefit from gamma correction override this */
+      self->gamma = LED_UTIL_GAMMA_LINEAR;
+      led_util_reset_gamma();
+
+      if( !lut[i].func(self) )
+      {
+        continue;
+      }
+
+      self->can_breathe = QUIRK(QUIRK_BREATHING_ENABLED, self->can_breathe);
+      self->breath_type = QUIRK(QUIRK_BREATHING_TYPE, self->breath_type);
+      self->gamma       = QUIRK(QUIRK_GAMMA, self->gamma);
+
+      /* Scaling tables are built once for the selected gamma
+       * and max_brightness values registered during probing */
+      led_util_set_gamma(self->gamma);
+
+      winner = lut[i].name;
+      ack = true;
+      break;
+    }
   }
 
+  /* Update cache if probing result differs from cached one */
+  if( !name && g_strcmp0(winner, hint) )
+    led_cache_store(winner);
+
+  /* Scan results are not needed after probing */
+  led_auto_survey_forget();
+
+  free(hint);
   g_free(name);
 
   return ack;
@@ -781,9 +889,9 @@ sysfs_led_static_cb(gpointer aptr)
   // adjust by brightness level
   int l = sysfs_led_curr.level;
 
-  r = led_util_scale_value(r, l);
-  g = led_util_scale_value(g, l);
-  b = led_util_scale_value(b, l);
+  r = led_util_scale_linear(r, l);
+  g = led_util_scale_linear(g, l);
+  b = led_util_scale_linear(b, l);
 
   // set led blinking and color
   sysfs_led_set_rgb_blink(sysfs_led_curr.on, sysfs_led_curr.off);
@@ -817,17 +925,17 @@ sysfs_led_step_cb(gpointer aptr)
   // adjust by brightness level
   int l = sysfs_led_curr.level;
 
-  r = led_util_scale_value(r, l);
-  g = led_util_scale_value(g, l);
-  b = led_util_scale_value(b, l);
+  r = led_util_scale_linear(r, l);
+  g = led_util_scale_linear(g, l);
+  b = led_util_scale_linear(b, l);
 
   // adjust by curve position
   size_t i = sysfs_led_breathe.step++;
   int    v = sysfs_led_breathe.value[i];
 
-  r = led_util_scale_value(r, v);
-  g = led_util_scale_value(g, v);
-  b = led_util_scale_value(b, v);
+  r = led_util_scale_linear(r, v);
+  g = led_util_scale_linear(g, v);
+  b = led_util_scale_linear(b, v);
 
   // set led color
   sysfs_led_set_rgb_value(r, g, b);
@@ -1038,6 +1146,36 @@ sysfs_led_can_breathe(void)
   return led_control_can_breathe(&led_control);
 }
 
+/** Get name of the probed led backend
+ *
+ * @return backend name, or NULL if no backend has been probed
+ */
+const char *
+sysfs_led_get_backend(void)
+{
+  return led_control.name;
+}
+
+/** Get sw breathing ramp type of the probed led backend
+ *
+ * @return LED_RAMP_DISABLED, LED_RAMP_HALF_SINE, or ...
+ */
+led_ramp_t
+sysfs_led_get_breath_type(void)
+{
+  return led_control.name ? led_control_breath_type(&led_control) : LED_RAMP_DISABLED;
+}
+
+/** Query if the probed led backend can blink without cpu involvement
+ *
+ * @return true if kernel / hw handles blinking, false otherwise
+ */
+bool
+sysfs_led_can_blink(void)
+{
+  return led_control.blink != 0;
+}
+
 void
 sysfs_led_set_breathing(bool enable)
 {
@@ -64,6 +64,7 @@ struct led_control_t
   bool        can_breathe;
   bool        use_config;
   led_ramp_t  breath_type;
+  int         gamma;
   void      (*enable)(void *data, bool enable);
   void      (*blink) (void *data, int on_ms, int off_ms);
   void      (*value) (void *data, int r, int g, int b);
@@ -74,6 +75,9 @@ bool sysfs_led_init           (void);
 void sysfs_led_quit           (void);
 bool sysfs_led_set_pattern    (int r, int g, int b, int ms_on, int ms_off);
 bool sysfs_led_can_breathe    (void);
+const char *sysfs_led_get_backend(void);
+led_ramp_t sysfs_led_get_breath_type(void);
+bool sysfs_led_can_blink      (void);
 void sysfs_led_set_breathing  (bool enable);
 void sysfs_led_set_brightness (int level);
 
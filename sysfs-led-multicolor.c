@@ -0,0 +1,547 @@
+/** @file sysfs-led-multicolor.c
+ *
+ * mce-plugin-libhybris - Libhybris plugin for Mode Control Entity
+ * <p>
+ * Copyright (c) 2026 Jollyboys Ltd.
+ * <p>
+ * @author Simo Piiroinen <simo.piiroinen@jollamobile.com>
+ *
+ * mce-plugin-libhybris is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * mce-plugin-libhybris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with mce-plugin-libhybris; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* ========================================================================= *
+ * RGB led control: kernel multicolor led class backend
+ *
+ * One led class device, which:
+ * - must have 'multi_index' file listing color components
+ * - must have 'multi_intensity' control file for the components
+ * - must have 'brightness' and 'max_brightness' control files
+ * - can have "timer" trigger for hw blinking
+ *
+ * Assumptions built into code:
+ *
+ * - Kernel applies changes written to 'multi_intensity' immediately
+ *   using the current 'brightness' value -> brightness is kept at
+ *   maximum and the whole color is changed with a single write.
+ *
+ * - Compared to using separate led class devices for each channel,
+ *   the color does not go through intermediate states while the
+ *   channels are updated one by one.
+ * ========================================================================= */
+
+#include "sysfs-led-multicolor.h"
+
+#include "sysfs-led-util.h"
+#include "sysfs-led-auto.h"
+#include "sysfs-led-cache.h"
+#include "sysfs-val.h"
+#include "plugin-config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <glib.h>
+
+/* ========================================================================= *
+ * PROTOTYPES
+ * ========================================================================= */
+
+/** Maximum number of color components supported */
+#define MULTICOLOR_MAX_COMPONENTS 8
+
+typedef struct
+{
+    const char *brightness;      // W
+    const char *max_brightness;  // R
+    const char *multi_index;     // R
+    const char *multi_intensity; // W
+    const char *trigger;         // W
+    const char *delay_on;        // W
+    const char *delay_off;       // W
+} led_paths_multicolor_t;
+
+/** Source for color component intensity */
+typedef enum
+{
+    MULTICOLOR_SOURCE_NONE,
+    MULTICOLOR_SOURCE_RED,
+    MULTICOLOR_SOURCE_GREEN,
+    MULTICOLOR_SOURCE_BLUE,
+    MULTICOLOR_SOURCE_MONO,
+} led_source_multicolor_t;
+
+typedef struct
+{
+    sysfsval_t              *cached_max_brightness;
+    sysfsval_t              *cached_brightness;
+    sysfsval_t              *cached_delay_on;
+    sysfsval_t              *cached_delay_off;
+
+    int                      fd_multi_intensity;
+    int                      fd_trigger;
+    bool                     timer_active;
+
+    char                    *delay_on_path;
+    char                    *delay_off_path;
+
+    int                      components;
+    led_source_multicolor_t  source[MULTICOLOR_MAX_COMPONENTS];
+
+    /** Last written multi_intensity content, for skipping no-op writes */
+    char                     intensity[MULTICOLOR_MAX_COMPONENTS * 12];
+} led_channel_multicolor_t;
+
+/* ------------------------------------------------------------------------- *
+ * ONE_CHANNEL
+ * ------------------------------------------------------------------------- */
+
+static void        led_channel_multicolor_init          (led_channel_multicolor_t *self);
+static void        led_channel_multicolor_close         (led_channel_multicolor_t *self);
+static bool        led_channel_multicolor_parse_index   (led_channel_multicolor_t *self, const char *path);
+static bool        led_channel_multicolor_probe         (led_channel_multicolor_t *self, const led_paths_multicolor_t *path);
+static void        led_channel_multicolor_set_timer     (led_channel_multicolor_t *self, bool enable);
+static void        led_channel_multicolor_set_value     (led_channel_multicolor_t *self, int r, int g, int b);
+static void        led_channel_multicolor_set_blink     (led_channel_multicolor_t *self, int on_ms, int off_ms);
+
+/* ------------------------------------------------------------------------- *
+ * ALL_CHANNELS
+ * ------------------------------------------------------------------------- */
+
+static void        led_control_multicolor_blink_cb      (void *data, int on_ms, int off_ms);
+static void        led_control_multicolor_value_cb      (void *data, int r, int g, int b);
+static void        led_control_multicolor_close_cb      (void *data);
+
+bool               led_control_multicolor_probe         (led_control_t *self);
+
+/* ========================================================================= *
+ * ONE_CHANNEL
+ * ========================================================================= */
+
+static void
+led_channel_multicolor_init(led_channel_multicolor_t *self)
+{
+    self->cached_max_brightness = sysfsval_create();
+    self->cached_brightness     = sysfsval_create();
+    self->cached_delay_on       = sysfsval_create();
+    self->cached_delay_off      = sysfsval_create();
+
+    self->fd_multi_intensity    = -1;
+    self->fd_trigger            = -1;
+    self->timer_active          = false;
+
+    self->delay_on_path         = 0;
+    self->delay_off_path        = 0;
+
+    self->components            = 0;
+    self->intensity[0]          = 0;
+}
+
+static void
+led_channel_multicolor_close(led_channel_multicolor_t *self)
+{
+    if( self->timer_active )
+        led_channel_multicolor_set_timer(self, false);
+
+    sysfsval_delete_at(&self->cached_max_brightness);
+    sysfsval_delete_at(&self->cached_brightness);
+    sysfsval_delete_at(&self->cached_delay_on);
+    sysfsval_delete_at(&self->cached_delay_off);
+
+    led_util_close_file(&self->fd_multi_intensity);
+    led_util_close_file(&self->fd_trigger);
+
+    free(self->delay_on_path),  self->delay_on_path  = 0;
+    free(self->delay_off_path), self->delay_off_path = 0;
+
+    self->components   = 0;
+    self->intensity[0] = 0;
+}
+
+static bool
+led_channel_multicolor_parse_index(led_channel_multicolor_t *self,
+                                   const char *path)
+{
+    bool  ack  = false;
+    FILE *file = 0;
+    char  name[32];
+
+    int rgb  = 0;
+    int mono = -1;
+
+    self->components = 0;
+
+    if( !path || !(file = fopen(path, "r")) )
+        goto EXIT;
+
+    while( self->components < MULTICOLOR_MAX_COMPONENTS &&
+           fscanf(file, "%31s", name) == 1 ) {
+        led_source_multicolor_t src = MULTICOLOR_SOURCE_NONE;
+
+        if( !strcmp(name, "red") )
+            src = MULTICOLOR_SOURCE_RED, ++rgb;
+        else if( !strcmp(name, "green") )
+            src = MULTICOLOR_SOURCE_GREEN, ++rgb;
+        else if( !strcmp(name, "blue") )
+            src = MULTICOLOR_SOURCE_BLUE, ++rgb;
+        else if( mono == -1 )
+            mono = self->components;
+
+        self->source[self->components++] = src;
+    }
+
+    /* Without any rgb components, drive the 1st one as monochrome led */
+    if( rgb == 0 && mono != -1 )
+        self->source[mono] = MULTICOLOR_SOURCE_MONO, ++rgb;
+
+    mce_log(LL_DEBUG, "%s: %d components, %d usable",
+            path, self->components, rgb);
+
+    ack = (rgb > 0);
+
+EXIT:
+    if( file )
+        fclose(file);
+
+    return ack;
+}
+
+static bool
+led_channel_multicolor_probe(led_channel_multicolor_t *self,
+                             const led_paths_multicolor_t *path)
+{
+    bool res = false;
+    char data[256];
+
+    if( !led_channel_multicolor_parse_index(self, path->multi_index) )
+        goto cleanup;
+
+    if( !sysfsval_open_ro(self->cached_max_brightness, path->max_brightness) )
+        goto cleanup;
+
+    sysfsval_refresh(self->cached_max_brightness);
+
+    if( sysfsval_get(self->cached_max_brightness) <= 0 )
+        goto cleanup;
+
+    led_util_prepare_gamma(sysfsval_get(self->cached_max_brightness));
+
+    if( !sysfsval_open_rw(self->cached_brightness, path->brightness) )
+        goto cleanup;
+
+    if( !led_util_open_file(&self->fd_multi_intensity, path->multi_intensity) )
+        goto cleanup;
+
+    /* Timer trigger is optional */
+    if( path->trigger && path->delay_on && path->delay_off ) {
+        int fd = -1;
+        int rc = -1;
+
+        if( (fd = open(path->trigger, O_RDONLY)) != -1 ) {
+            if( (rc = read(fd, data, sizeof data - 1)) > 0 )
+                data[rc] = 0;
+            close(fd);
+        }
+
+        if( rc > 0 && strstr(data, "timer") &&
+            led_util_open_file(&self->fd_trigger, path->trigger) ) {
+            self->delay_on_path  = strdup(path->delay_on);
+            self->delay_off_path = strdup(path->delay_off);
+        }
+    }
+
+    /* Brightness stays at maximum, color is set via intensities */
+    sysfsval_set(self->cached_brightness,
+                 sysfsval_get(self->cached_max_brightness));
+
+    res = true;
+
+cleanup:
+
+    /* Always close the max_brightness file */
+    sysfsval_close(self->cached_max_brightness);
+
+    /* On failure close the other files too */
+    if( !res ) {
+        sysfsval_close(self->cached_brightness);
+        led_util_close_file(&self->fd_multi_intensity);
+        led_util_close_file(&self->fd_trigger);
+    }
+
+    return res;
+}
+
+static void
+led_channel_multicolor_set_timer(led_channel_multicolor_t *self, bool enable)
+{
+    if( self->fd_trigger == -1 || self->timer_active == enable )
+        goto EXIT;
+
+    self->timer_active = enable;
+
+    /* Note: Timer specific delay_on/off controls exist only
+     *       while the timer trigger is selected */
+    sysfsval_close(self->cached_delay_on);
+    sysfsval_close(self->cached_delay_off);
+
+    dprintf(self->fd_trigger, "%s", enable ? "timer" : "none");
+
+    if( enable ) {
+        sysfsval_open_rw(self->cached_delay_on,  self->delay_on_path);
+        sysfsval_open_rw(self->cached_delay_off, self->delay_off_path);
+    }
+
+    /* Kernel resets delays when trigger changes */
+    sysfsval_invalidate(self->cached_delay_on);
+    sysfsval_invalidate(self->cached_delay_off);
+
+    /* Removing trigger turns the led off -> brightness must be restored */
+    sysfsval_invalidate(self->cached_brightness);
+
+EXIT:
+    return;
+}
+
+static void
+led_channel_multicolor_set_value(led_channel_multicolor_t *self,
+                                 int r, int g, int b)
+{
+    int  max = sysfsval_get(self->cached_max_brightness);
+    char data[sizeof self->intensity];
+    int  size = 0;
+
+    for( int i = 0; i < self->components; ++i ) {
+        int val = 0;
+
+        switch( self->source[i] ) {
+        case MULTICOLOR_SOURCE_RED:   val = r; break;
+        case MULTICOLOR_SOURCE_GREEN: val = g; break;
+        case MULTICOLOR_SOURCE_BLUE:  val = b; break;
+        case MULTICOLOR_SOURCE_MONO:  val = led_util_max3(r, g, b); break;
+        default: break;
+        }
+
+        size += snprintf(data + size, sizeof data - size, "%s%d",
+                         i ? " " : "", led_util_scale_value(val, max));
+    }
+
+    /* Brightness changes only if trigger has been modified */
+    sysfsval_set(self->cached_brightness, max);
+
+    if( !strcmp(self->intensity, data) )
+        goto EXIT;
+
+    mce_log(LL_DEBUG, "multi_intensity: %s -> %s", self->intensity, data);
+
+    /* All components must be written in one go */
+    if( write(self->fd_multi_intensity, data, size) == size )
+        snprintf(self->intensity, sizeof self->intensity, "%s", data);
+    else
+        mce_log(LL_ERR, "multi_intensity: write: %m"), self->intensity[0] = 0;
+
+EXIT:
+    return;
+}
+
+static void
+led_channel_multicolor_set_blink(led_channel_multicolor_t *self,
+                                 int on_ms, int off_ms)
+{
+    led_channel_multicolor_set_timer(self, on_ms > 0 && off_ms > 0);
+
+    sysfsval_set(self->cached_delay_on,  on_ms);
+    sysfsval_set(self->cached_delay_off, off_ms);
+}
+
+/* ========================================================================= *
+ * ALL_CHANNELS
+ * ========================================================================= */
+
+#define MULTICOLOR_CHANNELS 1
+
+static void
+led_control_multicolor_blink_cb(void *data, int on_ms, int off_ms)
+{
+    led_channel_multicolor_t *channel = data;
+    led_channel_multicolor_set_blink(channel + 0, on_ms, off_ms);
+}
+
+static void
+led_control_multicolor_value_cb(void *data, int r, int g, int b)
+{
+    led_channel_multicolor_t *channel = data;
+    led_channel_multicolor_set_value(channel + 0, r, g, b);
+}
+
+static void
+led_control_multicolor_close_cb(void *data)
+{
+    led_channel_multicolor_t *channel = data;
+    led_channel_multicolor_close(channel + 0);
+}
+
+static bool
+led_control_multicolor_probe_directory(led_channel_multicolor_t *channel,
+                                       const char *dir)
+{
+    char brightness[256];
+    char max_brightness[256];
+    char multi_index[256];
+    char multi_intensity[256];
+    char trigger[256];
+    char delay_on[256];
+    char delay_off[256];
+
+    snprintf(brightness,      sizeof brightness,      "%s/brightness",      dir);
+    snprintf(max_brightness,  sizeof max_brightness,  "%s/max_brightness",  dir);
+    snprintf(multi_index,     sizeof multi_index,     "%s/multi_index",     dir);
+    snprintf(multi_intensity, sizeof multi_intensity, "%s/multi_intensity", dir);
+    snprintf(trigger,         sizeof trigger,         "%s/trigger",         dir);
+    snprintf(delay_on,        sizeof delay_on,        "%s/delay_on",        dir);
+    snprintf(delay_off,       sizeof delay_off,       "%s/delay_off",       dir);
+
+    const led_paths_multicolor_t paths =
+    {
+        .brightness      = brightness,
+        .max_brightness  = max_brightness,
+        .multi_index     = multi_index,
+        .multi_intensity = multi_intensity,
+        .trigger         = trigger,
+        .delay_on        = delay_on,
+        .delay_off       = delay_off,
+    };
+
+    return led_channel_multicolor_probe(channel + 0, &paths);
+}
+
+static bool
+led_control_multicolor_static_probe(led_channel_multicolor_t *channel)
+{
+    /** Commonly used multicolor indicator led names */
+    static const char * const names[] =
+    {
+        "rgb:status",
+        "multicolor:status",
+        "rgb:indicator",
+        "multicolor:indicator",
+    };
+
+    bool        ack = false;
+    char        dir[256];
+    const char *any = 0;
+
+    /* Note: Uses led class directory scan that is shared with other
+     *       backends - the directory is not read again and nothing
+     *       gets opened unless a matching entry exists. */
+
+    for( size_t i = 0; !ack && i < G_N_ELEMENTS(names); ++i ) {
+        if( !led_auto_survey_has_entry(names[i]) )
+            continue;
+
+        snprintf(dir, sizeof dir, "%s/%s", LED_CACHE_SYSFS_DIRECTORY, names[i]);
+        ack = led_control_multicolor_probe_directory(channel, dir);
+    }
+
+    /* Fall back to any led class device with multi_index control */
+    if( !ack && (any = led_auto_survey_multicolor()) ) {
+        snprintf(dir, sizeof dir, "%s/%s", LED_CACHE_SYSFS_DIRECTORY, any);
+        ack = led_control_multicolor_probe_directory(channel, dir);
+    }
+
+    return ack;
+}
+
+static bool
+led_control_multicolor_dynamic_probe(led_channel_multicolor_t *channel)
+{
+    static const objconf_t multicolor_conf[] =
+    {
+        OBJCONF_FILE(led_paths_multicolor_t, brightness,      Brightness),
+        OBJCONF_FILE(led_paths_multicolor_t, max_brightness,  MaxBrightness),
+        OBJCONF_FILE(led_paths_multicolor_t, multi_index,     MultiIndex),
+        OBJCONF_FILE(led_paths_multicolor_t, multi_intensity, MultiIntensity),
+        OBJCONF_FILE(led_paths_multicolor_t, trigger,         Trigger),
+        OBJCONF_FILE(led_paths_multicolor_t, delay_on,        DelayOn),
+        OBJCONF_FILE(led_paths_multicolor_t, delay_off,       DelayOff),
+        OBJCONF_STOP
+    };
+
+    static const char * const pfix[MULTICOLOR_CHANNELS] =
+    {
+        "Led",
+    };
+
+    bool ack = false;
+
+    led_paths_multicolor_t paths[MULTICOLOR_CHANNELS];
+
+    memset(paths, 0, sizeof paths);
+    for( size_t i = 0; i < MULTICOLOR_CHANNELS; ++i )
+        objconf_init(multicolor_conf, &paths[i]);
+
+    for( size_t i = 0; i < MULTICOLOR_CHANNELS; ++i ) {
+        if( !objconf_parse(multicolor_conf, &paths[i], pfix[i]) )
+            goto cleanup;
+
+        if( !led_channel_multicolor_probe(channel + i, &paths[i]) )
+            goto cleanup;
+    }
+
+    ack = true;
+
+cleanup:
+
+    for( size_t i = 0; i < MULTICOLOR_CHANNELS; ++i )
+        objconf_quit(multicolor_conf, &paths[i]);
+
+    return ack;
+}
+
+bool
+led_control_multicolor_probe(led_control_t *self)
+{
+    static led_channel_multicolor_t channel[MULTICOLOR_CHANNELS];
+
+    bool res = false;
+
+    led_channel_multicolor_init(channel + 0);
+
+    self->name   = "multicolor";
+    self->data   = channel;
+    self->enable = 0;
+    self->blink  = led_control_multicolor_blink_cb;
+    self->value  = led_control_multicolor_value_cb;
+    self->close  = led_control_multicolor_close_cb;
+
+    /* Single write per step makes sw breathing cheap */
+    self->can_breathe = true;
+
+    /* Multicolor class leds are typically driven with linear pwm,
+     * use perceptual brightness curve to get even ramps */
+    self->gamma = 220;
+
+    if( self->use_config )
+        res = led_control_multicolor_dynamic_probe(channel);
+
+    if( !res )
+        res = led_control_multicolor_static_probe(channel);
+
+    if( !res )
+        led_control_close(self);
+
+    return res;
+}
@@ -115,6 +115,8 @@ led_channel_redgreen_probe(led_channel_redgreen_t *self,
     if( sysfsval_get(self->cached_max_brightness) <= 0 )
         goto cleanup;
 
+    led_util_prepare_gamma(sysfsval_get(self->cached_max_brightness));
+
     res = true;
 
 cleanup:
@@ -27,6 +27,8 @@
 #include "plugin-logging.h"
 
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
@@ -35,12 +37,16 @@
  * PROTOTYPES
  * ========================================================================= */
 
-int  led_util_read_number(const char *path);
-void led_util_close_file (int *fd_ptr);
-bool led_util_open_file  (int *fd_ptr, const char *path);
-int  led_util_scale_value(int in, int max);
-int  led_util_gcd        (int a, int b);
-int  led_util_roundup    (int val, int range);
+int  led_util_read_number   (const char *path);
+void led_util_close_file    (int *fd_ptr);
+bool led_util_open_file     (int *fd_ptr, const char *path);
+int  led_util_scale_value   (int in, int max);
+void led_util_reset_gamma   (void);
+void led_util_prepare_gamma (int max);
+void led_util_set_gamma     (int gamma);
+int  led_util_get_gamma     (void);
+int  led_util_gcd           (int a, int b);
+int  led_util_roundup       (int val, int range);
 
 /* ========================================================================= *
  * FUNCTIONS
@@ -107,19 +113,178 @@ led_util_open_file(int *fd_ptr, const char *path)
   return res;
 }
 
-/** Scale value from 0...255 to 0...max range
+/** Maximum number of distinct max_brightness values with gamma table */
+#define LED_UTIL_GAMMA_TABLES 8
+
+/** Precomputed 0...255 to 0...max mapping for one max_brightness value */
+typedef struct
+{
+  int max;
+  int lut[256];
+} led_util_gamma_table_t;
+
+/** Gamma [percent] in use, LED_UTIL_GAMMA_LINEAR means no correction */
+static int led_util_gamma = LED_UTIL_GAMMA_LINEAR;
+
+/** Gamma tables for max_brightness values seen during probing */
+static led_util_gamma_table_t led_util_gamma_table[LED_UTIL_GAMMA_TABLES];
+
+/** Number of valid entries in led_util_gamma_table */
+static int led_util_gamma_tables = 0;
+
+/** Map 0...255 value to 0...max range using current gamma
  *
  * Note: zero / nonzero nature of input is preserved in output
  */
-int
-led_util_scale_value(int in, int max)
+static int
+led_util_gamma_eval(int in, int max)
 {
   int out = 0;
-  if( in > 0 )
-    out = led_util_trans(in, 1, 255, 1, max);
+  if( in > 0 && max > 0 )
+  {
+    double v = pow(in / 255.0, led_util_gamma / 100.0);
+    out = led_util_clamp((int)(v * max + 0.5), 1, max);
+  }
   return out;
 }
 
+/** Fill in gamma table using current gamma
+ */
+static void
+led_util_gamma_build(led_util_gamma_table_t *table)
+{
+  for( int in = 0; in < 256; ++in )
+    table->lut[in] = led_util_gamma_eval(in, table->max);
+
+  mce_log(LL_DEBUG, "gamma %d%% table for max=%d: %d %d %d ... %d",
+          led_util_gamma, table->max,
+          table->lut[1], table->lut[2], table->lut[3], table->lut[255]);
+}
+
+/** Lookup gamma table for given max_brightness value
+ *
+ * Tables are normally built at probe time, this builds missing
+ * ones only if max_brightness changes after probing.
+ *
+ * @return table, or NULL if table cache is full
+ */
+static const led_util_gamma_table_t *
+led_util_gamma_lookup(int max)
+{
+  led_util_gamma_table_t *table = 0;
+
+  for( int i = 0; i < led_util_gamma_tables; ++i )
+  {
+    if( led_util_gamma_table[i].max == max )
+      return &led_util_gamma_table[i];
+  }
+
+  if( led_util_gamma_tables < LED_UTIL_GAMMA_TABLES )
+  {
+    table = &led_util_gamma_table[led_util_gamma_tables++];
+    table->max = max;
+    led_util_gamma_build(table);
+  }
+
+  return table;
+}
+
+/** Forget max_brightness values seen during probing
+ *
+ * Should be called before probing a led backend, so that values
+ * from backends that failed to probe do not occupy table slots.
+ */
+void
+led_util_reset_gamma(void)
+{
+  led_util_gamma        = LED_UTIL_GAMMA_LINEAR;
+  led_util_gamma_tables = 0;
+  memset(led_util_gamma_table, 0, sizeof led_util_gamma_table);
+}
+
+/** Register max_brightness value used by a led channel
+ *
+ * Backends call this when probing channels, so that scaling tables
+ * can be built before the first brightness write.
+ *
+ * @param max  max_brightness value of a led channel
+ */
+void
+led_util_prepare_gamma(int max)
+{
+  if( max <= 0 )
+    goto EXIT;
+
+  for( int i = 0; i < led_util_gamma_tables; ++i )
+  {
+    if( led_util_gamma_table[i].max == max )
+      goto EXIT;
+  }
+
+  if( led_util_gamma_tables < LED_UTIL_GAMMA_TABLES )
+    led_util_gamma_table[led_util_gamma_tables++].max = max;
+
+EXIT:
+  return;
+}
+
+/** Set gamma used for scaling values to hw brightness range
+ *
+ * Gamma tables are (re)built for all max_brightness values
+ * registered via led_util_prepare_gamma().
+ *
+ * @param gamma  gamma * 100, e.g. 220 for gamma 2.2
+ */
+void
+led_util_set_gamma(int gamma)
+{
+  if( gamma <= 0 )
+    gamma = LED_UTIL_GAMMA_LINEAR;
+
+  mce_log(LL_DEBUG, "led gamma: %d%%", gamma);
+
+  led_util_gamma = gamma;
+
+  if( led_util_gamma == LED_UTIL_GAMMA_LINEAR )
+    goto EXIT;
+
+  for( int i = 0; i < led_util_gamma_tables; ++i )
+    led_util_gamma_build(&led_util_gamma_table[i]);
+
+EXIT:
+  return;
+}
+
+/** Get gamma used for scaling values to hw brightness range
+ *
+ * @return gamma * 100
+ */
+int
+led_util_get_gamma(void)
+{
+  return led_util_gamma;
+}
+
+/** Scale value from 0...255 to 0...max hw brightness range
+ *
+ * Uses gamma correction if configured, linear mapping otherwise.
+ *
+ * Note: zero / nonzero nature of input is preserved in output
+ */
+int
+led_util_scale_value(int in, int max)
+{
+  const led_util_gamma_table_t *table = 0;
+
+  if( in <= 0 || led_util_gamma == LED_UTIL_GAMMA_LINEAR )
+    return led_util_scale_linear(in, max);
+
+  if( (table = led_util_gamma_lookup(max)) )
+    return table->lut[led_util_min(in, 255)];
+
+  return led_util_gamma_eval(led_util_min(in, 255), max);
+}
+
 /** Calculate the greatest common divisor of two integer numbers
  */
 int
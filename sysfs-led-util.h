@@ -75,15 +75,35 @@ static inline int led_util_trans(int v, int l1, int h1, int l2, int h2)
     return led_util_clamp(l2 + (d2 * (v - l1) + d1 / 2) / d1, l2, h2);
 }
 
+/** Linearly scale value from 0...255 to 0...max range
+ *
+ * Note: zero / nonzero nature of input is preserved in output
+ */
+static inline int led_util_scale_linear(int in, int max)
+{
+    return in > 0 ? led_util_trans(in, 1, 255, 1, max) : 0;
+}
+
+/* ========================================================================= *
+ * GAMMA
+ * ========================================================================= */
+
+/** Gamma value [percent] that yields linear brightness mapping */
+# define LED_UTIL_GAMMA_LINEAR 100
+
 /* ========================================================================= *
  * Prototypes
  * ========================================================================= */
 
-int  led_util_read_number (const char *path);
-void led_util_close_file  (int *fd_ptr);
-bool led_util_open_file   (int *fd_ptr, const char *path);
-int  led_util_scale_value (int in, int max);
-int  led_util_gcd         (int a, int b);
-int  led_util_roundup     (int val, int range);
+int  led_util_read_number   (const char *path);
+void led_util_close_file    (int *fd_ptr);
+bool led_util_open_file     (int *fd_ptr, const char *path);
+int  led_util_scale_value   (int in, int max);
+void led_util_reset_gamma   (void);
+void led_util_prepare_gamma (int max);
+void led_util_set_gamma     (int gamma);
+int  led_util_get_gamma     (void);
+int  led_util_gcd           (int a, int b);
+int  led_util_roundup       (int val, int range);
 
 #endif /* SYSFS_LED_UTIL_H_ */
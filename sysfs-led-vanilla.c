@@ -147,6 +147,8 @@ led_channel_vanilla_probe(led_channel_vanilla_t *self,
   if( sysfsval_get(self->cached_max_brightness) <= 0 )
     goto cleanup;
 
+  led_util_prepare_gamma(sysfsval_get(self->cached_max_brightness));
+
   // we always must have brightness control
   if( !sysfsval_open_rw(self->cached_brightness, path->brightness) )
     goto cleanup;
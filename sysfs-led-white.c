@@ -113,6 +113,8 @@ led_channel_white_probe(led_channel_white_t *self,
     if( sysfsval_get(self->cached_max_brightness) <= 0 )
         goto cleanup;
 
+    led_util_prepare_gamma(sysfsval_get(self->cached_max_brightness));
+
     res = true;
 
 cleanup: